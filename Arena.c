@@ -0,0 +1,121 @@
+/********************************************************************************
+* Program Name: Arena.c
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: This is a bump allocator for the memory smallsh needs while it
+*   builds and runs one command line. Allocations are never freed one at a time.
+*   ResetArena() rewinds every block at once and keeps them, so after the first
+*   few lines parsing does not call malloc or free at all.
+********************************************************************************/
+#include "Arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_BLOCK_SIZE (64 * 1024) /* Smallest block, enough for most lines */
+#define ARENA_ALIGN sizeof(void *)
+
+/********************************************************************************
+* Description: NewBlock()
+*   This function allocates a block with room for at least size bytes.
+********************************************************************************/
+static struct arenaBlock *NewBlock(size_t size) {
+  struct arenaBlock *block;
+
+  if (size < ARENA_BLOCK_SIZE) {
+    size = ARENA_BLOCK_SIZE;
+  }
+  block = (struct arenaBlock *) malloc(sizeof(struct arenaBlock) + size);
+  if (block == NULL) {
+    abort();
+  }
+  block->next = NULL;
+  block->size = size;
+  block->used = 0;
+  return block;
+}
+
+/********************************************************************************
+* Description: InitArena()
+*   This function sets up an empty arena. No memory is allocated until the first
+*   call to ArenaAlloc().
+********************************************************************************/
+void InitArena(struct arena *arena) {
+  arena->head = NULL;
+  arena->current = NULL;
+}
+
+/********************************************************************************
+* Description: ArenaAlloc()
+*   This function returns size bytes of pointer-aligned memory from the arena.
+*   When the current block is full, the next kept block is reused if it is big
+*   enough; otherwise a block twice the size of the current one (or the request,
+*   if larger) is inserted after it.
+********************************************************************************/
+void *ArenaAlloc(struct arena *arena, size_t size) {
+  struct arenaBlock *block = arena->current;
+  struct arenaBlock *grown;
+  void *memory;
+
+  size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+  if (block == NULL) {
+    arena->head = arena->current = block = NewBlock(size);
+  }
+
+  while (block->size - block->used < size) {
+    if (block->next != NULL && block->next->size >= size) {
+      block = block->next;
+      block->used = 0;
+    } else {
+      grown = NewBlock(size > block->size * 2 ? size : block->size * 2);
+      grown->next = block->next;
+      block->next = grown;
+      block = grown;
+    }
+  }
+  arena->current = block;
+
+  memory = block->data + block->used;
+  block->used += size;
+  return memory;
+}
+
+/********************************************************************************
+* Description: ArenaStrndup()
+*   This function copies length bytes of a string into the arena and terminates
+*   the copy.
+********************************************************************************/
+char *ArenaStrndup(struct arena *arena, const char *string, size_t length) {
+  char *copy = (char *) ArenaAlloc(arena, length + 1);
+  memcpy(copy, string, length);
+  copy[length] = '\0';
+  return copy;
+}
+
+/********************************************************************************
+* Description: ResetArena()
+*   This function releases everything allocated from the arena at once. The
+*   blocks are kept for the next command line.
+********************************************************************************/
+void ResetArena(struct arena *arena) {
+  arena->current = arena->head;
+  if (arena->head != NULL) {
+    arena->head->used = 0;
+  }
+}
+
+/********************************************************************************
+* Description: FreeArena()
+*   This function returns every block of the arena to the system.
+********************************************************************************/
+void FreeArena(struct arena *arena) {
+  struct arenaBlock *block = arena->head;
+  struct arenaBlock *next;
+
+  while (block != NULL) {
+    next = block->next;
+    free(block);
+    block = next;
+  }
+  InitArena(arena);
+}
@@ -0,0 +1,30 @@
+/********************************************************************************
+* Program Name: Arena.h
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: Header file for Arena.c. A bump allocator that holds everything
+*   built for one command line and is reset between prompts.
+********************************************************************************/
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+struct arenaBlock {
+  struct arenaBlock *next;
+  size_t size; /* Bytes available in data[] */
+  size_t used;
+  char data[];
+};
+
+struct arena {
+  struct arenaBlock *head;    /* First block, kept across resets */
+  struct arenaBlock *current; /* Block allocations are bumped from */
+};
+
+void InitArena(struct arena *arena);
+void *ArenaAlloc(struct arena *arena, size_t size);
+char *ArenaStrndup(struct arena *arena, const char *string, size_t length);
+void ResetArena(struct arena *arena);
+void FreeArena(struct arena *arena);
+#endif
@@ -0,0 +1,889 @@
+/********************************************************************************
+* Program Name: Builtins.c
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: This is the registry of smallsh builtins and the small utilities
+*   that run inside the shell. Names are found with a perfect hash over their
+*   first, second and last characters and their length, computed at compile
+*   time, so a lookup is one hash and one strcmp. echo, true, false, pwd, test
+*   ([), printf, sleep, cat and cp are common enough in scripts that running
+*   them in the shell saves a spawn per line.
+********************************************************************************/
+#include "Builtins.h"
+#include "Copy.h"
+#include "Directory.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#define BUILTIN_SLOTS 64 /* Size of the registry, a power of two */
+
+/* The perfect hash. The multipliers were chosen so that no two builtin names */
+/* share a slot. A name that collides is a compile error below, and the fix is */
+/* to pick new multipliers. */
+#define NAME_HASH(first, second, last, length) \
+  (((first) + (second) * 5 + (last) * 6 + (length)) & (BUILTIN_SLOTS - 1))
+
+volatile sig_atomic_t interrupted = 0; /* Set by SIGINT while a utility or "wait" waits */
+
+/********************************************************************************
+* Description: catchInterrupt()
+*   This function is the SIGINT handler while a utility that can wait runs.
+********************************************************************************/
+static void catchInterrupt(int signo) {
+  interrupted = 1;
+}
+
+/********************************************************************************
+* Description: AllowInterrupt()
+*   This function installs a SIGINT handler, saving the old action, so that a
+*   utility that sleeps or copies, or "wait", can be stopped with Ctrl-C. The
+*   shell itself ignores SIGINT. The handler has no SA_RESTART, so a blocked
+*   call returns EINTR.
+********************************************************************************/
+void AllowInterrupt(struct sigaction *oldAction) {
+  struct sigaction SIGINT_action = {{0}};
+
+  interrupted = 0;
+  SIGINT_action.sa_handler = catchInterrupt;
+  sigfillset(&SIGINT_action.sa_mask);
+  sigaction(SIGINT, &SIGINT_action, oldAction);
+}
+
+/********************************************************************************
+* Description: EndInterrupt()
+*   This function puts back the SIGINT action saved by AllowInterrupt().
+********************************************************************************/
+void EndInterrupt(struct sigaction *oldAction) {
+  sigaction(SIGINT, oldAction, NULL);
+}
+
+/********************************************************************************
+* Description: FinishOutput()
+*   This function flushes a utility's output and returns its exit value: 0, or
+*   1 after printing an error if the output could not be written.
+********************************************************************************/
+static int FinishOutput(const char *name) {
+  if (fflush(stdout) != 0 || ferror(stdout)) {
+    perror(name);
+    clearerr(stdout);
+    return 1;
+  }
+  return 0;
+}
+
+/********************************************************************************
+* Description: PutEscape()
+*   This function prints the backslash escape that text points at and returns
+*   the text after it. Octal escapes take up to three digits, after a leading
+*   0 if zeroOctal is set (as echo and printf's %b do). \c sets stop.
+********************************************************************************/
+static const char *PutEscape(const char *text, bool zeroOctal, bool *stop) {
+  const char *from = "\\abefnrtv";
+  const char *to = "\\\a\b\033\f\n\r\t\v";
+  const char *match;
+  int value = 0;
+  int digits = 0;
+
+  text++; /* Skip the backslash */
+  if (*text == 'c') {
+    *stop = true;
+    return text + 1;
+  } else if (*text != '\0' && (match = strchr(from, *text)) != NULL) {
+    putchar(to[match - from]);
+    return text + 1;
+  } else if (*text == 'x' && isxdigit((unsigned char) text[1])) {
+    for (text++; digits < 2 && isxdigit((unsigned char) *text); digits++, text++) {
+      value = value * 16 + (isdigit((unsigned char) *text) ? *text - '0'
+                                                           : tolower(*text) - 'a' + 10);
+    }
+    putchar(value);
+    return text;
+  } else if (*text >= '0' && *text <= '7' && (!zeroOctal || *text == '0')) {
+    if (zeroOctal) {
+      text++;
+    }
+    for (; digits < 3 && *text >= '0' && *text <= '7'; digits++, text++) {
+      value = value * 8 + *text - '0';
+    }
+    putchar(value);
+    return text;
+  }
+  putchar('\\'); /* Not an escape, print the backslash as is */
+  return text;
+}
+
+/********************************************************************************
+* Description: PutEscaped()
+*   This function prints text, interpreting its backslash escapes as echo -e
+*   does. Printing stops at \c, which sets stop.
+********************************************************************************/
+static void PutEscaped(const char *text, bool *stop) {
+  while (*text != '\0' && !*stop) {
+    if (*text == '\\') {
+      text = PutEscape(text, true, stop);
+    } else {
+      putchar(*text++);
+    }
+  }
+}
+
+/********************************************************************************
+* Description: Echo()
+*   This function responds to the command "echo". It prints its arguments
+*   separated by spaces. Leading options made of n, e and E leave off the
+*   newline (-n) and turn escapes on (-e) or off (-E), as in coreutils.
+********************************************************************************/
+static int Echo(struct command *input) {
+  const char *flag;
+  bool newline = true;
+  bool escapes = false;
+  bool stop = false;
+  int first = 1;
+  int i;
+
+  while (first < input->argCount && input->args[first][0] == '-' &&
+         input->args[first][1] != '\0' &&
+         input->args[first][1 + strspn(input->args[first] + 1, "neE")] == '\0') {
+    for (flag = input->args[first] + 1; *flag != '\0'; flag++) {
+      if (*flag == 'n') {
+        newline = false;
+      } else {
+        escapes = *flag == 'e';
+      }
+    }
+    first++;
+  }
+
+  for (i = first; i < input->argCount && !stop; i++) {
+    if (i > first) {
+      putchar(' ');
+    }
+    if (escapes) {
+      PutEscaped(input->args[i], &stop);
+    } else {
+      fputs(input->args[i], stdout);
+    }
+  }
+  if (newline && !stop) {
+    putchar('\n');
+  }
+  return FinishOutput("echo");
+}
+
+/********************************************************************************
+* Description: True()
+*   This function responds to the command "true".
+********************************************************************************/
+static int True(struct command *input) {
+  return 0;
+}
+
+/********************************************************************************
+* Description: False()
+*   This function responds to the command "false".
+********************************************************************************/
+static int False(struct command *input) {
+  return 1;
+}
+
+/********************************************************************************
+* Description: PrintDir()
+*   This function responds to the command "pwd". It prints the working
+*   directory, which is only looked up again after it changes, or with -P asks
+*   getcwd() even if nothing changed.
+********************************************************************************/
+static int PrintDir(struct command *input) {
+  char physicalDir[PATH_MAX];
+  const char *path;
+
+  if (input->argCount == 1 || (input->argCount == 2 && strcmp(input->args[1], "-L") == 0)) {
+    path = CurrentDir();
+    if (path == NULL) {
+      perror("pwd");
+      return 1;
+    }
+    puts(path);
+  } else if (input->argCount == 2 && strcmp(input->args[1], "-P") == 0) {
+    if (getcwd(physicalDir, sizeof(physicalDir)) == NULL) {
+      perror("pwd");
+      return 1;
+    }
+    puts(physicalDir);
+  } else {
+    fprintf(stderr, "usage: pwd [-L | -P]\n");
+    return 1;
+  }
+  return FinishOutput("pwd");
+}
+
+/********************************************************************************
+* Description: TestInteger()
+*   This function reads a whole decimal integer for test. Returns false and
+*   prints an error if the text is not one.
+********************************************************************************/
+static bool TestInteger(const char *text, long long *value) {
+  char *end;
+
+  errno = 0;
+  *value = strtoll(text, &end, 10);
+  if (end == text || *end != '\0' || errno != 0) {
+    fprintf(stderr, "test: %s: integer expression expected\n", text);
+    return false;
+  }
+  return true;
+}
+
+/********************************************************************************
+* Description: IsBinaryTest()
+*   This function returns whether op is one of test's binary operators.
+********************************************************************************/
+static bool IsBinaryTest(const char *op) {
+  const char *operators[] = {"=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le",
+                             "-gt", "-ge", "-nt", "-ot", "-ef"};
+  int i;
+
+  for (i = 0; i < (int) (sizeof(operators) / sizeof(operators[0])); i++) {
+    if (strcmp(op, operators[i]) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/********************************************************************************
+* Description: TestUnary()
+*   This function evaluates a unary test such as -f file or -z string. Returns
+*   0 for true, 1 for false and 2 for an unknown operator.
+********************************************************************************/
+static int TestUnary(const char *op, const char *operand) {
+  struct stat info;
+
+  if (op[0] != '-' || op[1] == '\0' || op[2] != '\0' ||
+      strchr("bcdefghkLnprsStuwxzGO", op[1]) == NULL) {
+    fprintf(stderr, "test: %s: unary operator expected\n", op);
+    return 2;
+  }
+  switch (op[1]) {
+    case 'z': return operand[0] != '\0';
+    case 'n': return operand[0] == '\0';
+    case 't': return !isatty(atoi(operand));
+    case 'r': return access(operand, R_OK) != 0;
+    case 'w': return access(operand, W_OK) != 0;
+    case 'x': return access(operand, X_OK) != 0;
+    case 'h':
+    case 'L': return lstat(operand, &info) != 0 || !S_ISLNK(info.st_mode);
+  }
+
+  if (stat(operand, &info) != 0) {
+    return 1;
+  }
+  switch (op[1]) {
+    case 'b': return !S_ISBLK(info.st_mode);
+    case 'c': return !S_ISCHR(info.st_mode);
+    case 'd': return !S_ISDIR(info.st_mode);
+    case 'f': return !S_ISREG(info.st_mode);
+    case 'p': return !S_ISFIFO(info.st_mode);
+    case 'S': return !S_ISSOCK(info.st_mode);
+    case 'g': return !(info.st_mode & S_ISGID);
+    case 'u': return !(info.st_mode & S_ISUID);
+    case 'k': return !(info.st_mode & S_ISVTX);
+    case 's': return info.st_size == 0;
+    case 'G': return info.st_gid != getegid();
+    case 'O': return info.st_uid != geteuid();
+  }
+  return 0; /* -e */
+}
+
+/********************************************************************************
+* Description: TestBinary()
+*   This function evaluates a binary test such as a = b, n -lt m or f -nt g.
+*   Returns 0 for true, 1 for false and 2 for a bad integer.
+********************************************************************************/
+static int TestBinary(const char *left, const char *op, const char *right) {
+  struct stat leftInfo;
+  struct stat rightInfo;
+  long long leftValue;
+  long long rightValue;
+  bool hasLeft;
+  bool hasRight;
+
+  if (op[0] != '-') {
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) {
+      return strcmp(left, right) != 0;
+    } else if (strcmp(op, "!=") == 0) {
+      return strcmp(left, right) == 0;
+    }
+    return op[0] == '<' ? strcmp(left, right) >= 0 : strcmp(left, right) <= 0;
+  }
+
+  if (op[1] == 'n' && op[2] == 't') { /* Newer, older and same file */
+    hasLeft = stat(left, &leftInfo) == 0;
+    hasRight = stat(right, &rightInfo) == 0;
+    return !(hasLeft && (!hasRight || leftInfo.st_mtime > rightInfo.st_mtime));
+  } else if (op[1] == 'o' && op[2] == 't') {
+    hasLeft = stat(left, &leftInfo) == 0;
+    hasRight = stat(right, &rightInfo) == 0;
+    return !(hasRight && (!hasLeft || leftInfo.st_mtime < rightInfo.st_mtime));
+  } else if (op[1] == 'e' && op[2] == 'f') {
+    return !(stat(left, &leftInfo) == 0 && stat(right, &rightInfo) == 0 &&
+             leftInfo.st_dev == rightInfo.st_dev && leftInfo.st_ino == rightInfo.st_ino);
+  }
+
+  if (!TestInteger(left, &leftValue) || !TestInteger(right, &rightValue)) {
+    return 2;
+  }
+  if (strcmp(op, "-eq") == 0) {
+    return !(leftValue == rightValue);
+  } else if (strcmp(op, "-ne") == 0) {
+    return !(leftValue != rightValue);
+  } else if (strcmp(op, "-lt") == 0) {
+    return !(leftValue < rightValue);
+  } else if (strcmp(op, "-le") == 0) {
+    return !(leftValue <= rightValue);
+  } else if (strcmp(op, "-gt") == 0) {
+    return !(leftValue > rightValue);
+  }
+  return !(leftValue >= rightValue);
+}
+
+/********************************************************************************
+* Description: Negate()
+*   This function turns a test result around, leaving errors alone.
+********************************************************************************/
+static int Negate(int result) {
+  return result == 2 ? 2 : !result;
+}
+
+struct testParser {  /* Arguments of a test with -a, -o and parentheses */
+  char **args;
+  int count;
+  int next;          /* The argument to read next */
+};
+
+static int TestOr(struct testParser *parser);
+
+/********************************************************************************
+* Description: TestPrimary()
+*   This function reads one primary of a longer test: a binary test, a unary
+*   test, a parenthesized expression or a lone string, tried in that order.
+********************************************************************************/
+static int TestPrimary(struct testParser *parser) {
+  char **args = parser->args + parser->next;
+  int remaining = parser->count - parser->next;
+  int result;
+
+  if (remaining == 0) {
+    fprintf(stderr, "test: argument expected\n");
+    return 2;
+  }
+  if (remaining >= 3 && IsBinaryTest(args[1])) {
+    parser->next += 3;
+    return TestBinary(args[0], args[1], args[2]);
+  } else if (strcmp(args[0], "(") == 0) {
+    parser->next++;
+    result = TestOr(parser);
+    if (parser->next == parser->count || strcmp(parser->args[parser->next], ")") != 0) {
+      fprintf(stderr, "test: missing ')'\n");
+      return 2;
+    }
+    parser->next++;
+    return result;
+  } else if (remaining >= 2 && args[0][0] == '-' && args[0][1] != '\0' &&
+             args[0][2] == '\0' && strchr("bcdefghkLnprsStuwxzGO", args[0][1]) != NULL) {
+    parser->next += 2;
+    return TestUnary(args[0], args[1]);
+  }
+  parser->next++;
+  return args[0][0] == '\0';
+}
+
+/********************************************************************************
+* Description: TestNot()
+*   This function reads a primary with any number of "!" before it.
+********************************************************************************/
+static int TestNot(struct testParser *parser) {
+  if (parser->count - parser->next > 1 && strcmp(parser->args[parser->next], "!") == 0) {
+    parser->next++;
+    return Negate(TestNot(parser));
+  }
+  return TestPrimary(parser);
+}
+
+/********************************************************************************
+* Description: TestAnd()
+*   This function reads primaries joined by -a, which binds tighter than -o.
+********************************************************************************/
+static int TestAnd(struct testParser *parser) {
+  int result = TestNot(parser);
+  int right;
+
+  while (result != 2 && parser->next < parser->count &&
+         strcmp(parser->args[parser->next], "-a") == 0) {
+    parser->next++;
+    right = TestNot(parser);
+    result = right == 2 ? 2 : (result == 0 && right == 0 ? 0 : 1);
+  }
+  return result;
+}
+
+/********************************************************************************
+* Description: TestOr()
+*   This function reads -a expressions joined by -o.
+********************************************************************************/
+static int TestOr(struct testParser *parser) {
+  int result = TestAnd(parser);
+  int right;
+
+  while (result != 2 && parser->next < parser->count &&
+         strcmp(parser->args[parser->next], "-o") == 0) {
+    parser->next++;
+    right = TestAnd(parser);
+    result = right == 2 ? 2 : (result == 0 || right == 0 ? 0 : 1);
+  }
+  return result;
+}
+
+/********************************************************************************
+* Description: TestExpression()
+*   This function evaluates test arguments. Up to four are decided by the POSIX
+*   rules, which go by the number of arguments. Anything else, such as a test
+*   joined with -a or -o, is read by precedence: "!" first, then -a, then -o,
+*   with parentheses for grouping. Returns 0 for true, 1 for false and 2 for
+*   an error.
+********************************************************************************/
+static int TestExpression(char **args, int count) {
+  struct testParser parser = {args, count, 0};
+  int result;
+
+  switch (count) {
+    case 0:
+      return 1;
+    case 1:
+      return args[0][0] == '\0';
+    case 2:
+      if (strcmp(args[0], "!") == 0) {
+        return Negate(TestExpression(args + 1, 1));
+      }
+      return TestUnary(args[0], args[1]);
+    case 3:
+      if (IsBinaryTest(args[1])) {
+        return TestBinary(args[0], args[1], args[2]);
+      } else if (strcmp(args[0], "!") == 0) {
+        return Negate(TestExpression(args + 1, 2));
+      } else if (strcmp(args[0], "(") == 0 && strcmp(args[2], ")") == 0) {
+        return TestExpression(args + 1, 1);
+      }
+      break;
+    case 4:
+      if (strcmp(args[0], "!") == 0) {
+        return Negate(TestExpression(args + 1, 3));
+      } else if (strcmp(args[0], "(") == 0 && strcmp(args[3], ")") == 0) {
+        return TestExpression(args + 1, 2);
+      }
+      break;
+  }
+  result = TestOr(&parser);
+  if (result != 2 && parser.next < count) {
+    fprintf(stderr, "test: %s: unexpected argument\n", args[parser.next]);
+    return 2;
+  }
+  return result;
+}
+
+/********************************************************************************
+* Description: Test()
+*   This function responds to the commands "test" and "[", which must end with
+*   "]". See TestExpression() for what it handles.
+********************************************************************************/
+static int Test(struct command *input) {
+  int count = input->argCount - 1;
+
+  if (input->args[0][0] == '[') {
+    if (count == 0 || strcmp(input->args[count], "]") != 0) {
+      fprintf(stderr, "[: missing ']'\n");
+      return 2;
+    }
+    count--;
+  }
+  return TestExpression(input->args + 1, count);
+}
+
+/********************************************************************************
+* Description: PrintfNumber()
+*   This function reads a printf argument as an integer. A leading quote gives
+*   the value of the next character. A missing argument is 0, and a bad one
+*   prints an error and sets result to 1.
+********************************************************************************/
+static long long PrintfNumber(const char *text, int *result) {
+  long long value;
+  char *end;
+
+  if (text == NULL) {
+    return 0;
+  } else if (text[0] == '\'' || text[0] == '"') {
+    return (unsigned char) text[1];
+  }
+  errno = 0;
+  value = strtoll(text, &end, 0);
+  if (end == text || *end != '\0' || errno != 0) {
+    fprintf(stderr, "printf: %s: invalid number\n", text);
+    *result = 1;
+  }
+  return value;
+}
+
+/********************************************************************************
+* Description: PrintfFloat()
+*   This function reads a printf argument as a floating point number, like
+*   PrintfNumber() does for integers.
+********************************************************************************/
+static double PrintfFloat(const char *text, int *result) {
+  double value;
+  char *end;
+
+  if (text == NULL) {
+    return 0;
+  } else if (text[0] == '\'' || text[0] == '"') {
+    return (unsigned char) text[1];
+  }
+  value = strtod(text, &end);
+  if (end == text || *end != '\0') {
+    fprintf(stderr, "printf: %s: invalid number\n", text);
+    *result = 1;
+  }
+  return value;
+}
+
+/********************************************************************************
+* Description: Printf()
+*   This function responds to the command "printf format [argument ...]". The
+*   format is reused until every argument has been printed. Conversions may
+*   have flags, a width and a precision, and %b prints its argument with echo
+*   escapes. Missing arguments are empty or 0.
+********************************************************************************/
+static int Printf(struct command *input) {
+  const char *format;
+  const char *argument;
+  char spec[48];
+  char single[2] = {'\0', '\0'};
+  char conversion;
+  bool stop = false;
+  int result = 0;
+  int next = 2;
+  int first;
+  int length;
+
+  if (input->argCount < 2) {
+    fprintf(stderr, "usage: printf format [argument ...]\n");
+    return 1;
+  }
+
+  do {
+    first = next;
+    for (format = input->args[1]; *format != '\0' && !stop; ) {
+      if (*format == '\\') {
+        format = PutEscape(format, false, &stop);
+        continue;
+      } else if (*format != '%') {
+        putchar(*format++);
+        continue;
+      } else if (format[1] == '%') {
+        putchar('%');
+        format += 2;
+        continue;
+      }
+
+      /* Copy the conversion's flags, width and precision */
+      length = 1 + strspn(format + 1, "-+ #0");
+      length += strspn(format + length, "0123456789");
+      if (format[length] == '.') {
+        length++;
+        length += strspn(format + length, "0123456789");
+      }
+      conversion = format[length];
+      if (conversion == '\0' || strchr("diouxXcsbfFeEgGaA", conversion) == NULL ||
+          length > (int) sizeof(spec) - 4) {
+        fprintf(stderr, "printf: %.*s: invalid conversion\n", length + 1, format);
+        return 1;
+      }
+      memcpy(spec, format, length);
+      format += length + 1;
+      argument = next < input->argCount ? input->args[next++] : NULL;
+
+      if (strchr("di", conversion) != NULL) {
+        sprintf(spec + length, "ll%c", conversion);
+        printf(spec, PrintfNumber(argument, &result));
+      } else if (strchr("ouxX", conversion) != NULL) {
+        sprintf(spec + length, "ll%c", conversion);
+        printf(spec, (unsigned long long) PrintfNumber(argument, &result));
+      } else if (strchr("fFeEgGaA", conversion) != NULL) {
+        sprintf(spec + length, "%c", conversion);
+        printf(spec, PrintfFloat(argument, &result));
+      } else if (conversion == 'b') {
+        PutEscaped(argument != NULL ? argument : "", &stop);
+      } else {
+        if (conversion == 'c') {
+          single[0] = argument != NULL ? argument[0] : '\0';
+          argument = single;
+        }
+        strcpy(spec + length, "s");
+        printf(spec, argument != NULL ? argument : "");
+      }
+    }
+  } while (!stop && next < input->argCount && next > first);
+
+  return FinishOutput("printf") || result;
+}
+
+/********************************************************************************
+* Description: Sleep()
+*   This function responds to the command "sleep". It sleeps for the sum of
+*   its durations, which take the same units as timeout. Ctrl-C ends it as it
+*   would end a spawned sleep.
+********************************************************************************/
+static int Sleep(struct command *input) {
+  struct sigaction oldAction;
+  struct timespec remaining;
+  long milliseconds;
+  long total = 0;
+  int i;
+
+  if (input->argCount < 2) {
+    fprintf(stderr, "usage: sleep duration ...\n");
+    return 1;
+  }
+  for (i = 1; i < input->argCount; i++) {
+    if (!ParseDuration(input->args[i], &milliseconds)) {
+      fprintf(stderr, "sleep: %s: invalid time interval\n", input->args[i]);
+      return 1;
+    }
+    total += milliseconds;
+  }
+  remaining.tv_sec = total / 1000;
+  remaining.tv_nsec = (total % 1000) * 1000000;
+
+  AllowInterrupt(&oldAction);
+  /* Other signals, such as SIGCHLD, only shorten one nanosleep call */
+  while (!interrupted && nanosleep(&remaining, &remaining) != 0 && errno == EINTR) {
+    continue;
+  }
+  EndInterrupt(&oldAction);
+
+  return interrupted ? -SIGINT : 0;
+}
+
+/********************************************************************************
+* Description: Cat()
+*   This function responds to the command "cat [-u] [file ...]". Each file, or
+*   stdin for "-" or no files, is copied to stdout by CopyFd() without passing
+*   through the shell's memory. -u is accepted and has no effect, since
+*   nothing is buffered.
+********************************************************************************/
+static int Cat(struct command *input) {
+  struct sigaction oldAction;
+  const char *path;
+  int result = 0;
+  int first = 1;
+  int fd;
+  int i;
+
+  while (first < input->argCount && input->args[first][0] == '-' &&
+         input->args[first][1] != '\0') {
+    if (strcmp(input->args[first++], "--") == 0) {
+      break;
+    }
+  }
+
+  fflush(stdout);
+  AllowInterrupt(&oldAction);
+  for (i = first; (i == first || i < input->argCount) && !interrupted; i++) {
+    path = i < input->argCount ? input->args[i] : "-";
+    if (strcmp(path, "-") == 0) {
+      fd = STDIN_FILENO;
+    } else if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+      fprintf(stderr, "cat: %s: %s\n", path, strerror(errno));
+      result = 1;
+      continue;
+    }
+    if (CopyFd(fd, STDOUT_FILENO, &interrupted) < 0 && !interrupted) {
+      fprintf(stderr, "cat: %s: %s\n", path, strerror(errno));
+      result = 1;
+    }
+    if (fd != STDIN_FILENO) {
+      close(fd);
+    }
+  }
+  EndInterrupt(&oldAction);
+
+  return interrupted ? -SIGINT : result;
+}
+
+/********************************************************************************
+* Description: CopyFile()
+*   This function copies one file for cp, into the directory target if toDir
+*   is set. A new file gets the source's permission bits. Returns 0, or 1
+*   after printing an error.
+********************************************************************************/
+static int CopyFile(const char *source, const char *target, bool toDir) {
+  struct stat sourceInfo;
+  struct stat targetInfo;
+  char joined[PATH_MAX];
+  const char *base;
+  int result = 0;
+  int fdIn;
+  int fdOut;
+
+  if ((fdIn = open(source, O_RDONLY | O_CLOEXEC)) < 0 || fstat(fdIn, &sourceInfo) < 0) {
+    fprintf(stderr, "cp: %s: %s\n", source, strerror(errno));
+    if (fdIn >= 0) {
+      close(fdIn);
+    }
+    return 1;
+  }
+  if (S_ISDIR(sourceInfo.st_mode)) {
+    fprintf(stderr, "cp: %s: is a directory (not copied)\n", source);
+    close(fdIn);
+    return 1;
+  }
+
+  if (toDir) { /* target/basename(source) */
+    base = strrchr(source, '/');
+    snprintf(joined, sizeof(joined), "%s/%s", target, base != NULL ? base + 1 : source);
+    target = joined;
+  }
+  if (stat(target, &targetInfo) == 0 && targetInfo.st_dev == sourceInfo.st_dev &&
+      targetInfo.st_ino == sourceInfo.st_ino) {
+    fprintf(stderr, "cp: %s and %s are the same file\n", source, target);
+    close(fdIn);
+    return 1;
+  }
+
+  fdOut = open(target, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, sourceInfo.st_mode & 07777);
+  if (fdOut < 0) {
+    fprintf(stderr, "cp: %s: %s\n", target, strerror(errno));
+    close(fdIn);
+    return 1;
+  }
+  if ((CopyFd(fdIn, fdOut, &interrupted) < 0 && !interrupted) || close(fdOut) < 0) {
+    fprintf(stderr, "cp: %s: %s\n", target, strerror(errno));
+    result = 1;
+  }
+  close(fdIn);
+  return result;
+}
+
+/********************************************************************************
+* Description: Copy()
+*   This function responds to the command "cp source target" or "cp source ...
+*   directory". Options such as -r are left to the cp program.
+********************************************************************************/
+static int Copy(struct command *input) {
+  struct sigaction oldAction;
+  struct stat targetInfo;
+  const char *target = input->args[input->argCount - 1];
+  bool toDir;
+  int result = 0;
+  int i;
+
+  if (input->argCount < 3) {
+    fprintf(stderr, "usage: cp source ... target\n");
+    return 1;
+  }
+  toDir = stat(target, &targetInfo) == 0 && S_ISDIR(targetInfo.st_mode);
+  if (input->argCount > 3 && !toDir) {
+    fprintf(stderr, "cp: %s: not a directory\n", target);
+    return 1;
+  }
+
+  AllowInterrupt(&oldAction);
+  for (i = 1; i < input->argCount - 1 && !interrupted; i++) {
+    result |= CopyFile(input->args[i], target, toDir);
+  }
+  EndInterrupt(&oldAction);
+
+  return interrupted ? -SIGINT : result;
+}
+
+/* Every builtin, placed at its hash. Making a duplicate initializer an error */
+/* turns a hash collision into a compile error. */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic error "-Woverride-init"
+static const struct builtin builtinTable[BUILTIN_SLOTS] = {
+  [NAME_HASH('e', 'x', 't', 4)] = {"exit", BUILTIN_EXIT, NULL, false, NULL},
+  [NAME_HASH('c', 'd', 'd', 2)] = {"cd", BUILTIN_CD, NULL, false, NULL},
+  [NAME_HASH('s', 't', 's', 6)] = {"status", BUILTIN_STATUS, NULL, false, NULL},
+  [NAME_HASH('h', 'a', 'h', 4)] = {"hash", BUILTIN_HASH, NULL, false, NULL},
+  [NAME_HASH('t', 'i', 't', 7)] = {"timeout", BUILTIN_TIMEOUT, NULL, false, NULL},
+  [NAME_HASH('l', 'i', 't', 5)] = {"limit", BUILTIN_LIMIT, NULL, false, NULL},
+  [NAME_HASH('p', 'a', 'l', 8)] = {"parallel", BUILTIN_PARALLEL, NULL, false, NULL},
+  [NAME_HASH('t', 'i', 'e', 4)] = {"time", BUILTIN_TIME, NULL, false, NULL},
+  [NAME_HASH('h', 'i', 'y', 7)] = {"history", BUILTIN_HISTORY, NULL, false, NULL},
+  [NAME_HASH('p', 'u', 'd', 5)] = {"pushd", BUILTIN_PUSHD, NULL, false, NULL},
+  [NAME_HASH('p', 'o', 'd', 4)] = {"popd", BUILTIN_POPD, NULL, false, NULL},
+  [NAME_HASH('d', 'i', 's', 4)] = {"dirs", BUILTIN_DIRS, NULL, false, NULL},
+  [NAME_HASH('j', 'o', 's', 4)] = {"jobs", BUILTIN_JOBS, NULL, false, NULL},
+  [NAME_HASH('f', 'g', 'g', 2)] = {"fg", BUILTIN_FG, NULL, false, NULL},
+  [NAME_HASH('b', 'g', 'g', 2)] = {"bg", BUILTIN_BG, NULL, false, NULL},
+  [NAME_HASH('k', 'i', 'l', 4)] = {"kill", BUILTIN_KILL, NULL, false, NULL},
+  [NAME_HASH('w', 'a', 't', 4)] = {"wait", BUILTIN_WAIT, NULL, false, NULL},
+  [NAME_HASH('e', 'c', 'o', 4)] = {"echo", BUILTIN_ECHO, Echo, false, NULL},
+  [NAME_HASH('t', 'r', 'e', 4)] = {"true", BUILTIN_TRUE, True, false, NULL},
+  [NAME_HASH('f', 'a', 'e', 5)] = {"false", BUILTIN_FALSE, False, false, NULL},
+  [NAME_HASH('p', 'w', 'd', 3)] = {"pwd", BUILTIN_PWD, PrintDir, false, NULL},
+  [NAME_HASH('t', 'e', 't', 4)] = {"test", BUILTIN_TEST, Test, false, NULL},
+  [NAME_HASH('[', '\0', '[', 1)] = {"[", BUILTIN_TEST, Test, false, NULL},
+  [NAME_HASH('p', 'r', 'f', 6)] = {"printf", BUILTIN_PRINTF, Printf, false, NULL},
+  [NAME_HASH('s', 'l', 'p', 5)] = {"sleep", BUILTIN_SLEEP, Sleep, true, NULL},
+  [NAME_HASH('c', 'a', 't', 3)] = {"cat", BUILTIN_CAT, Cat, true, "u"},
+  [NAME_HASH('c', 'p', 'p', 2)] = {"cp", BUILTIN_CP, Copy, true, ""}
+};
+#pragma GCC diagnostic pop
+
+/********************************************************************************
+* Description: FindBuiltin()
+*   This function returns the registry entry for a command name, or NULL if it
+*   is not a builtin.
+********************************************************************************/
+const struct builtin *FindBuiltin(const char *name) {
+  const struct builtin *entry;
+  size_t length = strlen(name);
+
+  if (length == 0) {
+    return NULL;
+  }
+  entry = &builtinTable[NAME_HASH((unsigned char) name[0], (unsigned char) name[1],
+                                     (unsigned char) name[length - 1], length)];
+  if (entry->name != NULL && strcmp(entry->name, name) == 0) {
+    return entry;
+  }
+  return NULL;
+}
+
+/********************************************************************************
+* Description: HandlesOptions()
+*   This function returns whether the shell's version of a utility takes every
+*   option given to it. A utility with a list of options is launched as the
+*   program when given any other, so that nothing the program supports is lost.
+********************************************************************************/
+bool HandlesOptions(struct command *input) {
+  const char *options = input->builtin->options;
+  int i;
+
+  if (options == NULL) {
+    return true;
+  }
+  for (i = 1; i < input->argCount && input->args[i][0] == '-' && input->args[i][1] != '\0';
+       i++) {
+    if (strcmp(input->args[i], "--") == 0) {
+      break;
+    } else if (input->args[i][1 + strspn(input->args[i] + 1, options)] != '\0') {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,62 @@
+/********************************************************************************
+* Program Name: Builtins.h
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: Header file for Builtins.c. The registry of smallsh builtins and
+*   the simple utilities that run inside the shell instead of being spawned.
+********************************************************************************/
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include "CommandLine.h"
+#include <signal.h>
+
+enum builtinId {
+  BUILTIN_EXIT,
+  BUILTIN_CD,
+  BUILTIN_STATUS,
+  BUILTIN_HASH,
+  BUILTIN_TIMEOUT,
+  BUILTIN_LIMIT,
+  BUILTIN_PARALLEL,
+  BUILTIN_TIME,
+  BUILTIN_HISTORY,
+  BUILTIN_ECHO,
+  BUILTIN_TRUE,
+  BUILTIN_FALSE,
+  BUILTIN_PWD,
+  BUILTIN_TEST,
+  BUILTIN_PRINTF,
+  BUILTIN_SLEEP,
+  BUILTIN_CAT,
+  BUILTIN_CP,
+  BUILTIN_PUSHD,
+  BUILTIN_POPD,
+  BUILTIN_DIRS,
+  BUILTIN_JOBS,
+  BUILTIN_FG,
+  BUILTIN_BG,
+  BUILTIN_KILL,
+  BUILTIN_WAIT
+};
+
+struct builtin {
+  const char *name;
+  enum builtinId id;
+  /* Runs a utility in the shell and returns its exit value, or the negated */
+  /* signal number if a signal stopped it. NULL for the builtins that change */
+  /* the shell itself, which smallsh.c runs. A utility also exists as a program */
+  /* and is spawned wherever running it in the shell would not behave the same */
+  int (*run)(struct command *input);
+  bool mayBlock;  /* Can run long enough that a deadline matters */
+  const char *options; /* Options a utility takes in the shell, any other one */
+                       /* launches the program. NULL if every word is an operand */
+};
+
+extern volatile sig_atomic_t interrupted;
+
+void AllowInterrupt(struct sigaction *oldAction);
+void EndInterrupt(struct sigaction *oldAction);
+const struct builtin *FindBuiltin(const char *name);
+bool HandlesOptions(struct command *input);
+#endif
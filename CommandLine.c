@@ -6,132 +6,743 @@
 *   recognize commands, and build commands from that input to be executed.
 ********************************************************************************/
 #include "CommandLine.h"
+#include "Builtins.h"
+#include "Glob.h"
+#include "Limits.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define IsBlank(c) ((c) == ' ' || (c) == '\t' || (c) == '\n')
+#define IsNameStart(c) (isalpha((unsigned char) (c)) || (c) == '_')
+#define IsNameChar(c) (isalnum((unsigned char) (c)) || (c) == '_')
+#define WORD_STOP " \t\n<>|$'\"\\*?[" /* Characters that end or need a look within a word */
+#define IsSpecial(c) ((c) == '$' || (c) == '?' || (c) == '!')
+#define IsExpandStop(c) ((c) == '$' || (c) == '\'' || (c) == '"' || (c) == '\\')
+
+extern char **environ;
+
+static char pidString[32]; /* The shell's PID, formatted once by InitPidString() */
+static int pidLength = 0;
+static char statusString[16]; /* $?, the status of the last foreground command */
+static int statusLength = 0;
+static char backgroundString[32]; /* $!, the PID of the last background command */
+static int backgroundLength = 0;  /* 0 until a command has been put in the background */
+
+struct shellVariable {  /* A variable of the shell itself, never in the environment */
+  const char *name;     /* Both borrowed from the caller of SetShellVariable() */
+  const char *value;
+};
+
+static struct shellVariable *shellVariables = NULL; /* Found before the environment */
+static int variableCount = 0;
+static int variableCapacity = 0;
+
+#define FIELD_SPLIT '\001' /* Marks where an unquoted $(...) splits a word */
+
+/* Runs the command of a $(...) and returns its output, set by SetSubstitution() */
+static char *(*substitute)(const char *command, size_t length, size_t *outputLength) = NULL;
+
+struct captures {         /* The output of each $(...) in one word, in order */
+  char **outputs;         /* malloc()ed, so is each output */
+  size_t *lengths;
+  int count;
+  int capacity;
+  int next;               /* The next one ExpandWord() meets, 0 before each pass */
+  bool isSplit;           /* An unquoted one left FIELD_SPLITs in the word */
+};
+
+struct commandBuild {     /* A command while its words are added */
+  char pending;           /* '<' or '>' waiting for its file name */
+  bool lastIsAmp;         /* Whether the last word seen was a lone & */
+  int capacity;           /* Slots in args, one is kept for the NULL */
+};
+
+/********************************************************************************
+* Description: InitInput()
+*   This function sets up a reader for the lines of fd. Lines can be as long as
+*   ARG_MAX, the most a command can be given anyway. Only a terminal is
+*   prompted.
+********************************************************************************/
+void InitInput(struct inputReader *reader, int fd) {
+  long argMax = sysconf(_SC_ARG_MAX);
+
+  reader->fd = fd;
+  reader->isTerminal = isatty(fd);
+  reader->isDone = false;
+  reader->limit = argMax > 0 ? (size_t) argMax : INPUT_DEFAULT_LIMIT;
+  reader->capacity = INPUT_CHUNK;
+  reader->buffer = (char *) malloc(reader->capacity);
+  reader->start = 0;
+  reader->end = 0;
+}
+
+/********************************************************************************
+* Description: FillInput()
+*   This function reads more of the input after what the buffer holds. The
+*   unreturned bytes are first moved to the front, and the buffer doubles when
+*   they fill it. A line longer than the limit is dropped with a message and
+*   *isSkipping set until its newline is found. While a terminal user is
+*   typing, eventHandler is called whenever eventFd becomes readable, so the
+*   shell can keep supervising its jobs; SIGCHLD stays blocked while waiting
+*   so that only eventFd reports children. Returns false when interrupted by
+*   a signal, so the prompt is printed again.
+********************************************************************************/
+static bool FillInput(struct inputReader *reader, int eventFd, void (*eventHandler)(void),
+                      bool *isSkipping) {
+  struct pollfd waitFds[2];
+  sigset_t waitMask;
+  ssize_t n = 0;
+
+  if (reader->start > 0) {
+    memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+    reader->end -= reader->start;
+    reader->start = 0;
+  }
+  if (reader->end + 1 == reader->capacity) { /* One byte is kept for a last line's '\0' */
+    if (reader->capacity > reader->limit + 1) {
+      if (!*isSkipping) {
+        fprintf(stderr, "smallsh: line longer than %zu bytes\n", reader->limit);
+        *isSkipping = true;
+      }
+      reader->end = 0;
+    } else {
+      reader->capacity = reader->capacity * 2 > reader->limit + 2 ?
+                         reader->limit + 2 : reader->capacity * 2;
+      reader->buffer = (char *) realloc(reader->buffer, reader->capacity);
+    }
+  }
+
+  if (reader->isTerminal && eventFd >= 0) {
+    sigprocmask(SIG_BLOCK, NULL, &waitMask);
+    sigaddset(&waitMask, SIGCHLD);
+    waitFds[0].fd = reader->fd;
+    waitFds[0].events = POLLIN;
+    waitFds[1].fd = eventFd;
+    waitFds[1].events = POLLIN;
+    do {
+      waitFds[0].revents = 0;
+      waitFds[1].revents = 0;
+      n = ppoll(waitFds, 2, NULL, &waitMask);
+      if (n > 0 && waitFds[0].revents == 0 && (waitFds[1].revents & POLLIN)) {
+        eventHandler();
+      }
+    } while (n > 0 && waitFds[0].revents == 0);
+  }
+  if (n >= 0) {
+    n = read(reader->fd, reader->buffer + reader->end, reader->capacity - 1 - reader->end);
+  }
+  if (n > 0) {
+    reader->end += n;
+  } else if (n == 0 || errno != EINTR) {
+    reader->isDone = true;
+  }
+  return n >= 0;
+}
 
 /********************************************************************************
 * Description: GetInput()
-*   This function gets input from the user. For clarification, if the user hits
-*   enter and inputs only a newline character, that is handled by smallsh.c in
-*   main. smallsh will not try to build a command out of a newline character.
-*   Newlines can't be filtered by this function since smallsh needs to use newline
-*   characters to check background processes, but without running the newline as
-*   a command.
-********************************************************************************/
-void GetInput(char inputBuffer[]) {
-  size_t bufsize = 2049;
-  ssize_t n;
-  char *tempBuf = NULL;
-
-  fflush(stdout); /* Flush standard out before and after the colon */
-                  /* to make sure it doesn't get in the way */
-  while(1) { /* Keep running getline until a successful read is completed */
-    printf(": ");
-    fflush(stdout);
-    n = getline(&tempBuf, &bufsize, stdin);
-    if (n == -1) { /* When getline is interrupted by signal handlers, this allows */
-      clearerr(stdin); /* getline to return -1 and continue looking for input upon */
-    } else {       /* re-entering getline */
-      break;
+*   This function returns the next line of input, terminated in place by
+*   replacing its newline, or NULL at the end of the input. The line is a view
+*   into the reader's buffer, read with read() a large block at a time, and
+*   stays valid until the next call. For clarification, a line that is only a
+*   newline comes back empty, and smallsh.c skips it without running anything,
+*   after checking background processes. A terminal is prompted with prompt,
+*   which is ": ", or "> " while a block is open; piped input never is.
+********************************************************************************/
+char *GetInput(struct inputReader *reader, const char *prompt, int eventFd,
+               void (*eventHandler)(void)) {
+  bool isSkipping = false; /* Dropping the rest of a line that was too long */
+  bool isPrompted = false;
+  char *line;
+  char *newline;
+
+  while (1) {
+    line = reader->buffer + reader->start;
+    newline = memchr(line, '\n', reader->end - reader->start);
+    if (newline != NULL) {
+      *newline = '\0';
+      reader->start = newline + 1 - reader->buffer;
+      return isSkipping ? newline : line;
+    } else if (reader->isDone) {
+      if (reader->start == reader->end && !isSkipping) {
+        return NULL;
+      }
+      reader->buffer[reader->end] = '\0'; /* A last line without a newline */
+      reader->start = reader->end;
+      return isSkipping ? reader->buffer + reader->end : line;
+    }
+    if (reader->isTerminal && !isPrompted) {
+      printf("%s", prompt);
+      fflush(stdout);
+      isPrompted = true;
+    }
+    if (!FillInput(reader, eventFd, eventHandler, &isSkipping)) {
+      isPrompted = false; /* A signal handler may have printed over it */
     }
   }
-  strcpy(inputBuffer, tempBuf);
-  free(tempBuf);
-  tempBuf = NULL;
 }
 
 /********************************************************************************
-* Description: ExpandPid()
-*   This function takes a token from a command line input and looks for the $$
-*   within that token so that it can expand it into the process id of the shell.
+* Description: FreeInput()
+*   This function releases a reader's buffer.
+********************************************************************************/
+void FreeInput(struct inputReader *reader) {
+  free(reader->buffer);
+  reader->buffer = NULL;
+}
+
+/********************************************************************************
+* Description: MapScript()
+*   This function memory-maps a script file for non-interactive mode. The mapping
+*   is private and writable so lines can be terminated and tokenized in place
+*   without touching the file. One byte past the end is always readable and zero,
+*   so the last line is terminated even without a trailing newline. Returns NULL
+*   with errno set on failure.
+********************************************************************************/
+char *MapScript(const char *path, size_t *length) {
+  struct stat fileInfo;
+  char *script;
+  int fd;
+
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (fstat(fd, &fileInfo) < 0) {
+    close(fd);
+    return NULL;
+  }
+  *length = fileInfo.st_size;
+
+  /* The page after a page-aligned file is not backed by the file, so map an */
+  /* anonymous region one byte larger and lay the file over the front of it */
+  script = mmap(NULL, *length + 1, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (script != MAP_FAILED && *length > 0 &&
+      mmap(script, *length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+           fd, 0) == MAP_FAILED) {
+    munmap(script, *length + 1);
+    script = MAP_FAILED;
+  }
+  close(fd);
+
+  if (script == MAP_FAILED) {
+    return NULL;
+  }
+  madvise(script, *length, MADV_SEQUENTIAL);
+  return script;
+}
+
+/********************************************************************************
+* Description: UnmapScript()
+*   This function releases a script mapped by MapScript().
 ********************************************************************************/
-void ExpandPid (char *token, char output[]) {
-  char *subToken;
-  char *remaining = token;
-  char pidString[128];
-  char *ref;
-  
-  if (strcmp(token, "$$") == 0) { /* Check if the token is exactly $$ */
-    memset(pidString, '\0', sizeof(pidString));    
-    sprintf(pidString, "%d", getpid());
-    strcpy(output, pidString);
+void UnmapScript(char *script, size_t length) {
+  munmap(script, length + 1);
+}
+
+/********************************************************************************
+* Description: NextScriptLine()
+*   This function returns the next line of a script buffer, terminated in place
+*   by replacing its newline, and advances the cursor past it. Returns NULL at
+*   the end of the buffer.
+********************************************************************************/
+char *NextScriptLine(char **cursor, char *end) {
+  char *line = *cursor;
+  char *newline;
+
+  if (line >= end) {
+    return NULL;
+  }
+  newline = memchr(line, '\n', end - line);
+  if (newline == NULL) {
+    *end = '\0';
+    *cursor = end;
   } else {
-    ref = strstr(token, "$$"); /* Check if the token has $$ somewhere */
-    if (ref != NULL) {
-      subToken = strtok_r(token, "$$", &remaining); /* If there is $$ */
-      memset(pidString, '\0', sizeof(pidString));   /* then make a subtoken */
-      sprintf(pidString, "%d", getpid());           /* using it */
-
-      if (token[1] == '$') { /* Make a new string with the subtoken */
-        strcpy(output, pidString); /* For example, paul$$apes, would make */
-        strcat(output, subToken);  /* a paul subtoken and a new string of */
-      } else {                     /* paul7777apes, assuming the PID was 7777 */
-        strcpy(output, subToken);
-        strcat(output, pidString);
+    *newline = '\0';
+    *cursor = newline + 1;
+  }
+  return line;
+}
+
+/********************************************************************************
+* Description: InitPidString()
+*   This function formats the shell's process id once, so that expanding $$
+*   never calls getpid() or sprintf() again. $? starts out as 0 and $! empty.
+********************************************************************************/
+void InitPidString(void) {
+  pidLength = sprintf(pidString, "%d", getpid());
+  SetLastStatus(0);
+}
+
+/********************************************************************************
+* Description: SetLastStatus()
+*   This function records the status of the last foreground command for $?.
+********************************************************************************/
+void SetLastStatus(int status) {
+  statusLength = sprintf(statusString, "%d", status);
+}
+
+/********************************************************************************
+* Description: SetLastBackground()
+*   This function records the PID of the last background command for $!.
+********************************************************************************/
+void SetLastBackground(pid_t pid) {
+  backgroundLength = sprintf(backgroundString, "%d", (int) pid);
+}
+
+/********************************************************************************
+* Description: SetSubstitution()
+*   This function turns on $(...), with run as the function that runs the
+*   command between the parentheses. Until it is called a "$(" is kept as
+*   written, as it always was.
+********************************************************************************/
+void SetSubstitution(char *(*run)(const char *command, size_t length, size_t *outputLength)) {
+  substitute = run;
+}
+
+/********************************************************************************
+* Description: GetShellVariable()
+*   This function returns the value of the shell variable name, or NULL if the
+*   shell has no such variable. The environment is not looked at.
+********************************************************************************/
+const char *GetShellVariable(const char *name) {
+  int i;
+
+  for (i = 0; i < variableCount; i++) {
+    if (strcmp(shellVariables[i].name, name) == 0) {
+      return shellVariables[i].value;
+    }
+  }
+  return NULL;
+}
+
+/********************************************************************************
+* Description: SetShellVariable()
+*   This function gives the shell variable name the value, adding it if it is
+*   new. Shell variables are expanded like environment variables, and hide
+*   one of the same name, but are never passed to a command. Neither string
+*   is copied: both must stay valid until the variable is set again or unset.
+********************************************************************************/
+void SetShellVariable(const char *name, const char *value) {
+  struct shellVariable *grown;
+  int i;
+
+  for (i = 0; i < variableCount; i++) {
+    if (strcmp(shellVariables[i].name, name) == 0) {
+      shellVariables[i].value = value;
+      return;
+    }
+  }
+  if (variableCount == variableCapacity) {
+    variableCapacity = variableCapacity == 0 ? 8 : variableCapacity * 2;
+    grown = (struct shellVariable *) realloc(shellVariables,
+                                             variableCapacity * sizeof(struct shellVariable));
+    if (grown == NULL) {
+      perror("realloc()");
+      exit(1);
+    }
+    shellVariables = grown;
+  }
+  shellVariables[variableCount].name = name;
+  shellVariables[variableCount].value = value;
+  variableCount++;
+}
+
+/********************************************************************************
+* Description: UnsetShellVariable()
+*   This function removes the shell variable name, if there is one, so that
+*   the environment variable of that name shows through again.
+********************************************************************************/
+void UnsetShellVariable(const char *name) {
+  int i;
+
+  for (i = 0; i < variableCount; i++) {
+    if (strcmp(shellVariables[i].name, name) == 0) {
+      shellVariables[i] = shellVariables[--variableCount];
+      return;
+    }
+  }
+}
+
+/********************************************************************************
+* Description: FindVariable()
+*   This function returns the value of the shell variable or, failing that,
+*   the environment variable whose name is the given length, or NULL if it is
+*   not set. It compares against the names directly so the name never has to
+*   be copied out to be terminated.
+********************************************************************************/
+static const char *FindVariable(const char *name, size_t length) {
+  char **entry;
+  int i;
+
+  for (i = 0; i < variableCount; i++) {
+    if (strncmp(shellVariables[i].name, name, length) == 0 &&
+        shellVariables[i].name[length] == '\0') {
+      return shellVariables[i].value;
+    }
+  }
+  for (entry = environ; *entry != NULL; entry++) {
+    if (strncmp(*entry, name, length) == 0 && (*entry)[length] == '=') {
+      return *entry + length + 1;
+    }
+  }
+  return NULL;
+}
+
+/********************************************************************************
+* Description: SpecialValue()
+*   This function returns the value of the special parameter $name, where name
+*   is '$', '?' or '!', and sets *length. $! is NULL until a command has been
+*   put in the background. Any other name is not special and returns NULL too.
+********************************************************************************/
+static const char *SpecialValue(char name, size_t *length) {
+  *length = 0;
+  if (name == '$') {
+    *length = pidLength;
+    return pidString;
+  } else if (name == '?') {
+    *length = statusLength;
+    return statusString;
+  } else if (name == '!' && backgroundLength > 0) {
+    *length = backgroundLength;
+    return backgroundString;
+  }
+  return NULL;
+}
+
+/********************************************************************************
+* Description: FindParameter()
+*   This function looks up the parameter named by the text from name to end,
+*   which is either a variable name or one of the specials $, ? and !. It
+*   returns the value, NULL if the parameter is unset, and sets *isValid to
+*   whether the text is a parameter name at all.
+********************************************************************************/
+static const char *FindParameter(const char *name, const char *end, size_t *length,
+                                 bool *isValid) {
+  const char *scan = name;
+
+  *isValid = true;
+  if (end - name == 1 && IsSpecial(*name)) {
+    return SpecialValue(*name, length);
+  }
+  if (scan == end || !IsNameStart(*scan)) {
+    *isValid = false;
+    return NULL;
+  }
+  while (scan < end && IsNameChar(*scan)) {
+    scan++;
+  }
+  if (scan != end) {
+    *isValid = false;
+    return NULL;
+  }
+  name = FindVariable(name, end - name);
+  *length = name != NULL ? strlen(name) : 0;
+  return name;
+}
+
+/********************************************************************************
+* Description: SubstitutionEnd()
+*   This function returns one past the ')' that closes the "$(" at text,
+*   counting the parentheses of any nested in it and skipping those quoted,
+*   or text itself if none does.
+********************************************************************************/
+static const char *SubstitutionEnd(const char *text) {
+  const char *scan;
+  char quote = '\0';
+  int depth = 0;
+
+  for (scan = text + 1; *scan != '\0'; scan++) {
+    if (*scan == '\\' && quote != '\'' && scan[1] != '\0') {
+      scan++;
+    } else if (quote != '\0') {
+      quote = *scan == quote ? '\0' : quote;
+    } else if (*scan == '\'' || *scan == '"') {
+      quote = *scan;
+    } else if (*scan == '(') {
+      depth++;
+    } else if (*scan == ')' && --depth == 0) {
+      return scan + 1;
+    }
+  }
+  return text;
+}
+
+/********************************************************************************
+* Description: ParameterEnd()
+*   This function returns where the reference that starts with the '$' at text
+*   ends, or text itself if the '$' does not start one and is kept as it is.
+*   A ${ with no closing } also returns text, as does a $( with no closing )
+*   or while there is no substitution. A } inside quotes does not close a ${,
+*   and a quote left open inside one means it is not closed, so ScanWord()
+*   goes on to report the quote.
+********************************************************************************/
+static const char *ParameterEnd(const char *text) {
+  const char *close;
+  const char *quote;
+
+  if (IsSpecial(text[1])) {
+    return text + 2;
+  } else if (text[1] == '(' && substitute != NULL) {
+    return SubstitutionEnd(text);
+  } else if (text[1] == '{') {
+    for (close = text + 2; *close != '}' && *close != '\0'; close++) {
+      if (*close == '\\' && close[1] != '\0') {
+        close++;
+      } else if (*close == '\'' || *close == '"') {
+        quote = strchr(close + 1, *close);
+        if (quote == NULL) {
+          return text;
+        }
+        close = quote;
       }
-      subToken = strtok_r(NULL, "$$", &remaining);
+    }
+    return *close == '}' ? close + 1 : text;
+  } else if (IsNameStart(text[1])) {
+    text++;
+    while (IsNameChar(*text)) {
+      text++;
+    }
+  }
+  return text;
+}
+
+/********************************************************************************
+* Description: CopyText()
+*   This function copies count bytes of text to output at length and returns
+*   the new length, or only counts them if output is NULL. With isLiteral set,
+*   each pattern character is preceded by a backslash so that globbing treats
+*   it as itself.
+********************************************************************************/
+static size_t CopyText(char *output, size_t length, const char *text, size_t count,
+                       bool isLiteral) {
+  size_t i;
 
-      if (subToken != NULL) {
-        strcat(output, subToken);
+  if (!isLiteral) {
+    if (output != NULL) { /* Can overlap when unquoting in place */
+      memmove(output + length, text, count);
+    }
+    return length + count;
+  }
+  for (i = 0; i < count; i++) {
+    if (text[i] == '*' || text[i] == '?' || text[i] == '[' || text[i] == '\\') {
+      if (output != NULL) {
+        output[length] = '\\';
       }
-    } else {
-      strcpy(output, token);
+      length++;
     }
+    if (output != NULL) {
+      output[length] = text[i];
+    }
+    length++;
+  }
+  return length;
+}
+
+/********************************************************************************
+* Description: Capture()
+*   This function runs the command of the $(...) that is next in a word and
+*   keeps its output, so the second pass over the word uses the same output
+*   without running the command again.
+********************************************************************************/
+static void Capture(struct captures *captures, const char *command, size_t length) {
+  if (captures->count == captures->capacity) {
+    captures->capacity = captures->capacity == 0 ? 4 : captures->capacity * 2;
+    captures->outputs = (char **) realloc(captures->outputs,
+                                          captures->capacity * sizeof(char *));
+    captures->lengths = (size_t *) realloc(captures->lengths,
+                                           captures->capacity * sizeof(size_t));
   }
+  captures->outputs[captures->count] = substitute(command, length,
+                                                  &captures->lengths[captures->count]);
+  captures->count++;
 }
 
 /********************************************************************************
-* Description: TokenizeInput()
-*   This function takes a line from the command line entered by the user and
-*   tokenizes it by spaces or the " " character. Basically, this breaks the line
-*   into individual pieces for further analysis.
+* Description: ReleaseCaptures()
+*   This function frees the outputs kept for a word once it is built.
 ********************************************************************************/
-int TokenizeInput(char inputBuffer[], char *tokens[]) {
-  int tokenCount = 0;
-  char *remaining = inputBuffer;
+static void ReleaseCaptures(struct captures *captures) {
+  int i;
 
-  /* Use strtok_r for re-entrancy and for multiple strtok calls */
-  /* Keep tokeinizing until NULL is reached, and increment tokenCount */
-  tokens[tokenCount] = strtok_r(inputBuffer, " ", &remaining);
-  while (tokens[tokenCount] != NULL) {
-    tokens[++tokenCount] = strtok_r(NULL, " ", &remaining); 
+  for (i = 0; i < captures->count; i++) {
+    free(captures->outputs[i]);
   }
-  remaining = tokens[tokenCount - 1];
-  tokens[tokenCount - 1] = strtok_r(tokens[tokenCount - 1], "\n", &remaining);
+  free(captures->outputs);
+  free(captures->lengths);
+}
 
-  return tokenCount;
+/********************************************************************************
+* Description: CopyFields()
+*   This function copies the output of an unquoted $(...) like CopyText(),
+*   except that each run of blanks becomes one FIELD_SPLIT, where the word
+*   is split once it is built.
+********************************************************************************/
+static size_t CopyFields(char *output, size_t length, const char *text, size_t count,
+                         bool isLiteral) {
+  size_t start = 0;
+  size_t i = 0;
+
+  while (i < count) {
+    if (IsBlank(text[i]) || text[i] == FIELD_SPLIT) {
+      length = CopyText(output, length, text + start, i - start, isLiteral);
+      while (i < count && (IsBlank(text[i]) || text[i] == FIELD_SPLIT)) {
+        i++;
+      }
+      if (output != NULL) {
+        output[length] = FIELD_SPLIT;
+      }
+      length++;
+      start = i;
+    } else {
+      i++;
+    }
+  }
+  return CopyText(output, length, text + start, count - start, isLiteral);
 }
 
 /********************************************************************************
-* Description: AssignCommandName()
-*   This function takes the first token and assigns it to argument one, which
-*   is by default the name of the command. This also returns a bool to set the
-*   isBuiltin flag within the command struct that is being populated.
+* Description: ExpandWord()
+*   This function removes the quoting from the text of one word and expands the
+*   parameters in it, writing the result to output and returning its length.
+*   With a NULL output it only measures, so the caller can allocate the word at
+*   its exact size and call it again. Quoting follows the shell:
+*     '...'  everything is literal
+*     "..."  $ references are expanded; \ only escapes $, ", \ and a newline
+*     \c     outside quotes, c is literal
+*   References are $NAME, ${NAME}, ${NAME:-default} (the default is itself
+*   expanded when NAME is unset or empty, and runs to the first unquoted '}'),
+*   $$, $? and $!. A '$' that starts none of these is kept. Values are never
+*   split into more words. $(command) is the output of the command, taken
+*   from captures, which runs it the first time it is met; outside double
+*   quotes its blanks mark where the word splits. With isPattern set the
+*   result is a pattern for GlobWord(): the wildcards written outside quotes
+*   stay wildcards and every other pattern character, quoted or from a value,
+*   is escaped with a backslash.
 ********************************************************************************/
-bool AssignCommandName(struct command *input, char *firstToken) {
-  char firstTokenPid[512];
-  memset(firstTokenPid, '\0', sizeof(firstTokenPid));
+static size_t ExpandWord(const char *word, const char *end, char *output, bool isPattern,
+                         struct captures *captures) {
+  const char *close;
+  const char *value;
+  const char *split;
+  const char *run;
+  size_t length = 0;
+  size_t valueLength;
+  bool inDouble = false;
+  bool isValid;
 
-  input->args[0] = (char *) calloc(128, sizeof(char)); 
-  ExpandPid(firstToken, firstTokenPid);
-  strcpy(input->args[0], firstTokenPid);  
-  input->argCount++; 
-  if (strcmp(input->args[0], "exit") == 0) {
-    return true;
-  } else if (strcmp(input->args[0], "cd") == 0) {
-    return true;
-  } else if (strcmp(input->args[0], "status") == 0) {
-    return true;
-  } else {
-    return false;
+  while (word < end) {
+    if (*word == '\'' && !inDouble) {
+      close = (const char *) memchr(word + 1, '\'', end - word - 1);
+      if (close == NULL) { /* ScanWord() rejects this, but never read past end */
+        close = end;
+      }
+      length = CopyText(output, length, word + 1, close - word - 1, isPattern);
+      word = close < end ? close + 1 : end;
+    } else if (*word == '"') {
+      inDouble = !inDouble;
+      word++;
+    } else if (*word == '\\' && word + 1 < end &&
+               (!inDouble || strchr("$\"\\\n", word[1]) != NULL)) {
+      if (word[1] != '\n') { /* An escaped newline joins the lines */
+        length = CopyText(output, length, word + 1, 1, isPattern);
+      }
+      word += 2;
+    } else if (*word == '$' && word + 1 < end && IsSpecial(word[1])) {
+      value = SpecialValue(word[1], &valueLength);
+      length = CopyText(output, length, value, valueLength, false);
+      word += 2;
+    } else if (*word == '$' && word + 1 < end && word[1] == '(' &&
+               (close = ParameterEnd(word)) != word && close <= end) {
+      if (captures->next == captures->count) {
+        Capture(captures, word + 2, close - word - 3);
+      }
+      value = captures->outputs[captures->next];
+      valueLength = captures->lengths[captures->next++];
+      if (inDouble) {
+        length = CopyText(output, length, value, valueLength, isPattern);
+      } else {
+        length = CopyFields(output, length, value, valueLength, isPattern);
+        captures->isSplit = true;
+      }
+      word = close;
+    } else if (*word == '$' && (close = ParameterEnd(word)) != word && close <= end) {
+      split = NULL;
+      if (word[1] == '{') {
+        split = (const char *) memchr(word + 2, ':', close - word - 3);
+        if (split != NULL && split[1] != '-') {
+          split = NULL;
+        }
+        value = FindParameter(word + 2, split != NULL ? split : close - 1,
+                              &valueLength, &isValid);
+      } else {
+        value = FindParameter(word + 1, close, &valueLength, &isValid);
+      }
+      if (!isValid) { /* Not a name, so keep it as written */
+        length = CopyText(output, length, word, close - word, isPattern);
+      } else if (split != NULL && valueLength == 0) {
+        length += ExpandWord(split + 2, close - 1,
+                             output != NULL ? output + length : NULL, isPattern, captures);
+      } else {
+        length = CopyText(output, length, value, valueLength, isPattern);
+      }
+      word = close;
+    } else { /* Copy up to the next character that needs a look */
+      run = word + 1;
+      while (run < end && !IsExpandStop(*run)) {
+        run++;
+      }
+      length = CopyText(output, length, word, run - word, isPattern && inDouble);
+      word = run;
+    }
   }
+  return length;
 }
 
+/********************************************************************************
+* Description: ParseDuration()
+*   This function reads a duration such as 10, 2.5s, 500ms, 3m, 1h or 1d into
+*   milliseconds. A number without a unit is seconds. Returns false if the text
+*   is not a duration.
+********************************************************************************/
+bool ParseDuration(const char *text, long *milliseconds) {
+  char *unit;
+  double value = strtod(text, &unit);
+
+  if (unit == text || value < 0) {
+    return false;
+  }
+  if (*unit == '\0' || strcmp(unit, "s") == 0) {
+    value *= 1000;
+  } else if (strcmp(unit, "m") == 0) {
+    value *= 60 * 1000;
+  } else if (strcmp(unit, "h") == 0) {
+    value *= 60 * 60 * 1000;
+  } else if (strcmp(unit, "d") == 0) {
+    value *= 24 * 60 * 60 * 1000;
+  } else if (strcmp(unit, "ms") != 0) {
+    return false;
+  }
+  *milliseconds = (long) value;
+  return true;
+}
 
 /********************************************************************************
 * Description: IsComment()
 *   This function returns a bool value for whether or not the command is a
-*   comment. It checks the first character against the '#' character.
+*   comment. It checks the first character that is not a blank against the
+*   '#' character.
 ********************************************************************************/
 bool IsComment(char inputBuffer[]) {
+  while (IsBlank(*inputBuffer)) {
+    inputBuffer++;
+  }
   if (inputBuffer[0] == '#') { /* Check if first character in */
     return true;               /* the input is a # */
   } else {
@@ -140,187 +751,689 @@ bool IsComment(char inputBuffer[]) {
 }
 
 /********************************************************************************
-* Description: IsForeground()
-*   This function returns a bool value for whether or not the command is to be
-*   run in the foreground. It checks for the '&' character, at the very end of
-*   the command line input specifically.
+* Description: AddArgument()
+*   This function appends a word to the command's argument vector, doubling the
+*   vector within the arena when it is full. One slot is always kept free for
+*   the terminating NULL.
 ********************************************************************************/
-bool IsForeground(int tokenCount, char *tokens[]) {
-  const char backgroundChar[2] = "&"; 
-  if (tokenCount < 2) { /* First token interpretted as command name, not */
-    return true;         /* possible to have a background & present */ 
-  } else if (strcmp(tokens[tokenCount - 1], backgroundChar) == 0) {
-    return false;
+static void AddArgument(struct command *input, char *word, int *capacity,
+                        struct arena *arena) {
+  char **grown;
+
+  if (input->argCount + 1 == *capacity) {
+    *capacity *= 2;
+    grown = (char **) ArenaAlloc(arena, *capacity * sizeof(char *));
+    memcpy(grown, input->args, input->argCount * sizeof(char *));
+    input->args = grown;
+  }
+  input->args[input->argCount++] = word;
+}
+
+/********************************************************************************
+* Description: AddReference()
+*   This function notes a reference found while scanning a word. A special such
+*   as $$ adds how much longer its value is than the reference, so the word can
+*   be sized without looking at it again; a variable has to be measured.
+********************************************************************************/
+static void AddReference(const char *reference, long *growth, bool *hasVariables) {
+  size_t length;
+
+  if (IsSpecial(reference[1])) {
+    SpecialValue(reference[1], &length);
+    *growth += (long) length - 2;
   } else {
-    return true;
+    *hasVariables = true;
   }
 }
 
 /********************************************************************************
-* Description: IsInputRedirect()
-*   This function returns a bool value for whether or not the command has an input
-*   redirect. If the command has an input redirect, the inputFile of the command is
-*   populated in addition to returning the bool to set isInputRedirect in the
-*   command.
-********************************************************************************/
-bool IsInputRedirect(struct command *input, char *tokens[]) {
-  int backgroundMod = 0;
-  const char inputRedirectChar[2] = "<"; 
-  char tokenWithPid[512];  
-
-  if (!input->isForeground) {
-    backgroundMod = 1; /* Add one to indices being checked if is a background command */
-  } 
-  
-  /* Check if there are at least 3 tokens or 4 for background command */   
-  if (input->tokenCount < 3 + backgroundMod) { /* First token interpretted as command name, not */     
-    return false;                              /* possible to have a < present */    
-  /* Check the second to last token or third to last token if background command */              
-  } else if (strcmp(tokens[input->tokenCount - 2 + backgroundMod], inputRedirectChar) == 0) {
-    memset(input->inputFile, '\0', sizeof(input->inputFile));
-    memset(tokenWithPid, '\0', sizeof(tokenWithPid));
-    ExpandPid(tokens[input->tokenCount - 1 + backgroundMod], tokenWithPid);
-    strcpy(input->inputFile, tokenWithPid);
-    return true;
-  /* Check if there are at least 5 tokens or 6 for background command */
-  } else if (input->tokenCount < 5 + backgroundMod) {
-    return false;                                                    
-  /* Check the fourth to last token or fifth to last for background command */        
-  } else if (strcmp(tokens[input->tokenCount - 4 + backgroundMod], inputRedirectChar) == 0) {
-    memset(input->inputFile, '\0', sizeof(input->inputFile));
-    memset(tokenWithPid, '\0', sizeof(tokenWithPid));
-    ExpandPid(tokens[input->tokenCount - 3 + backgroundMod], tokenWithPid);
-    strcpy(input->inputFile, tokenWithPid);   
-    return true;
+* Description: ScanWord()
+*   This function finishes scanning a word that starts at start and has a quote,
+*   backslash, '$' or wildcard at *cursor. Quotes and ${...} are stepped over
+*   whole, blanks and all. A word with an unquoted *, ? or [...] is built as a
+*   pattern and *isPattern set. A word with references is expanded into the
+*   arena at its exact size; one that only has quoting to remove never gets
+*   longer, so it is unquoted in place. If isRaw is not NULL, a word with
+*   references is instead copied as written and *isRaw set, so that it can be
+*   expanded each time it is used. *isSplit is set if an unquoted $(...) left
+*   the word to be split with PlaceFields(). *cursor is left past the word and
+*   a following blank. Returns NULL if a quote is not closed.
+********************************************************************************/
+static char *ScanWord(char *start, char **cursor, bool *isQuoted, bool *isPattern,
+                      bool *isRaw, bool *isSplit, struct arena *arena) {
+  struct captures captures = {NULL, NULL, 0, 0, 0, false};
+  char *scan = *cursor;
+  char *close;
+  char *word = start;
+  bool isExpanded = false;
+  bool hasVariables = false; /* A reference to a variable, which must be measured */
+  long growth = 0;           /* How much the specials lengthen the word */
+  size_t length;
+  char c;
+
+  while (true) {
+    c = *(scan += strcspn(scan, WORD_STOP));
+    if (c == '$') {
+      close = (char *) ParameterEnd(scan);
+      if (close == scan) {
+        scan++;
+        continue;
+      }
+      AddReference(scan, &growth, &hasVariables);
+      isExpanded = true;
+      scan = close;
+    } else if (c == '\'') {
+      close = strchr(scan + 1, '\'');
+      if (close == NULL) {
+        return NULL;
+      }
+      *isQuoted = true;
+      scan = close + 1;
+    } else if (c == '"') {
+      for (scan++; *scan != '"' && *scan != '\0'; scan++) {
+        if (*scan == '\\' && scan[1] != '\0') {
+          scan++;
+        } else if (*scan == '$' && (close = (char *) ParameterEnd(scan)) != scan) {
+          AddReference(scan, &growth, &hasVariables);
+          isExpanded = true;
+          scan = close - 1;
+        }
+      }
+      if (*scan == '\0') {
+        return NULL;
+      }
+      *isQuoted = true;
+      scan++;
+    } else if (c == '\\') {
+      *isQuoted = true;
+      scan += scan[1] != '\0' ? 2 : 1;
+    } else if (c == '*' || c == '?' || c == '[') {
+      /* A '[' is only a wildcard if a ']' closes it within the word */
+      *isPattern = *isPattern || c != '[' || scan[strcspn(scan, "] \t\n<>|")] == ']';
+      scan++;
+    } else {
+      break;
+    }
+  }
+
+  if (isExpanded && isRaw != NULL) {
+    *isRaw = true;
+    word = ArenaStrndup(arena, start, scan - start);
+  } else if (*isPattern) {
+    length = ExpandWord(start, scan, NULL, true, &captures);
+    word = (char *) ArenaAlloc(arena, length + 1);
+    captures.next = 0;
+    word[ExpandWord(start, scan, word, true, &captures)] = '\0';
+  } else if (isExpanded) {
+    /* Removing quotes only shortens a word, so without variables its length */
+    /* plus the growth of the specials is enough and one pass does it */
+    length = hasVariables ? ExpandWord(start, scan, NULL, false, &captures) :
+                            (scan - start) + growth;
+    word = (char *) ArenaAlloc(arena, length + 1);
+    captures.next = 0;
+    word[ExpandWord(start, scan, word, false, &captures)] = '\0';
+  } else if (*isQuoted) {
+    word[ExpandWord(start, scan, start, false, &captures)] = '\0';
+  } else if (c == '\0' || IsBlank(c)) {
+    *scan = '\0';  /* Only a lone '$' or '[', which is kept */
   } else {
-  /* If all else fails, no input redirect */ 
-    return false;
+    word = ArenaStrndup(arena, start, scan - start);
+  }
+  if (IsBlank(c)) {
+    scan++;
   }
+  *cursor = scan;
+  *isSplit = captures.isSplit;
+  ReleaseCaptures(&captures);
+  return word;
+}
+
+/********************************************************************************
+* Description: StartCommand()
+*   This function empties a command before its words are added.
+********************************************************************************/
+static void StartCommand(struct command *input, struct commandBuild *build,
+                         struct arena *arena) {
+  build->pending = '\0';
+  build->lastIsAmp = false;
+  build->capacity = 16;
+  input->argCount = 0; 
+  input->timeoutMs = 0;
+  input->graceMs = 0;
+  input->limits = NULL;
+  input->isTimed = false;
+  input->args = (char **) ArenaAlloc(arena, build->capacity * sizeof(char *));
+  input->inputFile = NULL;
+  input->outputFile = NULL;
+  input->isComment = false;
+  input->isForeground = true;
+  input->isInputRedirect = false;
+  input->isOutputRedirect = false;
 }
 
 /********************************************************************************
-* Description: IsOutputRedirect()
-*   This function returns a bool value for whether or not the command has an output
-*   redirect. If the command has an output redirect, the outputFile of the command is
-*   populated in addition to returning the bool to set isOutputRedirect in the
-*   command.
+* Description: PlaceWord()
+*   This function adds one finished word to a command, as the file name of a
+*   pending redirect or as an argument. A pattern becomes the paths it
+*   matches, or stays as written if there are none, and a file name only takes
+*   a match if it is the only one.
 ********************************************************************************/
-bool IsOutputRedirect(struct command *input, char *tokens[]) {
-  int backgroundMod = 0;
-  const char outputRedirectChar[2] = ">"; 
-  char tokenWithPid[512];
+static void PlaceWord(struct command *input, struct commandBuild *build, char *word,
+                      bool isQuoted, bool isPattern, struct arena *arena) {
+  char **matches;
+  int matchCount;
+  int i;
 
-  if (!input->isForeground) {
-    backgroundMod = 1; /* Add one to indices being checked if is a background command */
-  } 
+  if (isPattern) {
+    matchCount = GlobWord(word, arena, &matches);
+    if (matchCount == 0 || (build->pending != '\0' && matchCount > 1)) {
+      UnescapePattern(word);
+    } else if (build->pending != '\0') {
+      word = matches[0];
+    } else {
+      for (i = 0; i < matchCount - 1; i++) {
+        AddArgument(input, matches[i], &build->capacity, arena);
+      }
+      word = matches[matchCount - 1];
+    }
+  }
 
-  /* Check if there are at least 3 tokens or 4 for background command */       
-  if (input->tokenCount < 3 + backgroundMod) { /* First token interpretted as command name, not */     
-    return false;                              /* possible to have a > present */                  
-  /* Check the second to last token or third to last token if background command */              
-  } else if (strcmp(tokens[input->tokenCount - 2 + backgroundMod], outputRedirectChar) == 0) {
-    memset(input->outputFile, '\0', sizeof(input->outputFile));
-    memset(tokenWithPid, '\0', sizeof(tokenWithPid));
-    ExpandPid(tokens[input->tokenCount - 1 + backgroundMod], tokenWithPid);
-    strcpy(input->outputFile, tokenWithPid);   
-    return true;
-  /* Check if there are at least 5 tokens or 6 for background command */
-  } else if (input->tokenCount < 5 + backgroundMod) {
-    return false;                                                            
-  /* Check the fourth to last token or fifth to last for background command */        
-  } else if (strcmp(tokens[input->tokenCount - 4 + backgroundMod], outputRedirectChar) == 0) {
-    memset(input->outputFile, '\0', sizeof(input->outputFile));
-    memset(tokenWithPid, '\0', sizeof(tokenWithPid));
-    ExpandPid(tokens[input->tokenCount - 3 + backgroundMod], tokenWithPid);
-    strcpy(input->outputFile, tokenWithPid);   
-    return true;
-  /* If all else fails, no output redirect */ 
+  if (build->pending == '<') {
+    input->inputFile = word;
+    input->isInputRedirect = true;
+    build->lastIsAmp = false;
+  } else if (build->pending == '>') {
+    input->outputFile = word;
+    input->isOutputRedirect = true;
+    build->lastIsAmp = false;
   } else {
-    return false;
+    AddArgument(input, word, &build->capacity, arena);
+    build->lastIsAmp = !isQuoted && word[0] == '&' && word[1] == '\0';
   }
+  build->pending = '\0';
 }
 
 /********************************************************************************
-* Description: AssignArguments()
-*   This function assigns all tokens that are not a command name, and are not
-*   associated with flagging foreground/redirects to the command's arguments.
-*   This requires the function to check the foreground and file redirect flags
-*   so that it knows which tokens to grab and which tokens to leave alone.
+* Description: PlaceFields()
+*   This function adds a word that an unquoted $(...) split, placing each
+*   field that is not empty with PlaceWord(). Nothing is added if every field
+*   is empty, unless the word had quoting of its own. A file name is not
+*   split, its fields are joined again with spaces.
 ********************************************************************************/
-void AssignArguments(struct command *input, int tokenCount, char *tokens[]) {
-  int loopStop = tokenCount;
-  char tokenWithPid[512];
+static void PlaceFields(struct command *input, struct commandBuild *build, char *word,
+                        bool isQuoted, bool isPattern, struct arena *arena) {
+  char *field = word;
+  char *split;
+  bool isPlaced = false;
 
-  if (!input->isForeground) {
-    loopStop -= 1;
+  if (build->pending != '\0') {
+    for (split = strchr(word, FIELD_SPLIT); split != NULL; split = strchr(split, FIELD_SPLIT)) {
+      *split = ' ';
+    }
+    PlaceWord(input, build, word, isQuoted, isPattern, arena);
+    return;
   }
-  if (input->isInputRedirect){
-    loopStop -= 2;   
-  } 
-  if (input->isOutputRedirect) {
-    loopStop -= 2;
+  while (field != NULL) {
+    split = strchr(field, FIELD_SPLIT);
+    if (split != NULL) {
+      *split = '\0';
+    }
+    if (field[0] != '\0') {
+      PlaceWord(input, build, field, true, isPattern, arena);
+      isPlaced = true;
+    }
+    field = split != NULL ? split + 1 : NULL;
+  }
+  if (!isPlaced && isQuoted) {
+    PlaceWord(input, build, word, true, false, arena);
   }
+}
 
-  int i;
-  for (i = 1; i < loopStop; i++) {
-    input->args[i] = (char *) calloc(128, sizeof(char)); 
-    memset(tokenWithPid, '\0', sizeof(tokenWithPid));
-    ExpandPid(tokens[i], tokenWithPid);
-    strcpy(input->args[i], tokenWithPid);   
-    input->argCount++;
+/********************************************************************************
+* Description: TimeoutPrefix()
+*   This function reads "timeout [-k <grace>] <duration>" at the start of a
+*   command that has a command after it, setting its deadline and grace period.
+*   A duration of 0 means none rather than the shell's. Returns how many words
+*   the prefix takes, or 0 if the words are not one, such as when they use an
+*   option of the timeout program.
+********************************************************************************/
+static int TimeoutPrefix(struct command *input) {
+  int skip = 1;
+
+  if (input->argCount > 4 && strcmp(input->args[1], "-k") == 0 &&
+      ParseDuration(input->args[2], &input->graceMs)) {
+    if (input->graceMs == 0) {
+      input->graceMs = -1;
+    }
+    skip = 3;
+  }
+  if (input->argCount <= skip + 1 || !ParseDuration(input->args[skip], &input->timeoutMs)) {
+    input->graceMs = 0;
+    return 0;
+  }
+  if (input->timeoutMs == 0) {
+    input->timeoutMs = -1; /* "timeout 0" means no deadline, not the default */
+  }
+  return skip + 1;
+}
+
+/********************************************************************************
+* Description: IsTimeoutSetting()
+*   This function returns whether a "timeout" that is not a prefix is one the
+*   builtin handles: on its own, "timeout <duration>" or "timeout -k
+*   <duration>". Any other form is left to the timeout program.
+********************************************************************************/
+static bool IsTimeoutSetting(struct command *input) {
+  long milliseconds;
+
+  return input->argCount == 1 ||
+         (input->argCount == 2 && ParseDuration(input->args[1], &milliseconds)) ||
+         (input->argCount == 3 && strcmp(input->args[1], "-k") == 0 &&
+          ParseDuration(input->args[2], &milliseconds));
+}
+
+/********************************************************************************
+* Description: FinishCommand()
+*   This function completes a command once all of its words are in: a final
+*   "&" makes it a background command, the prefixes are taken off, and the
+*   name is looked up in the builtin registry. Returns false and prints an
+*   error on a syntax error.
+********************************************************************************/
+static bool FinishCommand(struct command *input, struct commandBuild *build,
+                          struct arena *arena) {
+  rlim_t limitValue;
+  int resource;
+  int skip;
+
+  if (build->pending != '\0') {
+    fprintf(stderr, "syntax error near '%c'\n", build->pending);
+    return false;
+  }
+
+  /* Only a final & after a command name means background */
+  if (build->lastIsAmp && input->argCount > 1) {
+    input->argCount--;
+    input->isForeground = false;
   }
   input->args[input->argCount] = NULL;
-} 
+
+  if (input->argCount == 0) {
+    fprintf(stderr, "syntax error: missing command\n");
+    return false;
+  }
+
+  /* Prefixes, in any order: "timeout [-k <grace>] <duration> command ..." */
+  /* gives the command its own deadline, "limit <resource> <value> command ..." its own */
+  /* resource limit, and "time command ..." reports its usage */
+  while (true) {
+    if (input->argCount > 3 && strcmp(input->args[0], "limit") == 0 &&
+        (resource = ParseLimit(input->args[1], input->args[2], &limitValue)) >= 0) {
+      if (input->limits == NULL) {
+        input->limits = (struct resourceLimits *) ArenaAlloc(arena, sizeof(struct resourceLimits));
+        input->limits->setMask = 0;
+      }
+      SetLimit(input->limits, resource, limitValue);
+      input->args += 3;
+      input->argCount -= 3;
+    } else if (strcmp(input->args[0], "timeout") == 0 && (skip = TimeoutPrefix(input)) > 0) {
+      input->args += skip;
+      input->argCount -= skip;
+    } else if (input->argCount > 1 && strcmp(input->args[0], "time") == 0 &&
+               input->args[1][0] != '-') {
+      input->isTimed = true;
+      input->args++;
+      input->argCount--;
+    } else {
+      break;
+    }
+  }
+  input->builtin = FindBuiltin(input->args[0]);
+  if (input->builtin != NULL && input->builtin->id == BUILTIN_TIMEOUT &&
+      !IsTimeoutSetting(input)) {
+    input->builtin = NULL; /* The timeout program, with options of its own */
+  }
+  return true;
+}
+
+/********************************************************************************
+* Description: IsDescriptorRedirect()
+*   This function returns true if the plain word from start to op is all
+*   digits and runs straight into the '<' or '>' at op, as the 2 of 2>file
+*   does. Only stdin and stdout can be redirected, so such a line is refused
+*   rather than run with the number as an argument.
+********************************************************************************/
+static bool IsDescriptorRedirect(const char *start, const char *op) {
+  return (*op == '<' || *op == '>') && op > start &&
+         strspn(start, "0123456789") == (size_t) (op - start);
+}
 
 /********************************************************************************
 * Description: CreateCommand()
-*   This function takes the majority of functions in this file and uses them to
-*   build a struct command.
+*   This function builds a struct command from the text at *cursor in a single
+*   pass. Words are split on spaces, tabs and newlines. A word that is "<" or ">"
+*   (or starts with one) takes the next word as its file name, in any position,
+*   a number written against one, as in 2>file, is a syntax error, and a final unquoted "&" makes the command a background command. Quoting is
+*   removed and references expanded by ExpandWord(), and a word with wildcards
+*   is replaced by the paths GlobWord() finds. Words are terminated in place,
+*   and only words that contain references or run straight into an operator
+*   are copied into the arena. The pass stops at '|' or the end of the line,
+*   leaving *cursor there. Returns false and prints an error on a syntax error.
 ********************************************************************************/
-void CreateCommand(char inputBuffer[], struct command *input) {
-  char *inputTokens[600]; /* Allow for at least 512 arguments */
+bool CreateCommand(char **cursor, struct command *input, struct arena *arena) {
+  struct commandBuild build;
+  char *scan = *cursor;
+  char *start;
+  char *word;
+  bool isQuoted;           /* The word had quotes or backslashes removed */
+  bool isPattern;          /* The word has wildcards to expand */
+  bool isSplit;            /* The word holds the fields of a $(...) */
+  char c;
 
-  input->argCount = 0; 
+  StartCommand(input, &build, arena);
+  while (true) {
+    while (IsBlank(*scan)) {
+      scan++;
+    }
+    c = *scan;
+    if (c == '\0' || c == '|') {
+      break;
+    }
 
-  /* Check if command line input is a comment */
-  input->isComment = IsComment(inputBuffer);
+    /* Redirection operators */
+    if (c == '<' || c == '>') {
+      if (build.pending != '\0') {
+        break;
+      }
+      build.pending = c;
+      build.lastIsAmp = false;
+      scan++;
+      continue;
+    }
+
+    /* Scan one word. A plain word ends at the first stop and is terminated */
+    /* in place; one with quoting or references goes through ScanWord() */
+    start = scan;
+    isQuoted = false;
+    isPattern = false;
+    isSplit = false;
+    c = *(scan += strcspn(scan, WORD_STOP));
+    if (IsBlank(c)) {
+      *scan++ = '\0';
+      word = start;
+    } else if (c == '\0') {
+      word = start;
+    } else if (IsDescriptorRedirect(start, scan)) {
+      fprintf(stderr, "syntax error: %.*s%c: only stdin and stdout can be redirected\n",
+              (int) (scan - start), start, c);
+      return false;
+    } else if (c == '<' || c == '>' || c == '|') {
+      word = ArenaStrndup(arena, start, scan - start);
+    } else {
+      word = ScanWord(start, &scan, &isQuoted, &isPattern, NULL, &isSplit, arena);
+      if (word == NULL) {
+        fprintf(stderr, "syntax error: unterminated quote\n");
+        return false;
+      }
+    }
+
+    /* The word is either a file name for a pending redirect or an argument */
+    if (isSplit) {
+      PlaceFields(input, &build, word, isQuoted, isPattern, arena);
+    } else {
+      PlaceWord(input, &build, word, isQuoted, isPattern, arena);
+    }
+  }
+  *cursor = scan;
+  return FinishCommand(input, &build, arena);
+}
 
-  /* If command line input is not a comment, parse into tokens
-     and assign to appropriate struct data members */ 
-  if (!input->isComment) {
-    /* Tokenize command line input using space as the delimiter */
-    input->tokenCount = TokenizeInput(inputBuffer, inputTokens);
-  
-    /* Assign first token to command name */
-    input->isBuiltin = AssignCommandName(input, inputTokens[0]);
+/********************************************************************************
+* Description: ReadTokens()
+*   This function splits a command line into tokens without expanding
+*   anything, for a line that is built with BuildPipeline() later, perhaps
+*   many times. Quoting is removed from a word that has no references, and a
+*   word with wildcards is kept as its pattern, since both come out the same
+*   every time; a word with references is kept as written. The tokens point
+*   into the line and the arena. Returns the number of tokens, 0 for a blank
+*   line or a comment, -1 if a quote is not closed, or -2 if a number runs
+*   into a redirect, as in 2>file.
+********************************************************************************/
+int ReadTokens(char line[], struct token **tokens, struct arena *arena) {
+  struct token *grown;
+  struct token *token;
+  char *scan = line;
+  char *start;
+  bool isPattern;
+  bool isRaw;
+  bool isSplit;   /* Never set, a word that would be split is kept raw */
+  int capacity = 16;
+  int count = 0;
+  char c;
 
-    /* Check for background or foreground */
-    input->isForeground = IsForeground(input->tokenCount, inputTokens);
+  *tokens = (struct token *) ArenaAlloc(arena, capacity * sizeof(struct token));
+  if (IsComment(line)) {
+    return 0;
+  }
+  while (true) {
+    while (IsBlank(*scan)) {
+      scan++;
+    }
+    c = *scan;
+    if (c == '\0') {
+      break;
+    }
+    if (count == capacity) {
+      capacity *= 2;
+      grown = (struct token *) ArenaAlloc(arena, capacity * sizeof(struct token));
+      memcpy(grown, *tokens, count * sizeof(struct token));
+      *tokens = grown;
+    }
+    token = &(*tokens)[count++];
+    token->text = NULL;
+    token->isQuoted = false;
 
-    /* Check for redirects */
-    input->isInputRedirect = IsInputRedirect(input, inputTokens);  
-    input->isOutputRedirect = IsOutputRedirect(input, inputTokens);    
+    if (c == '|' || c == '<' || c == '>') {
+      token->kind = c == '|' ? TOKEN_PIPE : c == '<' ? TOKEN_INPUT : TOKEN_OUTPUT;
+      scan++;
+      continue;
+    }
 
-    /* The remainder are assigned to arguments */
-    AssignArguments(input, input->tokenCount, inputTokens); 
+    /* The same split as CreateCommand(), keeping references as written */
+    start = scan;
+    isPattern = false;
+    isRaw = false;
+    c = *(scan += strcspn(scan, WORD_STOP));
+    if (IsBlank(c)) {
+      *scan++ = '\0';
+      token->text = start;
+    } else if (c == '\0') {
+      token->text = start;
+    } else if (IsDescriptorRedirect(start, scan)) {
+      return -2;
+    } else if (c == '<' || c == '>' || c == '|') {
+      token->text = ArenaStrndup(arena, start, scan - start);
+    } else {
+      token->text = ScanWord(start, &scan, &token->isQuoted, &isPattern, &isRaw,
+                             &isSplit, arena);
+      if (token->text == NULL) {
+        return -1;
+      }
+    }
+    token->kind = isRaw ? TOKEN_RAW : isPattern ? TOKEN_PATTERN : TOKEN_WORD;
   }
+  return count;
 }
 
 /********************************************************************************
-* Description: DestroyCommand()
-*   This function takes a struct command created by CreateCommand() and
-*   deallocates all memory that has been dynamically allocated in the args[]
-*   array. 
+* Description: FinishPipeline()
+*   This function settles the pipeline-wide settings once every stage is
+*   built. Only the last stage decides whether the pipeline runs in the
+*   background, and every stage is given that setting. A "time" or "timeout"
+*   prefix on any stage applies to the whole pipeline.
 ********************************************************************************/
-void DestroyCommand(struct command *input) {
-  /* Free allocated memory in command struct */
+static void FinishPipeline(struct pipeline *input) {
   int i;
-  for (i = 0; i < input->argCount; i++) {
-    free(input->args[i]);
-    input->args[i] = NULL;
+
+  input->isForeground = input->stages[input->stageCount - 1].isForeground;
+  input->isTimed = false;
+  input->timeoutMs = 0;
+  input->graceMs = 0;
+  for (i = 0; i < input->stageCount; i++) {
+    input->stages[i].isForeground = input->isForeground;
+    input->isTimed = input->isTimed || input->stages[i].isTimed;
+    if (input->stages[i].timeoutMs != 0) {
+      input->timeoutMs = input->stages[i].timeoutMs;
+      input->graceMs = input->stages[i].graceMs;
+    }
   }
+}
+
+/********************************************************************************
+* Description: BuildPipeline()
+*   This function builds a struct pipeline from tokens made by ReadTokens(),
+*   the way CreatePipeline() builds one from text. The words kept as written
+*   are expanded now and the patterns matched now, each in a copy in the
+*   arena, so the tokens themselves are never changed and can be built again.
+*   Returns false and prints an error on a syntax error.
+********************************************************************************/
+bool BuildPipeline(const struct token *tokens, int count, struct pipeline *input,
+                   struct arena *arena) {
+  struct commandBuild build;
+  struct command *grown;
+  struct command *stage;
+  char *scan;
+  char *word;
+  bool isQuoted;
+  bool isPattern;
+  bool isSplit;
+  int capacity = 4;
+  int i = 0;
+
+  input->stageCount = 0;
+  input->stages = NULL;
+  input->isComment = count == 0;
+  if (input->isComment) {
+    return true;
+  }
+
+  input->stages = (struct command *) ArenaAlloc(arena, capacity * sizeof(struct command));
+  while (true) {
+    if (input->stageCount == capacity) {
+      capacity *= 2;
+      grown = (struct command *) ArenaAlloc(arena, capacity * sizeof(struct command));
+      memcpy(grown, input->stages, input->stageCount * sizeof(struct command));
+      input->stages = grown;
+    }
+    stage = &input->stages[input->stageCount];
+    StartCommand(stage, &build, arena);
+    for (; i < count && tokens[i].kind != TOKEN_PIPE; i++) {
+      if (tokens[i].kind == TOKEN_INPUT || tokens[i].kind == TOKEN_OUTPUT) {
+        if (build.pending != '\0') {
+          break;
+        }
+        build.pending = tokens[i].kind == TOKEN_INPUT ? '<' : '>';
+        build.lastIsAmp = false;
+        continue;
+      }
+      word = tokens[i].text;
+      isQuoted = tokens[i].isQuoted;
+      isPattern = tokens[i].kind == TOKEN_PATTERN;
+      if (tokens[i].kind != TOKEN_WORD) { /* Expanded or unescaped in place */
+        word = ArenaStrndup(arena, word, strlen(word));
+      }
+      isSplit = false;
+      if (tokens[i].kind == TOKEN_RAW) {
+        scan = word;
+        word = ScanWord(word, &scan, &isQuoted, &isPattern, NULL, &isSplit, arena);
+      }
+      if (isSplit) {
+        PlaceFields(stage, &build, word, isQuoted, isPattern, arena);
+      } else {
+        PlaceWord(stage, &build, word, isQuoted, isPattern, arena);
+      }
+    }
+    if (!FinishCommand(stage, &build, arena)) {
+      DestroyPipeline(input);
+      return false;
+    }
+    input->stageCount++;
+    if (i >= count || tokens[i].kind != TOKEN_PIPE) {
+      break;
+    }
+    i++;
+  }
+  FinishPipeline(input);
+  return true;
+}
+
+/********************************************************************************
+* Description: DestroyCommand()
+*   This function takes a struct command created by CreateCommand() and clears
+*   it. The memory it points to belongs to the arena, which the shell resets
+*   once the whole line has run.
+********************************************************************************/
+void DestroyCommand(struct command *input) {
+  input->args = NULL;
+  input->inputFile = NULL;
+  input->outputFile = NULL;
   input->argCount = 0;
 }
 
+/********************************************************************************
+* Description: CreatePipeline()
+*   This function builds a struct pipeline from a command line in one pass,
+*   calling CreateCommand() for each stage and stepping over the '|' between
+*   stages. The stage array lives in the arena and doubles when it is full.
+*   FinishPipeline() then applies the settings that hold for every stage.
+*   Returns false and prints an error on a syntax error.
+********************************************************************************/
+bool CreatePipeline(char inputBuffer[], struct pipeline *input, struct arena *arena) {
+  struct command *grown;
+  char *cursor = inputBuffer;
+  int capacity = 4;
+
+  input->stageCount = 0;
+  input->stages = NULL;
+
+  /* A comment is never parsed */
+  input->isComment = IsComment(inputBuffer);
+  if (input->isComment) {
+    return true;
+  }
+
+  input->stages = (struct command *) ArenaAlloc(arena, capacity * sizeof(struct command));
+  while (true) {
+    if (input->stageCount == capacity) {
+      capacity *= 2;
+      grown = (struct command *) ArenaAlloc(arena, capacity * sizeof(struct command));
+      memcpy(grown, input->stages, input->stageCount * sizeof(struct command));
+      input->stages = grown;
+    }
+    if (!CreateCommand(&cursor, &input->stages[input->stageCount], arena)) {
+      DestroyPipeline(input);
+      return false;
+    }
+    input->stageCount++;
+    if (*cursor != '|') {
+      break;
+    }
+    cursor++;
+  }
 
+  FinishPipeline(input);
+  return true;
+}
 
+/********************************************************************************
+* Description: DestroyPipeline()
+*   This function destroys every stage of a struct pipeline created by
+*   CreatePipeline(). The stage array belongs to the arena.
+********************************************************************************/
+void DestroyPipeline(struct pipeline *input) {
+  int i;
+  for (i = 0; i < input->stageCount; i++) {
+    DestroyCommand(&input->stages[i]);
+  }
+  input->stages = NULL;
+  input->stageCount = 0;
+}
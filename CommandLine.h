@@ -8,6 +8,7 @@
 #ifndef COMMANDLINE_H
 #define COMMANDLINE_H
 
+#define _GNU_SOURCE             /* Linux extensions such as O_PATH and copy_file_range */
 #define _POSIX_C_SOURCE 200809L /* https://stackoverflow.com/questions/23961147/ */
                                 /* implicit-declaration-of-function-strtok-r-wimplicit-
                                    function-declaration-in */
@@ -15,36 +16,94 @@
                                 /* for POSIX version supporting getline and strtok_r
                                    support in C */                              
 
+#include "Arena.h"
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+struct builtin;
+struct resourceLimits;
+
 struct command {
-  char *args[512]; /* The first argument is the command name */
-  char inputFile[1024];
-  char outputFile[1024];
+  char **args; /* NULL terminated, the first argument is the command name */
+  const struct builtin *builtin; /* Registry entry if the name is a builtin, else NULL */
+  char *inputFile;
+  char *outputFile;
   int argCount;
-  int tokenCount; /* This is the number of string tokens from command line input */
+  long timeoutMs; /* Deadline from a "timeout" prefix, 0 for the shell default */
+  long graceMs;   /* From "timeout -k", 0 for the shell's grace period, -1 for none */
+  struct resourceLimits *limits; /* From "limit" prefixes, NULL for the shell defaults */
   bool isComment;
   bool isForeground;
   bool isInputRedirect;
   bool isOutputRedirect;
-  bool isBuiltin;
+  bool isTimed;   /* Had a "time" prefix */
+};
+
+struct pipeline {
+  struct command *stages; /* One command per stage, connected by pipes */
+  int stageCount;
+  bool isComment;
+  bool isForeground;    /* Taken from the last stage */
+  bool isTimed;         /* Any stage had a "time" prefix */
+  long timeoutMs;       /* A "timeout" prefix on any stage applies to the whole pipeline */
+  long graceMs;
+};
+
+enum tokenKind {      /* What ReadTokens() found, see BuildPipeline() */
+  TOKEN_WORD,         /* A word as it will be used, quoting removed */
+  TOKEN_PATTERN,      /* A pattern to match with GlobWord() each time */
+  TOKEN_RAW,          /* A word with references, expanded each time */
+  TOKEN_INPUT,        /* "<" */
+  TOKEN_OUTPUT,       /* ">" */
+  TOKEN_PIPE          /* "|" between stages */
+};
+
+#define INPUT_CHUNK 65536           /* First size of an input reader's buffer */
+#define INPUT_DEFAULT_LIMIT 131072  /* Longest line when ARG_MAX is unknown */
+
+struct inputReader {  /* Lines read from a descriptor a block at a time */
+  char *buffer;       /* malloc()ed, doubled up to limit + 2 bytes */
+  size_t capacity;
+  size_t start;       /* First byte not yet returned as a line */
+  size_t end;         /* One past the last byte read */
+  size_t limit;       /* Longest line, ARG_MAX */
+  int fd;
+  bool isTerminal;    /* Prompted, and waits on the shell's events */
+  bool isDone;        /* read() found the end of the input */
+};
+
+struct token {
+  char *text;         /* NULL for an operator */
+  enum tokenKind kind;
+  bool isQuoted;      /* Had quoting, so a lone "&" is an argument */
 };
 
-void GetInput(char inputBuffer[]);
-void ExpandPid(char *input, char output[]); 
-int TokenizeInput(char inputBuffer[], char *tokens[]); 
-bool AssignCommandName(struct command *input, char *firstToken); 
+void InitInput(struct inputReader *reader, int fd);
+char *GetInput(struct inputReader *reader, const char *prompt, int eventFd,
+               void (*eventHandler)(void));
+void FreeInput(struct inputReader *reader);
+char *MapScript(const char *path, size_t *length);
+void UnmapScript(char *script, size_t length);
+char *NextScriptLine(char **cursor, char *end);
+void InitPidString(void);
+void SetSubstitution(char *(*run)(const char *command, size_t length, size_t *outputLength));
+void SetLastStatus(int status);
+void SetLastBackground(pid_t pid);
+const char *GetShellVariable(const char *name);
+void SetShellVariable(const char *name, const char *value);
+void UnsetShellVariable(const char *name);
+bool ParseDuration(const char *text, long *milliseconds);
 bool IsComment(char inputBuffer[]); 
-bool IsForeground(int tokenCount, char *tokens[]); 
-bool IsInputRedirect(struct command *input, char *tokens[]); 
-bool IsOutputRedirect(struct command *input, char *tokens[]); 
-void AssignArguments(struct command *input, int tokenCount, char *tokens[]); 
-void CreateCommand(char inputBuffer[], struct command *input); 
+bool CreateCommand(char **cursor, struct command *input, struct arena *arena); 
 void DestroyCommand(struct command *input); 
+bool CreatePipeline(char inputBuffer[], struct pipeline *input, struct arena *arena);
+int ReadTokens(char line[], struct token **tokens, struct arena *arena);
+bool BuildPipeline(const struct token *tokens, int count, struct pipeline *input,
+                   struct arena *arena);
+void DestroyPipeline(struct pipeline *input);
 #endif
 
 
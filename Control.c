@@ -0,0 +1,389 @@
+/********************************************************************************
+* Program Name: Control.c
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: This is the parser for smallsh's control flow:
+*
+*     if command        while command       for name in words
+*     then              do                  do
+*       commands          commands            commands
+*     elif command      done                done
+*     then
+*       commands        break [n]
+*     else              continue [n]
+*       commands
+*     fi
+*
+*   A line that starts with one of these words, and every line after it until
+*   the block is closed, is split into tokens with ReadTokens() and added to a
+*   tree of nodes. Within those lines a ';' separates commands the way a new
+*   line does, so "for f in *.c; do cc -c $f; done" fits on one line, and the
+*   commands after then, else and do can share their line. Every line
+*   anywhere else keeps its ';' as part of a word, as before.
+*
+*   The tokens are copied into the parser's arena, so the lines they came
+*   from can be reused at once. smallsh.c runs the tree with BuildPipeline(),
+*   which expands each command's references again every time it runs.
+********************************************************************************/
+#include "Control.h"
+#include <ctype.h>
+
+#define IsBlank(c) ((c) == ' ' || (c) == '\t' || (c) == '\n')
+
+static const char *keywords[] = {
+  "if", "then", "elif", "else", "fi", "while", "for", "do", "done",
+  "break", "continue", NULL
+};
+
+/********************************************************************************
+* Description: IsKeyword()
+*   This function returns true if a token is the keyword word: written as is,
+*   with no quoting.
+********************************************************************************/
+static bool IsKeyword(const struct token *token, const char *word) {
+  return token->kind == TOKEN_WORD && !token->isQuoted && strcmp(token->text, word) == 0;
+}
+
+/********************************************************************************
+* Description: TokenText()
+*   This function returns a token as it was written, for an error message.
+********************************************************************************/
+static const char *TokenText(const struct token *token) {
+  if (token->text != NULL) {
+    return token->text;
+  }
+  return token->kind == TOKEN_PIPE ? "|" : token->kind == TOKEN_INPUT ? "<" : ">";
+}
+
+/********************************************************************************
+* Description: StartsControl()
+*   This function returns true if a line's first word is a control keyword,
+*   so the line belongs to AddControlText() rather than CreatePipeline().
+********************************************************************************/
+bool StartsControl(const char *line) {
+  size_t length;
+  int i;
+
+  while (IsBlank(*line)) {
+    line++;
+  }
+  length = strcspn(line, " \t\n;");
+  for (i = 0; keywords[i] != NULL; i++) {
+    if (strlen(keywords[i]) == length && strncmp(line, keywords[i], length) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/********************************************************************************
+* Description: InitControl()
+*   This function sets up a parser with nothing read.
+********************************************************************************/
+void InitControl(struct controlParser *parser) {
+  InitArena(&parser->arena);
+  ResetControl(parser);
+}
+
+/********************************************************************************
+* Description: ResetControl()
+*   This function drops every node read, once they have run or after an
+*   error, keeping the arena's memory for the next block.
+********************************************************************************/
+void ResetControl(struct controlParser *parser) {
+  ResetArena(&parser->arena);
+  parser->nodes = NULL;
+  parser->tail = &parser->nodes;
+  parser->depth = 0;
+}
+
+/********************************************************************************
+* Description: SyntaxError()
+*   This function reports a word that does not fit where it is, drops the
+*   block being read and returns CONTROL_ERROR.
+********************************************************************************/
+static enum controlResult SyntaxError(struct controlParser *parser, const char *near) {
+  fprintf(stderr, "syntax error near '%s'\n", near);
+  ResetControl(parser);
+  return CONTROL_ERROR;
+}
+
+/********************************************************************************
+* Description: NewNode()
+*   This function makes a node for tokens in the parser's arena.
+********************************************************************************/
+static struct controlNode *NewNode(struct controlParser *parser, enum nodeKind kind,
+                                   struct token *tokens, int count) {
+  struct controlNode *node;
+
+  node = (struct controlNode *) ArenaAlloc(&parser->arena, sizeof(struct controlNode));
+  node->kind = kind;
+  node->tokens = tokens;
+  node->tokenCount = count;
+  node->name = NULL;
+  node->levels = 1;
+  node->body = NULL;
+  node->orElse = NULL;
+  node->next = NULL;
+  return node;
+}
+
+/********************************************************************************
+* Description: AppendNode()
+*   This function adds a node to the list that is open, the innermost
+*   block's or the top level, and returns it.
+********************************************************************************/
+static struct controlNode *AppendNode(struct controlParser *parser,
+                                      struct controlNode *node) {
+  struct controlNode ***tail;
+
+  tail = parser->depth > 0 ? &parser->frames[parser->depth - 1].tail : &parser->tail;
+  **tail = node;
+  *tail = &node->next;
+  return node;
+}
+
+/********************************************************************************
+* Description: OpenBlock()
+*   This function starts reading the block of an if, while or for node.
+*   Returns false if too many blocks are open already.
+********************************************************************************/
+static bool OpenBlock(struct controlParser *parser, struct controlNode *node,
+                      enum controlState state) {
+  if (parser->depth == CONTROL_DEPTH) {
+    return false;
+  }
+  parser->frames[parser->depth].node = node;
+  parser->frames[parser->depth].tail = NULL;
+  parser->frames[parser->depth].state = state;
+  parser->depth++;
+  return true;
+}
+
+/********************************************************************************
+* Description: CountLevels()
+*   This function reads the optional count of a break or continue into the
+*   node. Returns false if it is not a positive number.
+********************************************************************************/
+static bool CountLevels(struct controlNode *node, const struct token *tokens, int count) {
+  const char *digit;
+
+  if (count == 1) {
+    return true;
+  }
+  if (count > 2 || tokens[1].kind != TOKEN_WORD || tokens[1].text[0] == '\0') {
+    return false;
+  }
+  for (digit = tokens[1].text; *digit != '\0'; digit++) {
+    if (!isdigit((unsigned char) *digit)) {
+      return false;
+    }
+  }
+  node->levels = atoi(tokens[1].text);
+  return node->levels > 0;
+}
+
+/********************************************************************************
+* Description: IsForHead()
+*   This function checks "for name in words": a plain variable name, the
+*   word in, and words that are neither redirections nor pipes.
+********************************************************************************/
+static bool IsForHead(const struct token *tokens, int count) {
+  const char *c;
+  int i;
+
+  if (count < 3 || tokens[1].kind != TOKEN_WORD || tokens[1].isQuoted ||
+      !IsKeyword(&tokens[2], "in")) {
+    return false;
+  }
+  for (c = tokens[1].text; *c != '\0'; c++) {
+    if (!(isalpha((unsigned char) *c) || *c == '_' ||
+          (c != tokens[1].text && isdigit((unsigned char) *c)))) {
+      return false;
+    }
+  }
+  for (i = 3; i < count; i++) {
+    if (tokens[i].text == NULL) {
+      return false;
+    }
+  }
+  return tokens[1].text[0] != '\0';
+}
+
+/********************************************************************************
+* Description: AddSegment()
+*   This function adds one command, with any keyword in front of it, to the
+*   tree. The tokens already belong to the parser's arena.
+********************************************************************************/
+static enum controlResult AddSegment(struct controlParser *parser, struct token *tokens,
+                                     int count) {
+  struct controlFrame *frame;
+  struct controlNode *node;
+
+  while (count > 0) {
+    frame = parser->depth > 0 ? &parser->frames[parser->depth - 1] : NULL;
+
+    /* A condition is followed by then or do, which can share a line with a command */
+    if (frame != NULL && (frame->state == EXPECT_THEN || frame->state == EXPECT_DO)) {
+      if (!IsKeyword(&tokens[0], frame->state == EXPECT_THEN ? "then" : "do")) {
+        return SyntaxError(parser, TokenText(&tokens[0]));
+      }
+      frame->state = frame->state == EXPECT_THEN ? IN_THEN : IN_DO;
+      frame->tail = &frame->node->body;
+      tokens++;
+      count--;
+      continue;
+    }
+
+    if (IsKeyword(&tokens[0], "if") || IsKeyword(&tokens[0], "while")) {
+      if (count == 1) {
+        return SyntaxError(parser, tokens[0].text);
+      }
+      node = AppendNode(parser, NewNode(parser, tokens[0].text[0] == 'i' ?
+                                        NODE_IF : NODE_WHILE, tokens + 1, count - 1));
+      if (!OpenBlock(parser, node, node->kind == NODE_IF ? EXPECT_THEN : EXPECT_DO)) {
+        return SyntaxError(parser, tokens[0].text);
+      }
+    } else if (IsKeyword(&tokens[0], "for")) {
+      if (!IsForHead(tokens, count)) {
+        return SyntaxError(parser, tokens[0].text);
+      }
+      node = AppendNode(parser, NewNode(parser, NODE_FOR, tokens + 2, count - 2));
+      node->name = tokens[1].text;
+      if (!OpenBlock(parser, node, EXPECT_DO)) {
+        return SyntaxError(parser, tokens[0].text);
+      }
+    } else if (IsKeyword(&tokens[0], "elif")) {
+      if (frame == NULL || frame->state != IN_THEN || count == 1) {
+        return SyntaxError(parser, tokens[0].text);
+      }
+      /* The elif is an if of its own in the else list, closed by the same fi */
+      node = NewNode(parser, NODE_IF, tokens + 1, count - 1);
+      frame->node->orElse = node;
+      frame->node = node;
+      frame->state = EXPECT_THEN;
+    } else if (IsKeyword(&tokens[0], "else")) {
+      if (frame == NULL || frame->state != IN_THEN) {
+        return SyntaxError(parser, tokens[0].text);
+      }
+      frame->state = IN_ELSE;
+      frame->tail = &frame->node->orElse;
+      tokens++;
+      count--;
+      continue;
+    } else if (IsKeyword(&tokens[0], "fi") || IsKeyword(&tokens[0], "done")) {
+      if (frame == NULL ||
+          (tokens[0].text[0] == 'f' && frame->state != IN_THEN && frame->state != IN_ELSE) ||
+          (tokens[0].text[0] == 'd' && frame->state != IN_DO)) {
+        return SyntaxError(parser, tokens[0].text);
+      }
+      if (count > 1) { /* Nothing can follow, not even a redirection of the block */
+        return SyntaxError(parser, TokenText(&tokens[1]));
+      }
+      parser->depth--;
+    } else if (IsKeyword(&tokens[0], "break") || IsKeyword(&tokens[0], "continue")) {
+      node = AppendNode(parser, NewNode(parser, tokens[0].text[0] == 'b' ?
+                                        NODE_BREAK : NODE_CONTINUE, tokens, count));
+      if (!CountLevels(node, tokens, count)) {
+        return SyntaxError(parser, TokenText(&tokens[count - 1]));
+      }
+    } else if (IsKeyword(&tokens[0], "then") || IsKeyword(&tokens[0], "do")) {
+      return SyntaxError(parser, tokens[0].text);
+    } else {
+      AppendNode(parser, NewNode(parser, NODE_COMMAND, tokens, count));
+    }
+    break;
+  }
+  return CONTROL_MORE;
+}
+
+/********************************************************************************
+* Description: AddControlTokens()
+*   This function adds one line's tokens, as made by ReadTokens() from a line
+*   with no ';', to the tree. They are copied, so the caller can reuse them.
+*   Returns CONTROL_READY once every block is closed.
+********************************************************************************/
+enum controlResult AddControlTokens(struct controlParser *parser,
+                                    const struct token *tokens, int count) {
+  struct token *copy;
+  int i;
+
+  if (count > 0) {
+    copy = (struct token *) ArenaAlloc(&parser->arena, count * sizeof(struct token));
+    for (i = 0; i < count; i++) {
+      copy[i] = tokens[i];
+      if (tokens[i].text != NULL) {
+        copy[i].text = ArenaStrndup(&parser->arena, tokens[i].text, strlen(tokens[i].text));
+      }
+    }
+    if (AddSegment(parser, copy, count) == CONTROL_ERROR) {
+      return CONTROL_ERROR;
+    }
+  }
+  return parser->depth > 0 ? CONTROL_MORE : CONTROL_READY;
+}
+
+/********************************************************************************
+* Description: ListEnd()
+*   This function finds the ';' that ends a command, skipping any inside
+*   quotes, after a backslash or inside a $(...). Returns the end of the line
+*   if there is none.
+********************************************************************************/
+static char *ListEnd(char *line) {
+  char *scan = line;
+  char quote = '\0';
+  int depth = 0;  /* Parentheses open since a "$(" */
+
+  for (; *scan != '\0'; scan++) {
+    if (*scan == '\\' && quote != '\'' && scan[1] != '\0') {
+      scan++;
+    } else if (quote != '\0') {
+      quote = *scan == quote ? '\0' : quote;
+    } else if (*scan == '\'' || *scan == '"') {
+      quote = *scan;
+    } else if (*scan == '(' && (depth > 0 || (scan > line && scan[-1] == '$'))) {
+      depth++;
+    } else if (*scan == ')' && depth > 0) {
+      depth--;
+    } else if (*scan == ';' && depth == 0) {
+      break;
+    }
+  }
+  return scan;
+}
+
+/********************************************************************************
+* Description: AddControlText()
+*   This function splits a line into the commands between its ';'s and adds
+*   each to the tree. The line is tokenized in place. A '#' starting a
+*   command makes the rest of the line a comment. Returns CONTROL_READY once
+*   every block is closed.
+********************************************************************************/
+enum controlResult AddControlText(struct controlParser *parser, char line[]) {
+  struct token *tokens;
+  char *segment = line;
+  char *end;
+  bool isLast = false;
+  int count;
+
+  while (!isLast) {
+    end = ListEnd(segment);
+    isLast = *end == '\0';
+    *end = '\0';
+    if (IsComment(segment)) {
+      break;
+    }
+    count = ReadTokens(segment, &tokens, &parser->arena);
+    if (count < 0) {
+      fprintf(stderr, "syntax error: %s\n", count == -1 ? "unterminated quote" :
+              "only stdin and stdout can be redirected");
+      ResetControl(parser);
+      return CONTROL_ERROR;
+    }
+    if (AddControlTokens(parser, tokens, count) == CONTROL_ERROR) {
+      return CONTROL_ERROR;
+    }
+    segment = end + 1;
+  }
+  return parser->depth > 0 ? CONTROL_MORE : CONTROL_READY;
+}
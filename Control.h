@@ -0,0 +1,78 @@
+/********************************************************************************
+* Program Name: Control.h
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: Header file for Control.c. Reads if, while and for blocks, one
+*   line at a time, into a tree of nodes that smallsh.c runs in the shell.
+********************************************************************************/
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include "CommandLine.h"
+#include "Arena.h"
+
+#define CONTROL_DEPTH 32 /* Blocks that can be open inside each other */
+
+enum nodeKind {
+  NODE_COMMAND,
+  NODE_IF,
+  NODE_WHILE,
+  NODE_FOR,
+  NODE_BREAK,
+  NODE_CONTINUE
+};
+
+struct controlNode {
+  enum nodeKind kind;
+  struct token *tokens;        /* The command, the if or while condition, or */
+  int tokenCount;              /* the for words starting with "in" */
+  const char *name;            /* Variable a for loop sets */
+  int levels;                  /* Loops a break or continue leaves */
+  struct controlNode *body;    /* The then or do list */
+  struct controlNode *orElse;  /* The else list, or the if of an elif */
+  struct controlNode *next;
+};
+
+enum controlState {   /* Where a block is up to */
+  EXPECT_THEN,
+  IN_THEN,
+  IN_ELSE,
+  EXPECT_DO,
+  IN_DO
+};
+
+struct controlFrame {
+  struct controlNode *node;   /* The if, elif, while or for being read */
+  struct controlNode **tail;  /* Where the next node of its open list goes */
+  enum controlState state;
+};
+
+struct controlParser {
+  struct arena arena;         /* Every node and token read, until ResetControl() */
+  struct controlNode *nodes;  /* Top-level nodes read so far, in order */
+  struct controlNode **tail;
+  struct controlFrame frames[CONTROL_DEPTH];
+  int depth;                  /* Blocks still open */
+};
+
+enum controlResult {
+  CONTROL_MORE,   /* A block is open, read another line */
+  CONTROL_READY,  /* parser->nodes can be run */
+  CONTROL_ERROR   /* A syntax error was printed and the block dropped */
+};
+
+enum controlJump {  /* How running a list of nodes ended */
+  JUMP_NONE,
+  JUMP_BREAK,
+  JUMP_CONTINUE,
+  JUMP_EXIT,        /* "exit" ran */
+  JUMP_INTERRUPT    /* Ctrl-C, leave every loop */
+};
+
+bool StartsControl(const char *line);
+void InitControl(struct controlParser *parser);
+void ResetControl(struct controlParser *parser);
+enum controlResult AddControlText(struct controlParser *parser, char line[]);
+enum controlResult AddControlTokens(struct controlParser *parser,
+                                    const struct token *tokens, int count);
+#endif
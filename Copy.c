@@ -0,0 +1,188 @@
+/********************************************************************************
+* Program Name: Copy.c
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: This is the copy loop behind the cat and cp builtins. Data is
+*   moved with copy_file_range(), which can share extents or copy inside the
+*   file system, then with sendfile(), then with splice() through a pipe, so
+*   that it never passes through a userspace buffer. A plain read/write loop
+*   is kept for descriptors that support none of them, such as a terminal.
+********************************************************************************/
+#include "Copy.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+
+#define COPY_CHUNK (64 * 1024 * 1024) /* Largest single call, so Ctrl-C is seen often */
+#define PIPE_CHUNK (1024 * 1024)      /* Requested size of the splice pipe */
+#define BUFFER_CHUNK (128 * 1024)     /* Buffer for the read/write fallback */
+
+enum copyMethod {
+  COPY_RANGE, /* copy_file_range(), file to file */
+  COPY_SEND,  /* sendfile(), from anything that can be mapped or spliced */
+  COPY_SPLICE,/* splice(), with a pipe in between if neither end is one */
+  COPY_BUFFER /* read() and write() */
+};
+
+/********************************************************************************
+* Description: IsUnsupported()
+*   This function returns whether a copy call failed because the descriptors
+*   do not allow that method, so the next one should be tried.
+********************************************************************************/
+static bool IsUnsupported(int error) {
+  return error == EINVAL || error == EXDEV || error == ENOSYS || error == EOPNOTSUPP ||
+         error == EBADF;
+}
+
+/********************************************************************************
+* Description: WriteAll()
+*   This function writes a whole buffer, retrying short writes. Returns -1 on
+*   an error.
+********************************************************************************/
+static int WriteAll(int fd, const char *buffer, ssize_t length,
+                    volatile sig_atomic_t *interrupted) {
+  ssize_t written;
+
+  while (length > 0) {
+    written = write(fd, buffer, length);
+    if (written < 0) {
+      if (errno == EINTR && !*interrupted) {
+        continue;
+      }
+      return -1;
+    }
+    buffer += written;
+    length -= written;
+  }
+  return 0;
+}
+
+/********************************************************************************
+* Description: DrainPipe()
+*   This function empties the splice pipe into fdOut with read and write, for
+*   when fdOut turns out not to accept splice(). Returns -1 on an error.
+********************************************************************************/
+static int DrainPipe(int pipeOut, int fdOut, ssize_t pending,
+                     volatile sig_atomic_t *interrupted) {
+  char buffer[4096];
+  ssize_t n;
+
+  while (pending > 0) {
+    n = read(pipeOut, buffer, pending < (ssize_t) sizeof(buffer) ? pending : (ssize_t) sizeof(buffer));
+    if (n <= 0 || WriteAll(fdOut, buffer, n, interrupted) < 0) {
+      return -1;
+    }
+    pending -= n;
+  }
+  return 0;
+}
+
+/********************************************************************************
+* Description: SpliceChunk()
+*   This function moves up to one chunk with splice(). If neither descriptor
+*   is a pipe the data goes through the pipe in bridge, which is created on
+*   first use. Returns the bytes moved, 0 at the end of the input, or -1. If
+*   fdOut refuses splice after the input was already taken, the data is
+*   written out with DrainPipe() and *method falls back to COPY_BUFFER.
+********************************************************************************/
+static ssize_t SpliceChunk(int fdIn, int fdOut, bool hasPipe, int bridge[2],
+                           enum copyMethod *method, volatile sig_atomic_t *interrupted) {
+  ssize_t moved;
+  ssize_t sent;
+  ssize_t n;
+
+  if (hasPipe) {
+    return splice(fdIn, NULL, fdOut, NULL, COPY_CHUNK, SPLICE_F_MOVE);
+  }
+
+  if (bridge[0] < 0) {
+    if (pipe2(bridge, O_CLOEXEC) < 0) {
+      return -1;
+    }
+    fcntl(bridge[1], F_SETPIPE_SZ, PIPE_CHUNK);
+  }
+  moved = splice(fdIn, NULL, bridge[1], NULL, PIPE_CHUNK, SPLICE_F_MOVE);
+  for (sent = 0; moved > 0 && sent < moved; sent += n) {
+    n = splice(bridge[0], NULL, fdOut, NULL, moved - sent, SPLICE_F_MOVE);
+    if (n < 0 && errno == EINTR && !*interrupted) {
+      n = 0;
+    } else if (n < 0 && IsUnsupported(errno)) {
+      *method = COPY_BUFFER;
+      return DrainPipe(bridge[0], fdOut, moved - sent, interrupted) < 0 ? -1 : moved;
+    } else if (n < 0) {
+      return -1;
+    }
+  }
+  return moved;
+}
+
+/********************************************************************************
+* Description: CopyFd()
+*   This function copies everything left in fdIn to fdOut, trying each method
+*   in turn until one is accepted. A signal ends the copy only once the caller's
+*   handler has set *interrupted. Returns 0, or -1 with errno set.
+********************************************************************************/
+int CopyFd(int fdIn, int fdOut, volatile sig_atomic_t *interrupted) {
+  enum copyMethod method = COPY_RANGE;
+  struct stat inInfo;
+  struct stat outInfo;
+  int bridge[2] = {-1, -1};
+  char *buffer = NULL;
+  bool hasPipe;
+  ssize_t n;
+  int savedErrno;
+
+  if (fstat(fdIn, &inInfo) < 0 || fstat(fdOut, &outInfo) < 0) {
+    return -1;
+  }
+  hasPipe = S_ISFIFO(inInfo.st_mode) || S_ISFIFO(outInfo.st_mode);
+  /* Files such as those in /proc report a size of 0 and read as empty to */
+  /* copy_file_range(), so it is only used for regular files with data */
+  if (!S_ISREG(inInfo.st_mode) || inInfo.st_size == 0 || !S_ISREG(outInfo.st_mode)) {
+    method = COPY_SEND;
+  }
+
+  while (true) {
+    if (*interrupted) { /* A chunk can finish even though a signal came in */
+      errno = EINTR;
+      n = -1;
+      break;
+    }
+    if (method == COPY_RANGE) {
+      n = copy_file_range(fdIn, NULL, fdOut, NULL, COPY_CHUNK, 0);
+    } else if (method == COPY_SEND) {
+      n = sendfile(fdOut, fdIn, NULL, COPY_CHUNK);
+    } else if (method == COPY_SPLICE) {
+      n = SpliceChunk(fdIn, fdOut, hasPipe, bridge, &method, interrupted);
+    } else {
+      if (buffer == NULL) {
+        buffer = (char *) malloc(BUFFER_CHUNK);
+      }
+      n = read(fdIn, buffer, BUFFER_CHUNK);
+      if (n > 0 && WriteAll(fdOut, buffer, n, interrupted) < 0) {
+        n = -1;
+      }
+    }
+
+    if (n == 0) {
+      break;
+    } else if (n < 0 && errno == EINTR && !*interrupted) {
+      continue;
+    } else if (n < 0 && method != COPY_BUFFER && IsUnsupported(errno)) {
+      method++; /* Nothing was copied, try the next method */
+      continue;
+    } else if (n < 0) {
+      break;
+    }
+  }
+
+  savedErrno = errno;
+  if (bridge[0] >= 0) {
+    close(bridge[0]);
+    close(bridge[1]);
+  }
+  free(buffer);
+  errno = savedErrno;
+  return n < 0 ? -1 : 0;
+}
@@ -0,0 +1,15 @@
+/********************************************************************************
+* Program Name: Copy.h
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: Header file for Copy.c. Moves data between two descriptors
+*   inside the kernel for the cat and cp builtins.
+********************************************************************************/
+#ifndef COPY_H
+#define COPY_H
+
+#include "CommandLine.h"
+#include <signal.h>
+
+int CopyFd(int fdIn, int fdOut, volatile sig_atomic_t *interrupted);
+#endif
@@ -0,0 +1,223 @@
+/********************************************************************************
+* Program Name: Directory.c
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: This is the set of functions that track the shell's working
+*   directory. The kernel's cwd is the only copy of it: "cd" resolves the path
+*   once into an O_PATH descriptor and fchdir()s to it, so children inherit the
+*   directory without being told it, and the path string is only built by
+*   getcwd() when something prints it. pushd and popd keep the directories they
+*   leave as descriptors too, so going back is a single fchdir() no matter what
+*   has been renamed in between.
+********************************************************************************/
+#include "CommandLine.h"
+#include "Directory.h"
+#include <errno.h>
+#include <fcntl.h>
+
+#define DIR_PATH_SIZE 256   /* Starting size of a path buffer, doubled as needed */
+#define DIR_STACK_SIZE 8    /* Starting stack capacity, doubled as needed */
+
+struct directoryStack workingDirs = {{-1, NULL}, 0, false, NULL, 0, 0};
+
+/********************************************************************************
+* Description: OpenDirectory()
+*   This function opens a directory for fchdir() only, or returns -1.
+********************************************************************************/
+static int OpenDirectory(const char *path) {
+  return open(path, O_PATH | O_DIRECTORY | O_CLOEXEC);
+}
+
+/********************************************************************************
+* Description: EntryPath()
+*   This function returns the path of a saved directory, read from the
+*   descriptor's /proc link each time so a directory renamed while on the stack
+*   is shown where it is now.
+********************************************************************************/
+static const char *EntryPath(struct dirEntry *entry) {
+  char link[32];
+  size_t size = DIR_PATH_SIZE;
+  ssize_t length;
+
+  snprintf(link, sizeof(link), "/proc/self/fd/%d", entry->fd);
+  while (1) {
+    entry->path = (char *) realloc(entry->path, size);
+    length = readlink(link, entry->path, size);
+    if (length < 0) {
+      strcpy(entry->path, "?");
+      break;
+    }
+    if ((size_t) length < size) {
+      entry->path[length] = '\0';
+      break;
+    }
+    size *= 2;
+  }
+  return entry->path;
+}
+
+/********************************************************************************
+* Description: InitDirectory()
+*   This function opens the directory the shell was started in.
+********************************************************************************/
+void InitDirectory(void) {
+  workingDirs.current.fd = OpenDirectory(".");
+  workingDirs.isPathValid = false;
+}
+
+/********************************************************************************
+* Description: CurrentDir()
+*   This function returns the absolute path of the working directory, calling
+*   getcwd() only if the directory changed since the last call. It returns
+*   NULL with errno set if the directory no longer has a path.
+********************************************************************************/
+const char *CurrentDir(void) {
+  if (workingDirs.isPathValid) {
+    return workingDirs.current.path;
+  }
+  if (workingDirs.pathSize == 0) {
+    workingDirs.pathSize = DIR_PATH_SIZE;
+    workingDirs.current.path = (char *) malloc(workingDirs.pathSize);
+  }
+  while (getcwd(workingDirs.current.path, workingDirs.pathSize) == NULL) {
+    if (errno != ERANGE) {
+      return NULL;
+    }
+    workingDirs.pathSize *= 2;
+    workingDirs.current.path = (char *) realloc(workingDirs.current.path,
+                                                workingDirs.pathSize);
+  }
+  workingDirs.isPathValid = true;
+  return workingDirs.current.path;
+}
+
+/********************************************************************************
+* Description: SetDirectory()
+*   This function makes path the working directory. It returns 0, or -1 with
+*   errno set and the working directory unchanged.
+********************************************************************************/
+int SetDirectory(const char *path) {
+  int fd = OpenDirectory(path);
+
+  if (fd < 0) {
+    return -1;
+  }
+  if (fchdir(fd) < 0) {
+    close(fd);
+    return -1;
+  }
+  if (workingDirs.current.fd >= 0) {
+    close(workingDirs.current.fd);
+  }
+  workingDirs.current.fd = fd;
+  workingDirs.isPathValid = false; /* Canonicalized by getcwd() if anything asks */
+  return 0;
+}
+
+/********************************************************************************
+* Description: PushDirectory()
+*   This function saves the working directory on the stack and changes to path.
+*   With no path it swaps the working directory with the top of the stack. It
+*   returns 0, or -1 with errno set (EINVAL if there is nothing to swap with).
+********************************************************************************/
+int PushDirectory(const char *path) {
+  struct dirEntry *top;
+  struct dirEntry saved;
+
+  if (path == NULL) {
+    if (workingDirs.count == 0) {
+      errno = EINVAL;
+      return -1;
+    }
+    top = &workingDirs.entries[workingDirs.count - 1];
+    if (fchdir(top->fd) < 0) {
+      return -1;
+    }
+    saved.fd = workingDirs.current.fd;
+    saved.path = top->path;
+    workingDirs.current.fd = top->fd;
+    workingDirs.isPathValid = false;
+    *top = saved;
+    return 0;
+  }
+
+  if (workingDirs.count == workingDirs.capacity) {
+    workingDirs.capacity = workingDirs.capacity == 0 ? DIR_STACK_SIZE : workingDirs.capacity * 2;
+    workingDirs.entries = (struct dirEntry *) realloc(workingDirs.entries,
+                                   workingDirs.capacity * sizeof(struct dirEntry));
+  }
+  saved.fd = workingDirs.current.fd;
+  saved.path = NULL;
+  workingDirs.current.fd = -1; /* Keep the old descriptor open for the stack */
+  if (SetDirectory(path) < 0) {
+    workingDirs.current.fd = saved.fd;
+    return -1;
+  }
+  workingDirs.entries[workingDirs.count++] = saved;
+  return 0;
+}
+
+/********************************************************************************
+* Description: PopDirectory()
+*   This function changes back to the directory on top of the stack and removes
+*   it. It returns 0, or -1 with errno set (EINVAL if the stack is empty).
+********************************************************************************/
+int PopDirectory(void) {
+  struct dirEntry *top;
+
+  if (workingDirs.count == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  top = &workingDirs.entries[workingDirs.count - 1];
+  if (fchdir(top->fd) < 0) {
+    return -1;
+  }
+  if (workingDirs.current.fd >= 0) {
+    close(workingDirs.current.fd);
+  }
+  workingDirs.current.fd = top->fd;
+  workingDirs.isPathValid = false;
+  free(top->path);
+  workingDirs.count--;
+  return 0;
+}
+
+/********************************************************************************
+* Description: ClearDirectories()
+*   This function empties the stack, leaving the working directory alone.
+********************************************************************************/
+void ClearDirectories(void) {
+  while (workingDirs.count > 0) {
+    workingDirs.count--;
+    close(workingDirs.entries[workingDirs.count].fd);
+    free(workingDirs.entries[workingDirs.count].path);
+  }
+}
+
+/********************************************************************************
+* Description: PrintDirectories()
+*   This function prints the working directory and then the stack from the top
+*   down, on one line or one numbered line each.
+********************************************************************************/
+void PrintDirectories(FILE *output, bool isNumbered) {
+  const char *path = CurrentDir();
+  size_t i;
+
+  if (isNumbered) {
+    fprintf(output, " 0  %s\n", path != NULL ? path : "?");
+  } else {
+    fputs(path != NULL ? path : "?", output);
+  }
+  for (i = 0; i < workingDirs.count; i++) {
+    path = EntryPath(&workingDirs.entries[workingDirs.count - 1 - i]);
+    if (isNumbered) {
+      fprintf(output, "%2zu  %s\n", i + 1, path);
+    } else {
+      fprintf(output, " %s", path);
+    }
+  }
+  if (!isNumbered) {
+    fputc('\n', output);
+  }
+}
@@ -0,0 +1,37 @@
+/********************************************************************************
+* Program Name: Directory.h
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: Header file for Directory.c. The shell's working directory, held
+*   as an O_PATH descriptor, and the pushd/popd directory stack.
+********************************************************************************/
+#ifndef DIRECTORY_H
+#define DIRECTORY_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+struct dirEntry {
+  int fd;                 /* O_PATH descriptor of the directory */
+  char *path;             /* Buffer for its absolute path, NULL until it is printed */
+};
+
+struct directoryStack {
+  struct dirEntry current; /* The working directory the shell and its children use */
+  size_t pathSize;        /* Bytes allocated for current.path */
+  bool isPathValid;       /* current.path names the working directory */
+  struct dirEntry *entries; /* Saved directories, the top of the stack is last */
+  size_t count;
+  size_t capacity;
+};
+
+extern struct directoryStack workingDirs;
+
+void InitDirectory(void);
+const char *CurrentDir(void);
+int SetDirectory(const char *path);
+int PushDirectory(const char *path);
+int PopDirectory(void);
+void ClearDirectories(void);
+void PrintDirectories(FILE *output, bool isNumbered);
+#endif
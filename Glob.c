@@ -0,0 +1,545 @@
+/********************************************************************************
+* Program Name: Glob.c
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: This is the set of functions that expand a pattern word such as
+*   *.log, data/?/[a-c]* or one with a recursive ** component into the sorted
+*   list of paths it matches. A pattern is matched one '/' component at a
+*   time, and only components with *, ? or [...] read a directory.
+*   Directories are read with getdents64 into listings that are cached by
+*   inode and kept until the directory's mtime changes, so a script that globs
+*   the same directories over and over reads each of them once. A backslash
+*   in a pattern makes the next character literal; CommandLine.c uses that for
+*   quoted characters.
+********************************************************************************/
+#include "CommandLine.h"
+#include "Glob.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#define GLOB_READ_SIZE (64 * 1024)        /* Bytes asked of each getdents64 call */
+#define GLOB_NAMES_SIZE 4096              /* Starting size of a listing's names */
+#define GLOB_ENTRIES 64                   /* Starting entries in a listing */
+#define GLOB_CACHE_LIMIT (64 * 1024 * 1024) /* Cache size that empties it */
+#define GLOB_RACY_NS 20000000L            /* An mtime this close to the read may */
+                                          /* hide a later change in the same tick */
+#define IsGlobChar(c) ((c) == '*' || (c) == '?' || (c) == '[')
+
+struct dirCache dirCache;
+
+struct globState {
+  struct arena *arena;    /* Holds the matches */
+  char **matches;
+  int count;
+  int capacity;
+  char path[PATH_MAX];    /* The path matched so far, ending in '/' unless empty */
+};
+
+/********************************************************************************
+* Description: ElapsedNs()
+*   This function returns the nanoseconds from one time to a later one.
+********************************************************************************/
+static long long ElapsedNs(const struct timespec *from, const struct timespec *to) {
+  return (to->tv_sec - from->tv_sec) * 1000000000LL + (to->tv_nsec - from->tv_nsec);
+}
+
+/********************************************************************************
+* Description: FreeListing()
+*   This function frees a listing and takes its memory off the cache total.
+********************************************************************************/
+static void FreeListing(struct dirListing *listing) {
+  dirCache.bytes -= listing->bytes;
+  free(listing->names);
+  free(listing->entries);
+  free(listing);
+}
+
+/********************************************************************************
+* Description: ClearDirCache()
+*   This function forgets every listing.
+********************************************************************************/
+void ClearDirCache(void) {
+  struct dirListing *listing;
+  struct dirListing *next;
+  int i;
+
+  for (i = 0; i < DIR_CACHE_BUCKETS; i++) {
+    for (listing = dirCache.buckets[i]; listing != NULL; listing = next) {
+      next = listing->next;
+      FreeListing(listing);
+    }
+    dirCache.buckets[i] = NULL;
+  }
+}
+
+/********************************************************************************
+* Description: AddName()
+*   This function appends one directory entry to a listing, doubling its
+*   arrays as they fill.
+********************************************************************************/
+static void AddName(struct dirListing *listing, size_t *namesSize, size_t *capacity,
+                    size_t *used, const char *name, unsigned char type) {
+  size_t length = strlen(name) + 1;
+
+  while (*used + length > *namesSize) {
+    *namesSize *= 2;
+    listing->names = (char *) realloc(listing->names, *namesSize);
+  }
+  if (listing->count == *capacity) {
+    *capacity *= 2;
+    listing->entries = (struct listingEntry *) realloc(listing->entries,
+                                     *capacity * sizeof(struct listingEntry));
+  }
+  memcpy(listing->names + *used, name, length);
+  listing->entries[listing->count].offset = *used;
+  listing->entries[listing->count].type = type;
+  listing->entries[listing->count].length = length - 1;
+  listing->count++;
+  *used += length;
+}
+
+/********************************************************************************
+* Description: CompareEntries()
+*   This function orders listing entries by name for qsort_r().
+********************************************************************************/
+static int CompareEntries(const void *first, const void *second, void *names) {
+  return strcmp((char *) names + ((const struct listingEntry *) first)->offset,
+                (char *) names + ((const struct listingEntry *) second)->offset);
+}
+
+/********************************************************************************
+* Description: ReadListing()
+*   This function returns the listing of a directory ("" is the working
+*   directory), or NULL if it cannot be read. A cached listing is used when the
+*   directory has the same inode and mtime as when it was read, unless that
+*   mtime was so close to the read that a change in the same clock tick would
+*   not have moved it. Otherwise the directory is read again with getdents64.
+*   Within one glob a listing is always reused, so none is freed while in use.
+*   A listing is sorted by name the first time it is reused, so a directory
+*   globbed once pays nothing for it and one globbed again gets its matches in
+*   order.
+********************************************************************************/
+static struct dirListing *ReadListing(const char *path) {
+  static char buffer[GLOB_READ_SIZE];
+  struct dirListing **link;
+  struct dirListing *listing;
+  struct dirent64 *entry;
+  struct stat info;
+  size_t namesSize = GLOB_NAMES_SIZE;
+  size_t capacity = GLOB_ENTRIES;
+  size_t used = 0;
+  ssize_t length;
+  ssize_t offset;
+  int fd;
+
+  fd = open(path[0] != '\0' ? path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (fstat(fd, &info) < 0) {
+    close(fd);
+    return NULL;
+  }
+
+  link = &dirCache.buckets[(info.st_ino ^ info.st_dev) & (DIR_CACHE_BUCKETS - 1)];
+  for (; *link != NULL; link = &(*link)->next) {
+    listing = *link;
+    if (listing->inode != info.st_ino || listing->device != info.st_dev) {
+      continue;
+    }
+    if (listing->generation == dirCache.generation ||
+        (ElapsedNs(&listing->modified, &info.st_mtim) == 0 &&
+         ElapsedNs(&listing->modified, &listing->readAt) >= GLOB_RACY_NS)) {
+      listing->generation = dirCache.generation;
+      dirCache.hits++;
+      close(fd);
+      if (!listing->isSorted) {
+        qsort_r(listing->entries, listing->count, sizeof(struct listingEntry),
+                CompareEntries, listing->names);
+        listing->isSorted = true;
+      }
+      return listing;
+    }
+    *link = listing->next; /* Out of date */
+    FreeListing(listing);
+    break;
+  }
+
+  dirCache.misses++;
+  listing = (struct dirListing *) calloc(1, sizeof(struct dirListing));
+  listing->device = info.st_dev;
+  listing->inode = info.st_ino;
+  listing->modified = info.st_mtim;
+  listing->generation = dirCache.generation;
+  clock_gettime(CLOCK_REALTIME, &listing->readAt);
+  listing->names = (char *) malloc(namesSize);
+  listing->entries = (struct listingEntry *) malloc(capacity * sizeof(struct listingEntry));
+
+  while ((length = getdents64(fd, buffer, sizeof(buffer))) > 0) {
+    for (offset = 0; offset < length; offset += entry->d_reclen) {
+      entry = (struct dirent64 *) (buffer + offset);
+      if (entry->d_name[0] == '.' && (entry->d_name[1] == '\0' ||
+          (entry->d_name[1] == '.' && entry->d_name[2] == '\0'))) {
+        continue;
+      }
+      AddName(listing, &namesSize, &capacity, &used, entry->d_name, entry->d_type);
+    }
+  }
+  close(fd);
+
+  listing->bytes = namesSize + capacity * sizeof(struct listingEntry) + sizeof(struct dirListing);
+  dirCache.bytes += listing->bytes;
+  listing->next = dirCache.buckets[(info.st_ino ^ info.st_dev) & (DIR_CACHE_BUCKETS - 1)];
+  dirCache.buckets[(info.st_ino ^ info.st_dev) & (DIR_CACHE_BUCKETS - 1)] = listing;
+  return listing;
+}
+
+/********************************************************************************
+* Description: MatchClass()
+*   This function matches one character against the bracket expression at
+*   pattern, such as [abc], [a-z] or [!0-9]. It returns 1 if it matches, 0 if
+*   not, or -1 if there is no closing ']' and the '[' is an ordinary character.
+*   *next is set past the expression.
+********************************************************************************/
+static int MatchClass(const char *pattern, const char *end, char c, const char **next) {
+  const char *scan = pattern + 1;
+  bool isNegated = false;
+  bool isMatch = false;
+  char low;
+  char high;
+
+  if (scan < end && (*scan == '!' || *scan == '^')) {
+    isNegated = true;
+    scan++;
+  }
+  do {  /* A ']' right after the '[' is part of the set */
+    if (scan >= end) {
+      return -1;
+    }
+    low = *scan;
+    if (low == '\\' && scan + 1 < end) {
+      low = *++scan;
+    }
+    high = low;
+    if (scan + 2 < end && scan[1] == '-' && scan[2] != ']') {
+      scan += 2;
+      high = *scan;
+      if (high == '\\' && scan + 1 < end) {
+        high = *++scan;
+      }
+    }
+    if ((unsigned char) c >= (unsigned char) low && (unsigned char) c <= (unsigned char) high) {
+      isMatch = true;
+    }
+    scan++;
+  } while (scan >= end || *scan != ']');
+  *next = scan + 1;
+  return isMatch != isNegated;
+}
+
+/********************************************************************************
+* Description: MatchName()
+*   This function returns whether a file name matches one component of a
+*   pattern. A '*' remembers where it was, so a failed match only backs up to
+*   the last one instead of trying every split.
+********************************************************************************/
+static bool MatchName(const char *pattern, const char *end, const char *name) {
+  const char *starPattern = NULL;
+  const char *starName = NULL;
+  const char *next;
+  int result;
+
+  while (*name != '\0') {
+    if (pattern < end) {
+      if (*pattern == '*') {
+        starPattern = ++pattern;
+        starName = name;
+        continue;
+      } else if (*pattern == '?') {
+        pattern++;
+        name++;
+        continue;
+      } else if (*pattern == '[' && (result = MatchClass(pattern, end, *name, &next)) >= 0) {
+        if (result == 1) {
+          pattern = next;
+          name++;
+          continue;
+        }
+      } else {
+        if (*pattern == '\\' && pattern + 1 < end) {
+          pattern++;
+        }
+        if (*pattern == *name) {
+          pattern++;
+          name++;
+          continue;
+        }
+      }
+    }
+    if (starPattern == NULL) { /* No '*' to give another character to */
+      return false;
+    }
+    pattern = starPattern;
+    name = ++starName;
+  }
+  while (pattern < end && *pattern == '*') {
+    pattern++;
+  }
+  return pattern == end;
+}
+
+/********************************************************************************
+* Description: HasGlobChars()
+*   This function returns whether a pattern component has a *, ? or [ that is
+*   not escaped, so that it has to be matched against a directory listing.
+********************************************************************************/
+static bool HasGlobChars(const char *pattern, const char *end) {
+  for (; pattern < end; pattern++) {
+    if (*pattern == '\\') {
+      pattern++;
+    } else if (IsGlobChar(*pattern)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/********************************************************************************
+* Description: AddMatch()
+*   This function copies the path matched so far into the arena as a result.
+********************************************************************************/
+static void AddMatch(struct globState *state, size_t length) {
+  char **grown;
+
+  if (state->count == state->capacity) {
+    state->capacity = state->capacity == 0 ? 16 : state->capacity * 2;
+    grown = (char **) ArenaAlloc(state->arena, state->capacity * sizeof(char *));
+    memcpy(grown, state->matches, state->count * sizeof(char *));
+    state->matches = grown;
+  }
+  state->matches[state->count++] = ArenaStrndup(state->arena, state->path, length);
+}
+
+/********************************************************************************
+* Description: IsDirectory()
+*   This function returns whether the entry at path is a directory, trusting
+*   d_type when getdents64 gave one. Symbolic links are followed unless
+*   noFollow is set, which keeps ** from walking out of the tree or in circles.
+********************************************************************************/
+static bool IsDirectory(const char *path, unsigned char type, bool noFollow) {
+  struct stat info;
+
+  if (type == DT_DIR) {
+    return true;
+  }
+  if (type != DT_UNKNOWN && (type != DT_LNK || noFollow)) {
+    return false;
+  }
+  if ((noFollow ? lstat(path, &info) : stat(path, &info)) < 0) {
+    return false;
+  }
+  return S_ISDIR(info.st_mode);
+}
+
+/********************************************************************************
+* Description: AppendPath()
+*   This function appends text to the path matched so far, unescaping it if it
+*   is a literal pattern component. Returns the new length, or 0 if the path
+*   would be too long.
+********************************************************************************/
+static size_t AppendPath(struct globState *state, size_t length, const char *text,
+                         const char *end, bool isPattern) {
+  for (; text < end; text++) {
+    if (isPattern && *text == '\\' && text + 1 < end) {
+      text++;
+    }
+    if (length + 2 >= sizeof(state->path)) {
+      return 0;
+    }
+    state->path[length++] = *text;
+  }
+  state->path[length] = '\0';
+  return length;
+}
+
+/********************************************************************************
+* Description: ExpandComponents()
+*   This function matches the rest of a pattern against the file system below
+*   the path matched so far, which is length bytes long. One component is taken
+*   at a time. A literal component is appended without reading anything, a
+*   component with wildcards is matched against the directory's listing, and a
+*   component that is just ** matches any number of directories, not hidden
+*   ones and not through symbolic links. A component followed by '/' only
+*   matches directories.
+********************************************************************************/
+static void ExpandComponents(struct globState *state, size_t length, const char *pattern) {
+  struct dirListing *listing;
+  const char *end = strchr(pattern, '/');
+  const char *rest;
+  const char *name;
+  struct stat info;
+  size_t nameLength;
+  size_t i;
+  char last;
+  bool hasSlash = end != NULL;
+
+  if (end == NULL) {
+    end = pattern + strlen(pattern);
+  }
+  for (rest = end; *rest == '/'; rest++) {
+  }
+
+  /* A literal component only has to exist */
+  if (!HasGlobChars(pattern, end)) {
+    nameLength = AppendPath(state, length, pattern, end, true);
+    if (nameLength == 0) {
+      return;
+    }
+    if (*rest != '\0') {
+      state->path[nameLength++] = '/';
+      ExpandComponents(state, nameLength, rest);
+    } else if (stat(state->path, &info) == 0 || lstat(state->path, &info) == 0) {
+      if (!hasSlash) {
+        AddMatch(state, nameLength);
+      } else if (S_ISDIR(info.st_mode)) {
+        state->path[nameLength++] = '/';
+        AddMatch(state, nameLength);
+      }
+    }
+    return;
+  }
+
+  state->path[length] = '\0';
+  listing = ReadListing(state->path);
+  if (listing == NULL) {
+    return;
+  }
+
+  /* ** matches here, and again in every directory below */
+  if (end - pattern == 2 && pattern[0] == '*' && pattern[1] == '*') {
+    if (*rest != '\0') {
+      ExpandComponents(state, length, rest);
+    }
+    for (i = 0; i < listing->count; i++) {
+      name = listing->names + listing->entries[i].offset;
+      if (name[0] == '.') {
+        continue;
+      }
+      nameLength = AppendPath(state, length, name, name + listing->entries[i].length, false);
+      if (nameLength == 0) {
+        continue;
+      }
+      if (*rest == '\0' && !hasSlash) {
+        AddMatch(state, nameLength);
+      }
+      if (IsDirectory(state->path, listing->entries[i].type, true)) {
+        state->path[nameLength++] = '/';
+        if (*rest == '\0' && hasSlash) {
+          AddMatch(state, nameLength);
+        }
+        ExpandComponents(state, nameLength, pattern);
+      }
+    }
+    return;
+  }
+
+  /* A component that ends in a literal character, like *.log, rules out */
+  /* most names on their last character before matching them */
+  last = end[-1];
+  if (last == '*' || last == '?' || last == ']' || (end - pattern > 1 && end[-2] == '\\')) {
+    last = '\0';
+  }
+  for (i = 0; i < listing->count; i++) {
+    name = listing->names + listing->entries[i].offset;
+    if (last != '\0' && name[listing->entries[i].length - 1] != last) {
+      continue;
+    }
+    /* A leading '.' is only matched by a '.' */
+    if (name[0] == '.' && pattern[0] != '.' && !(pattern[0] == '\\' && pattern[1] == '.')) {
+      continue;
+    }
+    if (!MatchName(pattern, end, name)) {
+      continue;
+    }
+    nameLength = AppendPath(state, length, name, name + listing->entries[i].length, false);
+    if (nameLength == 0) {
+      continue;
+    }
+    if (!hasSlash) {
+      AddMatch(state, nameLength);
+    } else if (IsDirectory(state->path, listing->entries[i].type, false)) {
+      state->path[nameLength++] = '/';
+      if (*rest == '\0') {
+        AddMatch(state, nameLength);
+      } else {
+        ExpandComponents(state, nameLength, rest);
+      }
+    }
+  }
+}
+
+/********************************************************************************
+* Description: ComparePaths()
+*   This function orders matches by their bytes for qsort().
+********************************************************************************/
+static int ComparePaths(const void *first, const void *second) {
+  return strcmp(*(char * const *) first, *(char * const *) second);
+}
+
+/********************************************************************************
+* Description: GlobWord()
+*   This function expands a pattern into the sorted paths it matches, stored in
+*   the arena, and returns how many there are. Returns 0 if nothing matches, in
+*   which case the caller keeps the word as it is.
+********************************************************************************/
+int GlobWord(const char *pattern, struct arena *arena, char ***matches) {
+  static struct globState state;
+  size_t length = 0;
+  int i;
+
+  /* Only drop the cache between globs, never under a listing in use */
+  if (dirCache.bytes > GLOB_CACHE_LIMIT) {
+    ClearDirCache();
+  }
+  dirCache.generation++;
+  state.arena = arena;
+  state.matches = NULL;
+  state.count = 0;
+  state.capacity = 0;
+  if (pattern[0] == '/') {
+    state.path[length++] = '/';
+    while (*pattern == '/') {
+      pattern++;
+    }
+  }
+  ExpandComponents(&state, length, pattern);
+
+  /* Matches from sorted listings usually come out in order already */
+  for (i = 1; i < state.count; i++) {
+    if (strcmp(state.matches[i - 1], state.matches[i]) > 0) {
+      qsort(state.matches, state.count, sizeof(char *), ComparePaths);
+      break;
+    }
+  }
+  *matches = state.matches;
+  return state.count;
+}
+
+/********************************************************************************
+* Description: UnescapePattern()
+*   This function turns a pattern that matched nothing back into the word it
+*   came from by removing its backslashes, in place.
+********************************************************************************/
+void UnescapePattern(char *pattern) {
+  char *write = pattern;
+
+  for (; *pattern != '\0'; pattern++) {
+    if (*pattern == '\\' && pattern[1] != '\0') {
+      pattern++;
+    }
+    *write++ = *pattern;
+  }
+  *write = '\0';
+}
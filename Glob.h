@@ -0,0 +1,51 @@
+/********************************************************************************
+* Program Name: Glob.h
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: Header file for Glob.c. Pathname expansion of *, ?, [...] and **
+*   over a cache of directory listings read with getdents64.
+********************************************************************************/
+#ifndef GLOB_H
+#define GLOB_H
+
+#include "Arena.h"
+#include <stdbool.h>
+#include <sys/types.h>
+#include <time.h>
+
+#define DIR_CACHE_BUCKETS 256 /* Listings are chained by inode within a bucket */
+
+struct listingEntry {
+  size_t offset;          /* Where the name starts in the listing's names */
+  unsigned char type;     /* d_type from getdents64 */
+  unsigned char length;   /* Length of the name, which NAME_MAX keeps under 256 */
+};
+
+struct dirListing {
+  dev_t device;           /* The directory's identity */
+  ino_t inode;
+  struct timespec modified; /* Its mtime when read, a change means re-read it */
+  struct timespec readAt;   /* When it was read, to spot a racily new mtime */
+  char *names;            /* Every name, NUL terminated, one after another */
+  struct listingEntry *entries;
+  size_t count;
+  bool isSorted;          /* entries are in name order, done once it is reused */
+  size_t bytes;           /* Memory held by the listing */
+  unsigned long generation; /* The glob that read or last checked it */
+  struct dirListing *next; /* Next listing in the same bucket */
+};
+
+struct dirCache {
+  struct dirListing *buckets[DIR_CACHE_BUCKETS];
+  size_t bytes;           /* Memory held by every listing */
+  unsigned long generation; /* Counts globs, so one glob never frees a listing */
+  unsigned long hits;     /* Listings used without reading the directory */
+  unsigned long misses;   /* Listings read with getdents64 */
+};
+
+extern struct dirCache dirCache;
+
+int GlobWord(const char *pattern, struct arena *arena, char ***matches);
+void UnescapePattern(char *pattern);
+void ClearDirCache(void);
+#endif
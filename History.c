@@ -0,0 +1,373 @@
+/********************************************************************************
+* Program Name: History.c
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: This is the command history for interactive smallsh sessions.
+*   Every line is appended to the history file with one write on an O_APPEND
+*   descriptor, so shells sharing the file never interleave their lines. At
+*   startup the file is only mapped, so a long history costs nothing until it
+*   is used. The first lookup by number finds where each line starts, and the
+*   first search builds a trigram index over the mapped lines. Lines from the
+*   current session are kept in memory after them.
+*
+*   Entries are numbered from 1, oldest first. The index takes roughly four
+*   bytes per byte of history, and only exists once something is searched.
+********************************************************************************/
+#include "History.h"
+#include <ctype.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#define TRIGRAM_BITS 16
+#define TRIGRAM_BUCKETS (1 << TRIGRAM_BITS)
+
+struct history {
+  int fd;              /* History file opened with O_APPEND, -1 when history is off */
+  char *map;           /* The file as it was at startup */
+  size_t mapLength;
+  size_t *starts;      /* Offset of each mapped line, then one past the last; */
+  int mapCount;        /* NULL until the first lookup */
+  int *bucketStarts;   /* Trigram index: the lines holding a trigram of bucket b */
+  int *postings;       /* are postings[bucketStarts[b]] up to bucketStarts[b + 1], */
+                       /* oldest first. NULL until the first search */
+  char **added;        /* Lines from this session */
+  int addedCount;
+  int addedCapacity;
+};
+
+static struct history history = {-1, NULL, 0, NULL, 0, NULL, NULL, NULL, 0, 0};
+
+/********************************************************************************
+* Description: InitHistory()
+*   This function opens the history file, creating it if needed, and maps what
+*   it holds. Nothing is read yet. Returns false if the file cannot be opened,
+*   which leaves history off.
+********************************************************************************/
+bool InitHistory(const char *path) {
+  struct stat info;
+
+  history.fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+  if (history.fd < 0) {
+    return false;
+  }
+  if (fstat(history.fd, &info) == 0 && info.st_size > 0) {
+    history.map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, history.fd, 0);
+    if (history.map == MAP_FAILED) {
+      history.map = NULL;
+    } else {
+      history.mapLength = info.st_size;
+    }
+  }
+  return true;
+}
+
+/********************************************************************************
+* Description: IndexLines()
+*   This function finds where every mapped line starts, the first time a line
+*   is looked up.
+********************************************************************************/
+static void IndexLines(void) {
+  size_t capacity = 1024;
+  char *cursor = history.map;
+  char *end = history.map + history.mapLength;
+  char *newline;
+
+  if (history.starts != NULL) {
+    return;
+  }
+  history.starts = (size_t *) malloc(capacity * sizeof(size_t));
+  while (cursor < end) {
+    if ((size_t) history.mapCount + 1 >= capacity) {
+      capacity *= 2;
+      history.starts = (size_t *) realloc(history.starts, capacity * sizeof(size_t));
+    }
+    history.starts[history.mapCount++] = cursor - history.map;
+    newline = memchr(cursor, '\n', end - cursor);
+    cursor = newline != NULL ? newline + 1 : end + 1; /* A last line may lack its newline */
+  }
+  history.starts[history.mapCount] = cursor - history.map;
+}
+
+/********************************************************************************
+* Description: HistoryCount()
+*   This function returns the number of entries, which is also the number of
+*   the newest one.
+********************************************************************************/
+int HistoryCount(void) {
+  IndexLines();
+  return history.mapCount + history.addedCount;
+}
+
+/********************************************************************************
+* Description: HistoryEntry()
+*   This function returns entry number (from 1) and sets its length, or returns
+*   NULL if there is no such entry. The text is not NUL terminated.
+********************************************************************************/
+const char *HistoryEntry(int number, size_t *length) {
+  const char *entry;
+
+  IndexLines();
+  if (number < 1 || number > history.mapCount + history.addedCount) {
+    return NULL;
+  } else if (number <= history.mapCount) {
+    *length = history.starts[number] - history.starts[number - 1] - 1;
+    return history.map + history.starts[number - 1];
+  }
+  entry = history.added[number - history.mapCount - 1];
+  *length = strlen(entry);
+  return entry;
+}
+
+/********************************************************************************
+* Description: AddHistory()
+*   This function records a line, without its newline, both in memory and at
+*   the end of the history file. The file gets the line and its newline in one
+*   writev call, which O_APPEND makes atomic against other shells. Blank lines
+*   are not recorded.
+********************************************************************************/
+void AddHistory(const char *line) {
+  struct iovec parts[2];
+  size_t length = strcspn(line, "\n");
+
+  if (history.fd < 0 || line[strspn(line, " \t\n")] == '\0') {
+    return;
+  }
+
+  if (history.addedCount == history.addedCapacity) {
+    history.addedCapacity = history.addedCapacity == 0 ? 64 : history.addedCapacity * 2;
+    history.added = (char **) realloc(history.added, history.addedCapacity * sizeof(char *));
+  }
+  history.added[history.addedCount++] = strndup(line, length);
+
+  parts[0].iov_base = (void *) line;
+  parts[0].iov_len = length;
+  parts[1].iov_base = "\n";
+  parts[1].iov_len = 1;
+  writev(history.fd, parts, 2);
+}
+
+/********************************************************************************
+* Description: TrigramBucket()
+*   This function returns the index bucket for three bytes.
+********************************************************************************/
+static unsigned int TrigramBucket(unsigned char a, unsigned char b, unsigned char c) {
+  return (((unsigned int) a << 16 | (unsigned int) b << 8 | c) * 2654435761u) >>
+         (32 - TRIGRAM_BITS);
+}
+
+/********************************************************************************
+* Description: SequenceByte()
+*   This function returns byte i of a line as it is indexed: with a newline in
+*   front, so that the first trigrams also find prefixes.
+********************************************************************************/
+static unsigned char SequenceByte(const char *text, size_t i) {
+  return i == 0 ? '\n' : (unsigned char) text[i - 1];
+}
+
+/********************************************************************************
+* Description: QueryByte()
+*   This function returns byte i of a search as it is looked up in the index.
+*   A prefix search has the same newline in front as the indexed lines.
+********************************************************************************/
+static unsigned char QueryByte(const char *text, size_t i, bool isPrefix) {
+  return isPrefix ? SequenceByte(text, i) : (unsigned char) text[i];
+}
+
+/********************************************************************************
+* Description: BuildTrigrams()
+*   This function builds the trigram index over the mapped lines the first
+*   time they are searched. Two passes over the lines count and then fill each
+*   bucket's list, and a line is listed once per bucket.
+********************************************************************************/
+static void BuildTrigrams(void) {
+  int *lastLine;
+  int *fill;
+  const char *text;
+  size_t length;
+  size_t i;
+  unsigned int bucket;
+  int pass;
+  int line;
+
+  if (history.bucketStarts != NULL) {
+    return;
+  }
+  IndexLines();
+  history.bucketStarts = (int *) calloc(TRIGRAM_BUCKETS + 1, sizeof(int));
+  lastLine = (int *) malloc(TRIGRAM_BUCKETS * sizeof(int));
+  fill = history.bucketStarts + 1; /* Counted into during the first pass */
+
+  for (pass = 0; pass < 2; pass++) {
+    memset(lastLine, 0xFF, TRIGRAM_BUCKETS * sizeof(int)); /* -1 */
+    for (line = 0; line < history.mapCount; line++) {
+      text = HistoryEntry(line + 1, &length);
+      for (i = 0; i + 2 <= length; i++) {
+        bucket = TrigramBucket(SequenceByte(text, i), SequenceByte(text, i + 1),
+                               SequenceByte(text, i + 2));
+        if (lastLine[bucket] != line) {
+          lastLine[bucket] = line;
+          if (pass == 0) {
+            fill[bucket]++;
+          } else {
+            history.postings[fill[bucket]++] = line;
+          }
+        }
+      }
+    }
+    if (pass == 0) { /* Turn the counts into starting positions */
+      for (i = 1; i <= TRIGRAM_BUCKETS; i++) {
+        history.bucketStarts[i] += history.bucketStarts[i - 1];
+      }
+      history.postings = (int *) malloc((history.bucketStarts[TRIGRAM_BUCKETS] + 1) * sizeof(int));
+      fill = (int *) malloc(TRIGRAM_BUCKETS * sizeof(int));
+      memcpy(fill, history.bucketStarts, TRIGRAM_BUCKETS * sizeof(int));
+    }
+  }
+  free(fill);
+  free(lastLine);
+}
+
+/********************************************************************************
+* Description: EntryMatches()
+*   This function returns whether entry number starts with, or contains, text.
+********************************************************************************/
+static bool EntryMatches(int number, const char *text, size_t length, bool isPrefix) {
+  size_t entryLength;
+  const char *entry = HistoryEntry(number, &entryLength);
+
+  if (isPrefix) {
+    return entryLength >= length && memcmp(entry, text, length) == 0;
+  }
+  return memmem(entry, entryLength, text, length) != NULL;
+}
+
+/********************************************************************************
+* Description: SearchHistory()
+*   This function returns the number of the newest entry before entry before
+*   (0 for the newest overall) that starts with text, or contains it if
+*   isPrefix is false. Returns 0 if none does. The session's own lines are
+*   few and are scanned. For the mapped lines the query's rarest trigram gives
+*   the candidates, newest first, and each is checked in full. A query too
+*   short to have a trigram is a scan.
+********************************************************************************/
+int SearchHistory(const char *text, size_t length, bool isPrefix, int before) {
+  size_t queryLength = isPrefix ? length + 1 : length;
+  unsigned int bucket;
+  int best = -1;
+  int bestCount = 0;
+  int low;
+  int high;
+  int middle;
+  int number;
+  size_t i;
+
+  if (before < 1 || before > HistoryCount()) {
+    before = HistoryCount() + 1;
+  }
+  for (number = before - 1; number > history.mapCount; number--) {
+    if (EntryMatches(number, text, length, isPrefix)) {
+      return number;
+    }
+  }
+  before = before > history.mapCount ? history.mapCount + 1 : before;
+
+  if (queryLength < 3) {
+    for (number = before - 1; number >= 1; number--) {
+      if (EntryMatches(number, text, length, isPrefix)) {
+        return number;
+      }
+    }
+    return 0;
+  }
+
+  BuildTrigrams();
+  for (i = 0; i + 2 < queryLength; i++) {
+    bucket = TrigramBucket(QueryByte(text, i, isPrefix), QueryByte(text, i + 1, isPrefix),
+                           QueryByte(text, i + 2, isPrefix));
+    if (best < 0 ||
+        history.bucketStarts[bucket + 1] - history.bucketStarts[bucket] < bestCount) {
+      best = bucket;
+      bestCount = history.bucketStarts[bucket + 1] - history.bucketStarts[bucket];
+    }
+  }
+
+  /* Find the first candidate at or after before, then walk back from it */
+  low = history.bucketStarts[best];
+  high = history.bucketStarts[best + 1];
+  while (low < high) {
+    middle = low + (high - low) / 2;
+    if (history.postings[middle] + 1 < before) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  for (middle = low - 1; middle >= history.bucketStarts[best]; middle--) {
+    if (EntryMatches(history.postings[middle] + 1, text, length, isPrefix)) {
+      return history.postings[middle] + 1;
+    }
+  }
+  return 0;
+}
+
+/********************************************************************************
+* Description: ExpandHistory()
+*   This function replaces a history reference at the start of a line with the
+*   entry it names: "!!" the last entry, "!n" entry n, "!-n" the nth newest,
+*   "!?text?" the newest containing text and "!text" the newest starting with
+*   it. The rest of the line is kept. The expanded line is echoed. Returns 1 if
+*   the line was expanded, 0 if it had no reference, and -1 after printing an
+*   error if the entry was not found or the result does not fit.
+********************************************************************************/
+int ExpandHistory(char line[], size_t size) {
+  const char *entry = NULL;
+  char *start = line + strspn(line, " \t");
+  char *rest;
+  char *expanded;
+  size_t entryLength = 0;
+  size_t length;
+  long number;
+
+  if (start[0] != '!' || start[1] == '\0' || strchr(" \t\n=", start[1]) != NULL) {
+    return 0;
+  }
+
+  rest = start + 1;
+  if (*rest == '!') {
+    entry = HistoryEntry(HistoryCount(), &entryLength);
+    rest++;
+  } else if (*rest == '-' || isdigit((unsigned char) *rest)) {
+    number = strtol(rest, &rest, 10);
+    entry = HistoryEntry(number < 0 ? HistoryCount() + 1 + number : number, &entryLength);
+  } else if (*rest == '?') {
+    length = strcspn(rest + 1, "?\n");
+    entry = HistoryEntry(SearchHistory(rest + 1, length, false, 0), &entryLength);
+    rest += 1 + length + (rest[1 + length] == '?');
+  } else {
+    length = strcspn(rest, " \t\n|<>&");
+    entry = HistoryEntry(SearchHistory(rest, length, true, 0), &entryLength);
+    rest += length;
+  }
+
+  if (entry == NULL) {
+    fprintf(stderr, "%.*s: event not found\n", (int) (rest - start), start);
+    return -1;
+  }
+  length = (start - line) + entryLength + strlen(rest);
+  if (length >= size) {
+    fprintf(stderr, "%.*s: expanded line is too long\n", (int) (rest - start), start);
+    return -1;
+  }
+
+  expanded = (char *) malloc(length + 1);
+  sprintf(expanded, "%.*s%.*s%s", (int) (start - line), line, (int) entryLength, entry, rest);
+  strcpy(line, expanded);
+  free(expanded);
+  printf("%s", line);
+  if (line[length - 1] != '\n') {
+    printf("\n");
+  }
+  return 1;
+}
@@ -0,0 +1,19 @@
+/********************************************************************************
+* Program Name: History.h
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: Header file for History.c. The interactive command history,
+*   kept in a file that is shared by every smallsh.
+********************************************************************************/
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "CommandLine.h"
+
+bool InitHistory(const char *path);
+void AddHistory(const char *line);
+int HistoryCount(void);
+const char *HistoryEntry(int number, size_t *length);
+int SearchHistory(const char *text, size_t length, bool isPrefix, int before);
+int ExpandHistory(char line[], size_t size);
+#endif
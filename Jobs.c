@@ -0,0 +1,881 @@
+/********************************************************************************
+* Program Name: Jobs.c
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: This is the set of functions that keep track of the processes
+*   smallsh starts. A SIGCHLD handler reaps every finished child as soon as it
+*   exits and finds its job through a PID index in constant time, so zombies
+*   never pile up and there is no limit on the number of jobs. Finished
+*   background jobs are reported together before the next prompt. Children
+*   are reaped with wait4(), and the resources each used are added to its job.
+*
+*   Stopped and continued children are reported by wait4() as well, and a job
+*   whose every remaining process is stopped counts as stopped. A job gets a
+*   number and a name once it is in the background, which is how "jobs", "fg",
+*   "bg", "kill" and "wait" find it.
+*
+*   A job may have a deadline, kept in a timerfd. Every timerfd and a signalfd
+*   for SIGCHLD sit in one epoll set, the supervisor. A foreground wait sleeps in
+*   epoll_wait on it, and the prompt and script loops service it between
+*   commands, so a late job gets SIGTERM and, after a grace period, SIGKILL.
+*
+*   The job array and the PID index are only changed with SIGCHLD blocked. The
+*   handler itself only updates jobs that already exist, so it never sees a
+*   table in the middle of a change.
+********************************************************************************/
+#include "Jobs.h"
+#include "Trace.h"
+#include <errno.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+#define JOB_TABLE_START 16 /* Starting number of jobs, doubled as needed */
+#define CHILD_SIGNAL_EVENT 0xFFFFFFFFu /* epoll data for the signalfd, jobs use their index */
+#define DEFAULT_GRACE_MS 5000
+#define REPORT_SIZE 320 /* Room for one completion report with its usage */
+
+struct jobTable jobTable = {NULL, 0, NULL, 0, NULL, 0, NULL, 0, 0, -1, -1, 0, DEFAULT_GRACE_MS,
+                            false};
+
+/********************************************************************************
+* Description: PidHash()
+*   This function returns the first PID index entry to probe for a PID.
+********************************************************************************/
+static int PidHash(pid_t pid) {
+  return (int) (((unsigned int) pid * 2654435761u) & (jobTable.pidCapacity - 1));
+}
+
+/********************************************************************************
+* Description: FindPid()
+*   This function returns the PID index entry holding pid, or -1. It is safe to
+*   call from the SIGCHLD handler.
+********************************************************************************/
+static int FindPid(pid_t pid) {
+  int i;
+
+  if (jobTable.pidCapacity == 0) {
+    return -1;
+  }
+  for (i = PidHash(pid); jobTable.pidIndex[i].pid != 0;
+       i = (i + 1) & (jobTable.pidCapacity - 1)) {
+    if (jobTable.pidIndex[i].pid == pid) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/********************************************************************************
+* Description: InsertPid()
+*   This function adds pid to the PID index with linear probing.
+********************************************************************************/
+static void InsertPid(pid_t pid, int job) {
+  int i = PidHash(pid);
+
+  while (jobTable.pidIndex[i].pid != 0) {
+    i = (i + 1) & (jobTable.pidCapacity - 1);
+  }
+  jobTable.pidIndex[i].pid = pid;
+  jobTable.pidIndex[i].job = job;
+  jobTable.pidIndex[i].isStopped = false;
+  jobTable.pidCount++;
+}
+
+/********************************************************************************
+* Description: RemovePid()
+*   This function removes pid from the PID index. Later entries in the same
+*   probe run are shifted back into the hole, so no tombstones are needed.
+********************************************************************************/
+static void RemovePid(pid_t pid) {
+  int mask = jobTable.pidCapacity - 1;
+  int hole = FindPid(pid);
+  int i;
+  int home;
+
+  if (hole < 0) {
+    return;
+  }
+  jobTable.pidIndex[hole].pid = 0;
+  jobTable.pidCount--;
+
+  for (i = (hole + 1) & mask; jobTable.pidIndex[i].pid != 0; i = (i + 1) & mask) {
+    home = PidHash(jobTable.pidIndex[i].pid);
+    /* Move the entry back if the hole lies between its home and where it is */
+    if (((i - home) & mask) >= ((i - hole) & mask)) {
+      jobTable.pidIndex[hole] = jobTable.pidIndex[i];
+      jobTable.pidIndex[i].pid = 0;
+      hole = i;
+    }
+  }
+}
+
+/********************************************************************************
+* Description: GrowPidIndex()
+*   This function doubles the PID index and re-inserts every entry, keeping the
+*   index at most half full.
+********************************************************************************/
+static void GrowPidIndex(void) {
+  struct pidSlot *old = jobTable.pidIndex;
+  int oldCapacity = jobTable.pidCapacity;
+  int i;
+
+  jobTable.pidCapacity = oldCapacity == 0 ? 2 * JOB_TABLE_START : oldCapacity * 2;
+  jobTable.pidIndex = (struct pidSlot *) calloc(jobTable.pidCapacity, sizeof(struct pidSlot));
+  jobTable.pidCount = 0;
+  for (i = 0; i < oldCapacity; i++) {
+    if (old[i].pid != 0) {
+      InsertPid(old[i].pid, old[i].job);
+      jobTable.pidIndex[FindPid(old[i].pid)].isStopped = old[i].isStopped;
+    }
+  }
+  free(old);
+}
+
+/********************************************************************************
+* Description: GrowJobs()
+*   This function doubles the job array and the lists that are sized with it.
+*   The new jobs are pushed onto the free stack.
+********************************************************************************/
+static void GrowJobs(void) {
+  int oldCapacity = jobTable.jobCapacity;
+  int i;
+
+  jobTable.jobCapacity = oldCapacity == 0 ? JOB_TABLE_START : oldCapacity * 2;
+  jobTable.jobs = (struct job *) realloc(jobTable.jobs,
+                                         jobTable.jobCapacity * sizeof(struct job));
+  jobTable.freeJobs = (int *) realloc(jobTable.freeJobs,
+                                      jobTable.jobCapacity * sizeof(int));
+  jobTable.doneJobs = (volatile int *) realloc((int *) jobTable.doneJobs,
+                                               jobTable.jobCapacity * sizeof(int));
+  memset(jobTable.jobs + oldCapacity, 0,
+         (jobTable.jobCapacity - oldCapacity) * sizeof(struct job));
+  for (i = jobTable.jobCapacity - 1; i >= oldCapacity; i--) {
+    jobTable.freeJobs[jobTable.freeCount++] = i;
+  }
+}
+
+/********************************************************************************
+* Description: RemoveJob()
+*   This function releases a finished job and its PID index entries.
+********************************************************************************/
+static void RemoveJob(int job) {
+  struct job *entry = &jobTable.jobs[job];
+  int i;
+
+  for (i = 0; i < entry->pidCount; i++) {
+    RemovePid(entry->pids[i]);
+  }
+  free(entry->pids);
+  entry->pids = NULL;
+  free(entry->name);
+  entry->name = NULL;
+  if (entry->timerFd >= 0) {
+    close(entry->timerFd); /* Also takes it out of the supervisor */
+    entry->timerFd = -1;
+  }
+  entry->graceMs = 0;
+  entry->isUsed = false;
+  jobTable.freeJobs[jobTable.freeCount++] = job;
+}
+
+/********************************************************************************
+* Description: ElapsedUs()
+*   This function returns the microseconds from start until now on the
+*   monotonic clock. It is async-signal-safe.
+********************************************************************************/
+static long ElapsedUs(struct timespec *start) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) * 1000000L + (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+/********************************************************************************
+* Description: AddUsage()
+*   This function adds what one reaped process used to its job's totals.
+********************************************************************************/
+static void AddUsage(struct jobUsage *usage, struct rusage *child) {
+  usage->userUs += child->ru_utime.tv_sec * 1000000L + child->ru_utime.tv_usec;
+  usage->systemUs += child->ru_stime.tv_sec * 1000000L + child->ru_stime.tv_usec;
+  if (child->ru_maxrss > usage->maxRssKb) {
+    usage->maxRssKb = child->ru_maxrss;
+  }
+  usage->majorFaults += child->ru_majflt;
+  usage->minorFaults += child->ru_minflt;
+  usage->voluntarySwitches += child->ru_nvcsw;
+  usage->involuntarySwitches += child->ru_nivcsw;
+}
+
+/********************************************************************************
+* Description: ReapChildren()
+*   This function reaps every child that has finished, with no limit per call,
+*   and records the result and the resources it used in the child's job. A
+*   background job whose last process is reaped is queued for reporting. A
+*   child that was stopped or continued only changes its job's stopped count.
+*   It is async-signal-safe, and is called from the SIGCHLD handler and, while
+*   SIGCHLD is blocked, when the signalfd reports it.
+********************************************************************************/
+static void ReapChildren(void) {
+  struct rusage childUsage;
+  int childExitMethod;
+  struct job *entry;
+  pid_t childPid;
+  int slot;
+
+  while ((childPid = wait4(-1, &childExitMethod, WNOHANG | WUNTRACED | WCONTINUED,
+                           &childUsage)) > 0) {
+    slot = FindPid(childPid);
+    if (slot < 0) {
+      continue;
+    }
+    entry = &jobTable.jobs[jobTable.pidIndex[slot].job];
+    if (WIFSTOPPED(childExitMethod)) {
+      TRACE('i', "stop", "pid", childPid);
+      if (!jobTable.pidIndex[slot].isStopped) {
+        jobTable.pidIndex[slot].isStopped = true;
+        entry->stopped++;
+      }
+      entry->stopSignal = WSTOPSIG(childExitMethod);
+      continue;
+    }
+    if (jobTable.pidIndex[slot].isStopped) { /* Continued, or killed while stopped */
+      jobTable.pidIndex[slot].isStopped = false;
+      entry->stopped--;
+    }
+    if (WIFCONTINUED(childExitMethod)) {
+      continue;
+    }
+    TRACE('i', "reap", "pid", childPid);
+    if (childPid == entry->pids[entry->pidCount - 1]) {
+      entry->waitStatus = childExitMethod;
+    }
+    AddUsage(&entry->usage, &childUsage);
+    if (--entry->running == 0) {
+      entry->usage.wallUs = ElapsedUs(&entry->startTime);
+      entry->isDone = true;
+      TRACE('e', "job", NULL, entry->pids[entry->pidCount - 1]);
+      if (!entry->isForeground) {
+        jobTable.doneJobs[jobTable.doneCount++] = jobTable.pidIndex[slot].job;
+      }
+    }
+  }
+}
+
+/********************************************************************************
+* Description: catchSIGCHLD()
+*   This function is the signal handler for SIGCHLD.
+********************************************************************************/
+static void catchSIGCHLD(int signo) {
+  int savedErrno = errno;
+  ReapChildren();
+  errno = savedErrno;
+}
+
+/********************************************************************************
+* Description: SignalJob()
+*   This function sends a signal to a job's process group, or to each of its
+*   processes if it has no group of its own.
+********************************************************************************/
+static void SignalJob(struct job *entry, int signo) {
+  int i;
+
+  if (entry->pgid > 0) {
+    kill(-entry->pgid, signo);
+  } else {
+    for (i = 0; i < entry->pidCount; i++) {
+      kill(entry->pids[i], signo);
+    }
+  }
+}
+
+/********************************************************************************
+* Description: ArmTimer()
+*   This function sets a timerfd to fire once after the given milliseconds.
+********************************************************************************/
+static void ArmTimer(int timerFd, long milliseconds) {
+  struct itimerspec deadline = {{0, 0}, {0, 0}};
+
+  deadline.it_value.tv_sec = milliseconds / 1000;
+  deadline.it_value.tv_nsec = (milliseconds % 1000) * 1000000;
+  timerfd_settime(timerFd, 0, &deadline, NULL);
+}
+
+/********************************************************************************
+* Description: HandleDeadline()
+*   This function runs when a job's timer fires. The first time the job gets
+*   SIGTERM and the timer is re-armed for the grace period, its own or else the
+*   shell's; the second time it gets SIGKILL.
+********************************************************************************/
+static void HandleDeadline(int job) {
+  struct job *entry = &jobTable.jobs[job];
+  uint64_t expirations;
+
+  if (read(entry->timerFd, &expirations, sizeof(expirations)) < 0 || entry->isDone) {
+    return;
+  }
+  if (!entry->timedOut) {
+    entry->timedOut = true;
+    SignalJob(entry, SIGTERM);
+    ArmTimer(entry->timerFd, entry->graceMs == 0 ? jobTable.graceMs :
+                             entry->graceMs < 0 ? 0 : entry->graceMs); /* 0 disarms it */
+  } else {
+    SignalJob(entry, SIGKILL);
+  }
+}
+
+/********************************************************************************
+* Description: Supervise()
+*   This function waits up to timeoutMs (-1 for no limit) for the supervisor and
+*   handles what it reports: a pending SIGCHLD is consumed from the signalfd and
+*   the children are reaped, and a fired timer escalates its job. SIGCHLD must
+*   be blocked.
+********************************************************************************/
+static void Supervise(int timeoutMs) {
+  struct epoll_event events[16];
+  struct signalfd_siginfo info;
+  int count;
+  int i;
+
+  count = epoll_wait(jobTable.supervisorFd, events, 16, timeoutMs);
+  for (i = 0; i < count; i++) {
+    if (events[i].data.u32 == CHILD_SIGNAL_EVENT) {
+      while (read(jobTable.childSignalFd, &info, sizeof(info)) > 0) {
+        continue;
+      }
+      ReapChildren();
+    } else {
+      HandleDeadline((int) events[i].data.u32);
+    }
+  }
+}
+
+/********************************************************************************
+* Description: InitJobs()
+*   This function installs the SIGCHLD handler and creates the supervisor.
+*   SA_RESTART keeps reads at the prompt from being interrupted every time a
+*   child exits. SIGCHLD is also raised when a child stops, so that a
+*   foreground wait wakes up for it.
+********************************************************************************/
+void InitJobs(void) {
+  struct sigaction SIGCHLD_action = {{0}};
+  struct epoll_event event = {0};
+  sigset_t childMask;
+
+  sigemptyset(&childMask);
+  sigaddset(&childMask, SIGCHLD);
+  jobTable.childSignalFd = signalfd(-1, &childMask, SFD_NONBLOCK | SFD_CLOEXEC);
+  jobTable.supervisorFd = epoll_create1(EPOLL_CLOEXEC);
+  event.events = EPOLLIN;
+  event.data.u32 = CHILD_SIGNAL_EVENT;
+  epoll_ctl(jobTable.supervisorFd, EPOLL_CTL_ADD, jobTable.childSignalFd, &event);
+
+  SIGCHLD_action.sa_handler = catchSIGCHLD;
+  sigfillset(&SIGCHLD_action.sa_mask);
+  SIGCHLD_action.sa_flags = SA_RESTART;
+  sigaction(SIGCHLD, &SIGCHLD_action, NULL);
+}
+
+/********************************************************************************
+* Description: BlockChildSignal()
+*   This function blocks SIGCHLD and saves the previous mask. Processes must be
+*   launched and added with AddJob() while it is blocked, so that one that exits
+*   at once is still found in the table.
+********************************************************************************/
+void BlockChildSignal(sigset_t *oldMask) {
+  sigset_t childMask;
+
+  sigemptyset(&childMask);
+  sigaddset(&childMask, SIGCHLD);
+  sigprocmask(SIG_BLOCK, &childMask, oldMask);
+}
+
+/********************************************************************************
+* Description: RestoreChildSignal()
+*   This function restores the mask saved by BlockChildSignal().
+********************************************************************************/
+void RestoreChildSignal(sigset_t *oldMask) {
+  sigprocmask(SIG_SETMASK, oldMask, NULL);
+}
+
+/********************************************************************************
+* Description: AddJob()
+*   This function records the processes of a newly started job and returns the
+*   job's index. The PID array is copied. A job whose timeoutMs is 0 gets the
+*   shell's default deadline, and a negative timeoutMs means none. A timed job
+*   has its usage added to its completion report. SIGCHLD must be blocked.
+********************************************************************************/
+int AddJob(pid_t *pids, int pidCount, pid_t pgid, bool isForeground, long timeoutMs,
+           bool isTimed) {
+  struct epoll_event event = {0};
+  struct job *entry;
+  int job;
+  int i;
+
+  if (jobTable.freeCount == 0) {
+    GrowJobs();
+  }
+  while ((jobTable.pidCount + pidCount) * 2 > jobTable.pidCapacity) {
+    GrowPidIndex();
+  }
+
+  job = jobTable.freeJobs[--jobTable.freeCount];
+  entry = &jobTable.jobs[job];
+  entry->pids = (pid_t *) malloc(pidCount * sizeof(pid_t));
+  memcpy(entry->pids, pids, pidCount * sizeof(pid_t));
+  entry->pidCount = pidCount;
+  entry->running = pidCount;
+  entry->stopped = 0;
+  entry->stopSignal = 0;
+  entry->number = 0;
+  entry->name = NULL;
+  entry->waitStatus = 0;
+  entry->pgid = pgid;
+  entry->isUsed = true;
+  entry->isForeground = isForeground;
+  entry->isDone = false;
+  entry->timedOut = false;
+  entry->isTimed = isTimed || jobTable.timeAll;
+  entry->timerFd = -1;
+  entry->graceMs = 0;
+  entry->limits.setMask = 0;
+  memset(&entry->usage, 0, sizeof(entry->usage));
+  clock_gettime(CLOCK_MONOTONIC, &entry->startTime);
+  TRACE('b', "job", NULL, pids[pidCount - 1]);
+
+  for (i = 0; i < pidCount; i++) {
+    InsertPid(pids[i], job);
+  }
+
+  if (timeoutMs == 0) {
+    timeoutMs = jobTable.defaultTimeoutMs;
+  }
+  if (timeoutMs > 0) {
+    entry->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    ArmTimer(entry->timerFd, timeoutMs);
+    event.events = EPOLLIN;
+    event.data.u32 = (uint32_t) job;
+    epoll_ctl(jobTable.supervisorFd, EPOLL_CTL_ADD, entry->timerFd, &event);
+  }
+  return job;
+}
+
+/********************************************************************************
+* Description: LimitJob()
+*   This function records the resource limits a job's last process was
+*   started with, so that its report can tell when one of them ended it.
+********************************************************************************/
+void LimitJob(int job, const struct resourceLimits *limits) {
+  jobTable.jobs[job].limits = *limits;
+}
+
+/********************************************************************************
+* Description: GraceJob()
+*   This function gives a job the grace period of its "timeout -k" prefix.
+********************************************************************************/
+void GraceJob(int job, long graceMs) {
+  jobTable.jobs[job].graceMs = graceMs;
+}
+
+/********************************************************************************
+* Description: WaitForChildren()
+*   This function sleeps on the supervisor until a child has been reaped or a
+*   deadline has fired. SIGCHLD must be blocked.
+********************************************************************************/
+void WaitForChildren(void) {
+  ReapChildren(); /* Children that exited before SIGCHLD was blocked */
+  Supervise(-1);
+}
+
+/********************************************************************************
+* Description: IsJobDone()
+*   This function returns whether every process of a job has been reaped.
+********************************************************************************/
+bool IsJobDone(int job) {
+  return jobTable.jobs[job].isDone;
+}
+
+/********************************************************************************
+* Description: IsJobStopped()
+*   This function returns whether every process of a job that has not been
+*   reaped is stopped.
+********************************************************************************/
+bool IsJobStopped(int job) {
+  return jobTable.jobs[job].stopped > 0 &&
+         jobTable.jobs[job].stopped == jobTable.jobs[job].running;
+}
+
+/********************************************************************************
+* Description: NameJob()
+*   This function gives a job the text "jobs" shows for it, the words of each
+*   stage with " | " between the stages.
+********************************************************************************/
+void NameJob(int job, struct command *stages, int stageCount) {
+  size_t length = 0;
+  char *name;
+  int i;
+  int j;
+
+  for (i = 0; i < stageCount; i++) {
+    for (j = 0; j < stages[i].argCount; j++) {
+      length += strlen(stages[i].args[j]) + 3;
+    }
+  }
+  name = (char *) malloc(length + 1);
+  name[0] = '\0';
+  for (i = 0; i < stageCount; i++) {
+    for (j = 0; j < stages[i].argCount; j++) {
+      if (i > 0 || j > 0) {
+        strcat(name, j == 0 ? " | " : " ");
+      }
+      strcat(name, stages[i].args[j]);
+    }
+  }
+  free(jobTable.jobs[job].name);
+  jobTable.jobs[job].name = name;
+}
+
+/********************************************************************************
+* Description: NumberJob()
+*   This function gives a job the next job number, one past the highest in
+*   use, unless it has one already, and returns it.
+********************************************************************************/
+int NumberJob(int job) {
+  int highest = 0;
+  int i;
+
+  if (jobTable.jobs[job].number > 0) {
+    return jobTable.jobs[job].number;
+  }
+  for (i = 0; i < jobTable.jobCapacity; i++) {
+    if (jobTable.jobs[i].isUsed && jobTable.jobs[i].number > highest) {
+      highest = jobTable.jobs[i].number;
+    }
+  }
+  jobTable.jobs[job].number = highest + 1;
+  return highest + 1;
+}
+
+/********************************************************************************
+* Description: FindJobPid()
+*   This function returns the job a PID belongs to, or -1.
+********************************************************************************/
+int FindJobPid(pid_t pid) {
+  int slot = FindPid(pid);
+  return slot < 0 ? -1 : jobTable.pidIndex[slot].job;
+}
+
+/********************************************************************************
+* Description: FindJobSpec()
+*   This function returns the numbered job a job spec names, or -1. "%n" is job
+*   n, "%%", "%+" and a bare "%" the current job, which is the newest one, "%-"
+*   the one before it, and "%text" the job whose name starts with text.
+********************************************************************************/
+int FindJobSpec(const char *spec) {
+  int current = -1;
+  int previous = -1;
+  int found = -1;
+  char *end;
+  long number;
+  int i;
+
+  if (spec[0] != '%') {
+    return -1;
+  }
+  spec++;
+  if (spec[0] >= '0' && spec[0] <= '9') {
+    number = strtol(spec, &end, 10);
+    for (i = 0; i < jobTable.jobCapacity && *end == '\0'; i++) {
+      if (jobTable.jobs[i].isUsed && jobTable.jobs[i].number == number) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  for (i = 0; i < jobTable.jobCapacity; i++) {
+    if (!jobTable.jobs[i].isUsed || jobTable.jobs[i].number == 0) {
+      continue;
+    }
+    if (current < 0 || jobTable.jobs[i].number > jobTable.jobs[current].number) {
+      previous = current;
+      current = i;
+    } else if (previous < 0 || jobTable.jobs[i].number > jobTable.jobs[previous].number) {
+      previous = i;
+    }
+    if (spec[0] != '\0' && jobTable.jobs[i].name != NULL &&
+        strncmp(jobTable.jobs[i].name, spec, strlen(spec)) == 0) {
+      if (found >= 0) {
+        return -1; /* Ambiguous */
+      }
+      found = i;
+    }
+  }
+  if (spec[0] == '\0' || strcmp(spec, "%") == 0 || strcmp(spec, "+") == 0) {
+    return current;
+  }
+  if (strcmp(spec, "-") == 0) {
+    return previous;
+  }
+  return found;
+}
+
+/********************************************************************************
+* Description: ContinueJob()
+*   This function sends SIGCONT to a job, in the foreground or in the
+*   background, and counts it as running again. A background job is reported
+*   when it finishes, a foreground one is left for its waiter. SIGCHLD must be
+*   blocked.
+********************************************************************************/
+void ContinueJob(int job, bool isForeground) {
+  struct job *entry = &jobTable.jobs[job];
+  int i;
+  int slot;
+
+  for (i = 0; i < entry->pidCount; i++) {
+    slot = FindPid(entry->pids[i]);
+    if (slot >= 0) {
+      jobTable.pidIndex[slot].isStopped = false;
+    }
+  }
+  entry->stopped = 0;
+  entry->isForeground = isForeground;
+  SignalJob(entry, SIGCONT);
+}
+
+/********************************************************************************
+* Description: JobExitValue()
+*   This function turns a wait status into the value "wait" and $? give for
+*   it: the exit value, or 128 plus the signal that ended or stopped it.
+********************************************************************************/
+int JobExitValue(int waitStatus) {
+  if (WIFSIGNALED(waitStatus)) {
+    return 128 + WTERMSIG(waitStatus);
+  }
+  if (WIFSTOPPED(waitStatus)) {
+    return 128 + WSTOPSIG(waitStatus);
+  }
+  return WEXITSTATUS(waitStatus);
+}
+
+/********************************************************************************
+* Description: PrintJobs()
+*   This function prints every numbered job in order of its number, marking
+*   the current job with "+" and the one before it with "-", and with withPids
+*   the PIDs of its processes. SIGCHLD must be blocked.
+********************************************************************************/
+void PrintJobs(FILE *output, bool withPids) {
+  struct job *entry;
+  int current = FindJobSpec("%+");
+  int previous = FindJobSpec("%-");
+  int number;
+  int next;
+  int i;
+  int j;
+
+  /* Job numbers are few, so find each next one with a scan of the table */
+  for (number = 0;; number = jobTable.jobs[next].number) {
+    next = -1;
+    for (i = 0; i < jobTable.jobCapacity; i++) {
+      if (jobTable.jobs[i].isUsed && jobTable.jobs[i].number > number &&
+          (next < 0 || jobTable.jobs[i].number < jobTable.jobs[next].number)) {
+        next = i;
+      }
+    }
+    if (next < 0) {
+      break;
+    }
+    entry = &jobTable.jobs[next];
+    fprintf(output, "[%d]%c  ", entry->number,
+            next == current ? '+' : next == previous ? '-' : ' ');
+    if (withPids) {
+      for (j = 0; j < entry->pidCount; j++) {
+        fprintf(output, "%d ", entry->pids[j]);
+      }
+    }
+    fprintf(output, "%-8s  %s\n",
+            entry->isDone ? "Done" : IsJobStopped(next) ? "Stopped" : "Running",
+            entry->name != NULL ? entry->name : "");
+  }
+}
+
+/********************************************************************************
+* Description: FinishJob()
+*   This function removes a job that is done and returns the wait status of its
+*   last process. timedOut is set if the job ran past its deadline, and usage,
+*   unless it is NULL, gets the resources the job used. SIGCHLD must be blocked.
+********************************************************************************/
+int FinishJob(int job, bool *timedOut, struct jobUsage *usage) {
+  int waitStatus = jobTable.jobs[job].waitStatus;
+
+  *timedOut = jobTable.jobs[job].timedOut;
+  if (usage != NULL) {
+    *usage = jobTable.jobs[job].usage;
+  }
+  RemoveJob(job);
+  return waitStatus;
+}
+
+/********************************************************************************
+* Description: WaitForJob()
+*   This function sleeps on the supervisor until every process of a job has been
+*   reaped, enforcing deadlines along the way, then removes the job and returns
+*   the wait status of its last process, as FinishJob() does. If the job stops
+*   instead it is kept in the table, no longer in the foreground, and -1 is
+*   returned. SIGCHLD must be blocked.
+********************************************************************************/
+int WaitForJob(int job, bool *timedOut, struct jobUsage *usage) {
+  while (!IsJobDone(job) && !IsJobStopped(job)) {
+    WaitForChildren();
+  }
+  if (!IsJobDone(job)) {
+    jobTable.jobs[job].isForeground = false;
+    return -1;
+  }
+  return FinishJob(job, timedOut, usage);
+}
+
+/********************************************************************************
+* Description: FormatUsage()
+*   This function writes a one line summary of a job's usage, without a
+*   newline, and returns its length as snprintf() does.
+********************************************************************************/
+int FormatUsage(char *text, size_t size, struct jobUsage *usage) {
+  return snprintf(text, size,
+                  "real %ld.%03lds user %ld.%03lds sys %ld.%03lds maxrss %ldKB "
+                  "faults %ld major %ld minor switches %ld voluntary %ld involuntary",
+                  usage->wallUs / 1000000, usage->wallUs / 1000 % 1000,
+                  usage->userUs / 1000000, usage->userUs / 1000 % 1000,
+                  usage->systemUs / 1000000, usage->systemUs / 1000 % 1000,
+                  usage->maxRssKb, usage->majorFaults, usage->minorFaults,
+                  usage->voluntarySwitches, usage->involuntarySwitches);
+}
+
+/********************************************************************************
+* Description: ServiceJobs()
+*   This function handles whatever the supervisor has ready without sleeping.
+*   The shell calls it between commands and while it waits at the prompt, so
+*   background deadlines are enforced even when nothing runs in the foreground.
+********************************************************************************/
+void ServiceJobs(void) {
+  sigset_t oldMask;
+
+  BlockChildSignal(&oldMask);
+  Supervise(0);
+  RestoreChildSignal(&oldMask);
+}
+
+/********************************************************************************
+* Description: TakeDoneJob()
+*   This function takes one finished background job off the queue that
+*   ReportJobs() prints from, for a caller that reports jobs itself, and returns
+*   it, or -1 if none has finished. The job stays in the table until it is
+*   passed to FinishJob(). SIGCHLD must be blocked.
+********************************************************************************/
+int TakeDoneJob(void) {
+  if (jobTable.doneCount == 0) {
+    return -1;
+  }
+  return jobTable.doneJobs[--jobTable.doneCount];
+}
+
+/********************************************************************************
+* Description: ReportJobs()
+*   This function prints how every finished background job ended, naming the
+*   resource limit that killed it if one did, and for a timed job what it
+*   used, and removes it from the table. All of the messages go out in a
+*   single writev call.
+********************************************************************************/
+void ReportJobs(void) {
+  struct iovec *messages;
+  struct job *entry;
+  sigset_t oldMask;
+  char *text;
+  int offset = 0;
+  int count;
+  int sent;
+  int limit;
+  int job;
+  int i;
+
+  if (jobTable.doneCount == 0) { /* Checked again with SIGCHLD blocked below */
+    return;
+  }
+  BlockChildSignal(&oldMask);
+
+  count = jobTable.doneCount;
+  messages = (struct iovec *) malloc(count * sizeof(struct iovec));
+  text = (char *) malloc(count * REPORT_SIZE);
+  for (i = 0; i < count; i++) {
+    job = jobTable.doneJobs[i];
+    entry = &jobTable.jobs[job];
+
+    messages[i].iov_base = text + offset;
+    limit = LimitViolation(entry->waitStatus, entry->usage.userUs + entry->usage.systemUs,
+                           &entry->limits);
+    if (limit >= 0) {
+      messages[i].iov_len = sprintf(text + offset,
+                                    "background pid %d is done: killed: %s (signal %d)\n",
+                                    entry->pids[entry->pidCount - 1], LimitMessage(limit),
+                                    WTERMSIG(entry->waitStatus));
+    } else if (WIFSIGNALED(entry->waitStatus)) {
+      messages[i].iov_len = sprintf(text + offset,
+                                    "background pid %d is done: terminated by signal %d%s\n",
+                                    entry->pids[entry->pidCount - 1],
+                                    WTERMSIG(entry->waitStatus),
+                                    entry->timedOut ? " (timed out)" : "");
+    } else {
+      messages[i].iov_len = sprintf(text + offset,
+                                    "background pid %d is done: exit value %d%s\n",
+                                    entry->pids[entry->pidCount - 1],
+                                    WEXITSTATUS(entry->waitStatus),
+                                    entry->timedOut ? " (timed out)" : "");
+    }
+    if (entry->isTimed) { /* Put the usage on its own line under the report */
+      messages[i].iov_len += FormatUsage(text + offset + messages[i].iov_len,
+                                         REPORT_SIZE - messages[i].iov_len - 1,
+                                         &entry->usage);
+      text[offset + messages[i].iov_len++] = '\n';
+    }
+    offset += messages[i].iov_len;
+    RemoveJob(job);
+  }
+  jobTable.doneCount = 0;
+  RestoreChildSignal(&oldMask);
+
+  fflush(stdout);
+  for (sent = 0; sent < count; sent += IOV_MAX) {
+    writev(STDOUT_FILENO, messages + sent, count - sent < IOV_MAX ? count - sent : IOV_MAX);
+  }
+  free(messages);
+  free(text);
+}
+
+/********************************************************************************
+* Description: SignalJobs()
+*   This function sends a signal to every process of every job that is still
+*   running, and SIGCONT after it to a stopped job so that it can act on it.
+********************************************************************************/
+void SignalJobs(int signo) {
+  sigset_t oldMask;
+  int job;
+  int i;
+
+  BlockChildSignal(&oldMask);
+  for (job = 0; job < jobTable.jobCapacity; job++) {
+    if (jobTable.jobs[job].isUsed && !jobTable.jobs[job].isDone) {
+      for (i = 0; i < jobTable.jobs[job].pidCount; i++) {
+        kill(jobTable.jobs[job].pids[i], signo);
+      }
+      if (jobTable.jobs[job].stopped > 0) {
+        SignalJob(&jobTable.jobs[job], SIGCONT);
+      }
+    }
+  }
+  RestoreChildSignal(&oldMask);
+}
@@ -0,0 +1,100 @@
+/********************************************************************************
+* Program Name: Jobs.h
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: Header file for Jobs.c. The table of processes smallsh has
+*   started, indexed by PID and reaped from a SIGCHLD handler, and the job
+*   numbers and states that job control works with.
+********************************************************************************/
+#ifndef JOBS_H
+#define JOBS_H
+
+#include "CommandLine.h"
+#include "Limits.h"
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+
+struct jobUsage {    /* Resources used by all of a job's processes together */
+  long wallUs;       /* From AddJob() until the last process was reaped */
+  long userUs;
+  long systemUs;
+  long maxRssKb;     /* Largest of any one process */
+  long majorFaults;
+  long minorFaults;
+  long voluntarySwitches;
+  long involuntarySwitches;
+};
+
+struct job {
+  pid_t *pids;       /* Every process in the job, the last one sets the status */
+  int pidCount;
+  int running;       /* Processes that have not been reaped yet */
+  int stopped;       /* Of those, how many are stopped by a signal */
+  int stopSignal;    /* Signal that stopped the last one to stop */
+  int number;        /* Job number for %n, 0 until it is in the background */
+  char *name;        /* Command text for "jobs", NULL until it is numbered */
+  int waitStatus;    /* Wait status of the last process */
+  pid_t pgid;        /* Process group to signal, -1 to signal the PIDs one by one */
+  int timerFd;       /* timerfd for the job's deadline, -1 for none */
+  long graceMs;      /* Its own grace period, 0 for the shell's, -1 for none */
+  struct timespec startTime;
+  struct jobUsage usage; /* Summed from wait4() as the processes are reaped */
+  struct resourceLimits limits; /* What the last process ran with, to explain its end */
+  bool isUsed;
+  bool isForeground;
+  bool isDone;       /* Every process has been reaped */
+  bool timedOut;     /* The deadline passed and SIGTERM was sent */
+  bool isTimed;      /* Report the usage when the job is done */
+};
+
+struct pidSlot {     /* Entry in the open-addressing PID index */
+  pid_t pid;         /* 0 when the entry is empty */
+  int job;           /* Index into the job array */
+  bool isStopped;    /* The process is stopped by a signal */
+};
+
+struct jobTable {
+  struct job *jobs;
+  int jobCapacity;
+  int *freeJobs;     /* Stack of unused job indices */
+  int freeCount;
+  volatile int *doneJobs; /* Background jobs finished but not reported yet */
+  volatile int doneCount;
+  struct pidSlot *pidIndex;
+  int pidCapacity;   /* Always a power of two */
+  int pidCount;
+  int supervisorFd;  /* epoll set of the SIGCHLD signalfd and every job timerfd */
+  int childSignalFd; /* signalfd that sees SIGCHLD while it is blocked */
+  long defaultTimeoutMs; /* Deadline for jobs without their own, 0 for none */
+  long graceMs;      /* Time between SIGTERM and SIGKILL for a late job */
+  bool timeAll;      /* Report the usage of every job, not just "time" ones */
+};
+
+extern struct jobTable jobTable;
+
+void InitJobs(void);
+void BlockChildSignal(sigset_t *oldMask);
+void RestoreChildSignal(sigset_t *oldMask);
+int AddJob(pid_t *pids, int pidCount, pid_t pgid, bool isForeground, long timeoutMs,
+           bool isTimed);
+void LimitJob(int job, const struct resourceLimits *limits);
+void GraceJob(int job, long graceMs);
+void WaitForChildren(void);
+bool IsJobDone(int job);
+bool IsJobStopped(int job);
+void NameJob(int job, struct command *stages, int stageCount);
+int NumberJob(int job);
+int FindJobPid(pid_t pid);
+int FindJobSpec(const char *spec);
+void ContinueJob(int job, bool isForeground);
+int JobExitValue(int waitStatus);
+void PrintJobs(FILE *output, bool withPids);
+int FinishJob(int job, bool *timedOut, struct jobUsage *usage);
+int WaitForJob(int job, bool *timedOut, struct jobUsage *usage);
+int FormatUsage(char *text, size_t size, struct jobUsage *usage);
+void ServiceJobs(void);
+int TakeDoneJob(void);
+void ReportJobs(void);
+void SignalJobs(int signo);
+#endif
@@ -0,0 +1,296 @@
+/********************************************************************************
+* Program Name: Limits.c
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: This is the set of functions behind "limit". The shell keeps a
+*   set of default resource limits, and a command can override any of them
+*   with "limit <resource> <value>" in front of it. A command with limits is
+*   launched through fork(), and the child calls setrlimit() before execv, so
+*   the limits hold from the first instruction of the new program and never
+*   touch the shell itself. The names follow csh and may be shortened to any
+*   unique prefix:
+*     cputime       CPU seconds, or any duration ParseDuration() reads
+*     filesize      largest file it may write, in bytes
+*     vmemoryuse    address space, in bytes
+*     descriptors   open files
+*     maxproc       processes, counted per user by the kernel
+*     coredumpsize  core file size, in bytes
+*   Sizes take a K, M or G suffix, and "unlimited" takes a limit away.
+*
+*   Only some limits end a program with a signal of their own. A job that
+*   dies of SIGXCPU, SIGXFSZ, or of SIGKILL after using up its CPU time is
+*   reported as killed by that limit, and so is one with a memory limit that
+*   dies of SIGSEGV, SIGBUS or SIGABRT, which is how most programs fail when
+*   an allocation is refused.
+********************************************************************************/
+#include "Limits.h"
+#include <signal.h>
+#include <sys/wait.h>
+
+#define CPU_GRACE_SECONDS 1 /* Between SIGXCPU at the soft limit and SIGKILL at the hard one */
+
+struct resourceLimits shellLimits = {{0}, 0};
+
+static const char *limitNames[LIMIT_COUNT] = {
+  "cputime", "filesize", "vmemoryuse", "descriptors", "maxproc", "coredumpsize"
+};
+static const char *limitMessages[LIMIT_COUNT] = {
+  "CPU limit", "file size limit", "memory limit", "descriptor limit", "process limit",
+  "core size limit"
+};
+static const int limitResources[LIMIT_COUNT] = {
+  RLIMIT_CPU, RLIMIT_FSIZE, RLIMIT_AS, RLIMIT_NOFILE, RLIMIT_NPROC, RLIMIT_CORE
+};
+
+/********************************************************************************
+* Description: FindLimit()
+*   This function returns the resource a name or unique prefix of one stands
+*   for, or -1.
+********************************************************************************/
+static int FindLimit(const char *name) {
+  size_t length = strlen(name);
+  int found = -1;
+  int i;
+
+  for (i = 0; i < LIMIT_COUNT && length > 0; i++) {
+    if (strcmp(name, limitNames[i]) == 0) {
+      return i;
+    }
+    if (strncmp(name, limitNames[i], length) == 0) {
+      if (found >= 0) {
+        return -1; /* Ambiguous */
+      }
+      found = i;
+    }
+  }
+  return found;
+}
+
+/********************************************************************************
+* Description: ParseLimit()
+*   This function reads a resource name and a value for it. CPU time is a
+*   duration, rounded up to whole seconds, sizes are bytes with an optional K,
+*   M or G, and counts are plain numbers. Returns the resource, or -1 if either
+*   word is not valid.
+********************************************************************************/
+int ParseLimit(const char *name, const char *text, rlim_t *value) {
+  unsigned long long amount;
+  long milliseconds;
+  char *unit;
+  int resource = FindLimit(name);
+
+  if (resource < 0) {
+    return -1;
+  }
+  if (strcmp(text, "unlimited") == 0) {
+    *value = RLIM_INFINITY;
+    return resource;
+  }
+  if (resource == LIMIT_CPU) {
+    if (!ParseDuration(text, &milliseconds)) {
+      return -1;
+    }
+    *value = (milliseconds + 999) / 1000;
+    return resource;
+  }
+
+  if (text[0] < '0' || text[0] > '9') {
+    return -1;
+  }
+  amount = strtoull(text, &unit, 10);
+  if (resource != LIMIT_DESCRIPTORS && resource != LIMIT_PROCESSES && unit[0] != '\0' &&
+      unit[1] == '\0') {
+    switch (unit[0]) {
+      case 'g': case 'G':
+        amount <<= 10;
+        /* Fall through */
+      case 'm': case 'M':
+        amount <<= 10;
+        /* Fall through */
+      case 'k': case 'K':
+        amount <<= 10;
+        unit++;
+        break;
+    }
+  }
+  if (*unit != '\0') {
+    return -1;
+  }
+  *value = (rlim_t) amount;
+  return resource;
+}
+
+/********************************************************************************
+* Description: SetLimit()
+*   This function gives a resource a value in a set of limits.
+********************************************************************************/
+void SetLimit(struct resourceLimits *limits, int resource, rlim_t value) {
+  limits->values[resource] = value;
+  limits->setMask |= 1u << resource;
+}
+
+/********************************************************************************
+* Description: MergeLimits()
+*   This function combines the shell's defaults with a command's own limits,
+*   which win. overrides may be NULL.
+********************************************************************************/
+void MergeLimits(const struct resourceLimits *overrides, struct resourceLimits *result) {
+  int i;
+
+  *result = shellLimits;
+  if (overrides == NULL) {
+    return;
+  }
+  for (i = 0; i < LIMIT_COUNT; i++) {
+    if (overrides->setMask & (1u << i)) {
+      SetLimit(result, i, overrides->values[i]);
+    }
+  }
+}
+
+/********************************************************************************
+* Description: HasLimits()
+*   This function returns whether a command with these overrides (or NULL) has
+*   any limit to apply, so that it must be launched through fork().
+********************************************************************************/
+bool HasLimits(const struct resourceLimits *overrides) {
+  struct resourceLimits limits;
+  int i;
+
+  if (shellLimits.setMask == 0 && overrides == NULL) {
+    return false;
+  }
+  MergeLimits(overrides, &limits);
+  for (i = 0; i < LIMIT_COUNT; i++) {
+    if ((limits.setMask & (1u << i)) && limits.values[i] != RLIM_INFINITY) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/********************************************************************************
+* Description: ApplyLimits()
+*   This function sets the limits of the calling process, both soft and hard so
+*   the program cannot raise them again. A limit above the current hard limit
+*   is held to it. The CPU hard limit is a little past the soft one, so a
+*   program first gets SIGXCPU and only then SIGKILL. It is called in a forked
+*   child before exec. Returns -1 with errno set if a limit cannot be set.
+********************************************************************************/
+int ApplyLimits(const struct resourceLimits *overrides) {
+  struct resourceLimits limits;
+  struct rlimit current;
+  struct rlimit wanted;
+  int i;
+
+  MergeLimits(overrides, &limits);
+  for (i = 0; i < LIMIT_COUNT; i++) {
+    if (!(limits.setMask & (1u << i)) || limits.values[i] == RLIM_INFINITY) {
+      continue;
+    }
+    if (getrlimit(limitResources[i], &current) < 0) {
+      return -1;
+    }
+    wanted.rlim_cur = limits.values[i];
+    wanted.rlim_max = limits.values[i] + (i == LIMIT_CPU ? CPU_GRACE_SECONDS : 0);
+    if (current.rlim_max != RLIM_INFINITY) {
+      wanted.rlim_cur = wanted.rlim_cur < current.rlim_max ? wanted.rlim_cur : current.rlim_max;
+      wanted.rlim_max = wanted.rlim_max < current.rlim_max ? wanted.rlim_max : current.rlim_max;
+    }
+    if (setrlimit(limitResources[i], &wanted) < 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/********************************************************************************
+* Description: LimitViolation()
+*   This function returns the resource whose limit ended a job, judging by the
+*   wait status of its last process, the CPU time the job used and the limits
+*   it ran with, or -1 if it did not end that way.
+********************************************************************************/
+int LimitViolation(int waitStatus, long cpuUs, const struct resourceLimits *limits) {
+  int signo;
+
+  if (!WIFSIGNALED(waitStatus)) {
+    return -1;
+  }
+  signo = WTERMSIG(waitStatus);
+  if (signo == SIGXCPU) {
+    return LIMIT_CPU;
+  }
+  if (signo == SIGXFSZ) {
+    return LIMIT_FILESIZE;
+  }
+  if (signo == SIGKILL && (limits->setMask & (1u << LIMIT_CPU)) &&
+      limits->values[LIMIT_CPU] != RLIM_INFINITY &&
+      cpuUs >= (long) limits->values[LIMIT_CPU] * 1000000L) {
+    return LIMIT_CPU;
+  }
+  if ((signo == SIGSEGV || signo == SIGBUS || signo == SIGABRT) &&
+      (limits->setMask & (1u << LIMIT_MEMORY)) && limits->values[LIMIT_MEMORY] != RLIM_INFINITY) {
+    return LIMIT_MEMORY;
+  }
+  return -1;
+}
+
+/********************************************************************************
+* Description: LimitMessage()
+*   This function returns how a resource is named in a report, such as
+*   "CPU limit".
+********************************************************************************/
+const char *LimitMessage(int resource) {
+  return limitMessages[resource];
+}
+
+/********************************************************************************
+* Description: PrintValue()
+*   This function prints one limit the way ParseLimit() reads it.
+********************************************************************************/
+static void PrintValue(FILE *output, int resource, rlim_t value) {
+  if (value == RLIM_INFINITY) {
+    fprintf(output, "unlimited");
+  } else if (resource == LIMIT_CPU) {
+    fprintf(output, "%llus", (unsigned long long) value);
+  } else if (resource == LIMIT_DESCRIPTORS || resource == LIMIT_PROCESSES) {
+    fprintf(output, "%llu", (unsigned long long) value);
+  } else if (value != 0 && value % (1 << 30) == 0) {
+    fprintf(output, "%lluG", (unsigned long long) value >> 30);
+  } else if (value != 0 && value % (1 << 20) == 0) {
+    fprintf(output, "%lluM", (unsigned long long) value >> 20);
+  } else if (value != 0 && value % (1 << 10) == 0) {
+    fprintf(output, "%lluK", (unsigned long long) value >> 10);
+  } else {
+    fprintf(output, "%llu", (unsigned long long) value);
+  }
+}
+
+/********************************************************************************
+* Description: PrintLimits()
+*   This function prints the limit every launched command gets for one
+*   resource, or for all of them if name is NULL. A resource the shell sets no
+*   default for shows the limit the shell itself has, which commands inherit.
+*   Returns false if name is not a resource.
+********************************************************************************/
+bool PrintLimits(FILE *output, const char *name) {
+  struct rlimit current;
+  int resource = name != NULL ? FindLimit(name) : 0;
+  int last = name != NULL ? resource : LIMIT_COUNT - 1;
+
+  if (resource < 0) {
+    return false;
+  }
+  for (; resource <= last; resource++) {
+    fprintf(output, "%-13s ", limitNames[resource]);
+    if (shellLimits.setMask & (1u << resource)) {
+      PrintValue(output, resource, shellLimits.values[resource]);
+    } else {
+      getrlimit(limitResources[resource], &current);
+      PrintValue(output, resource, current.rlim_cur);
+      fprintf(output, " (inherited)");
+    }
+    fprintf(output, "\n");
+  }
+  return true;
+}
@@ -0,0 +1,40 @@
+/********************************************************************************
+* Program Name: Limits.h
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: Header file for Limits.c. Resource limits that launched commands
+*   get, set for the whole shell with "limit" or for one command with a "limit"
+*   prefix.
+********************************************************************************/
+#ifndef LIMITS_H
+#define LIMITS_H
+
+#include "CommandLine.h"
+#include <sys/resource.h>
+
+enum limitResource {
+  LIMIT_CPU,           /* RLIMIT_CPU, in seconds */
+  LIMIT_FILESIZE,      /* RLIMIT_FSIZE, in bytes */
+  LIMIT_MEMORY,        /* RLIMIT_AS, in bytes */
+  LIMIT_DESCRIPTORS,   /* RLIMIT_NOFILE */
+  LIMIT_PROCESSES,     /* RLIMIT_NPROC, which the kernel counts per user */
+  LIMIT_CORE,          /* RLIMIT_CORE, in bytes */
+  LIMIT_COUNT
+};
+
+struct resourceLimits {
+  rlim_t values[LIMIT_COUNT]; /* RLIM_INFINITY keeps the shell's own limit */
+  unsigned setMask;           /* One bit per resource that was given a value */
+};
+
+extern struct resourceLimits shellLimits;
+
+int ParseLimit(const char *name, const char *text, rlim_t *value);
+void SetLimit(struct resourceLimits *limits, int resource, rlim_t value);
+void MergeLimits(const struct resourceLimits *overrides, struct resourceLimits *result);
+bool HasLimits(const struct resourceLimits *overrides);
+int ApplyLimits(const struct resourceLimits *overrides);
+int LimitViolation(int waitStatus, long cpuUs, const struct resourceLimits *limits);
+const char *LimitMessage(int resource);
+bool PrintLimits(FILE *output, const char *name);
+#endif
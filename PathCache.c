@@ -0,0 +1,259 @@
+/********************************************************************************
+* Program Name: PathCache.c
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: This is the set of functions that remember where commands live.
+*   The first launch of a command searches PATH once; later launches execve the
+*   remembered absolute path directly instead of letting execvp try every PATH
+*   directory. The table is emptied whenever PATH changes, and a single entry is
+*   dropped when its program disappears.
+********************************************************************************/
+#include "CommandLine.h"
+#include "PathCache.h"
+#include <sys/stat.h>
+
+#define PATH_CACHE_BUCKETS 64 /* Starting bucket count, doubled as entries are added */
+#define DEFAULT_PATH "/bin:/usr/bin" /* What execvp searches when PATH is unset */
+
+struct pathCache commandPaths = {NULL, 0, 0, NULL, 0, 0};
+
+/********************************************************************************
+* Description: HashName()
+*   This function is the FNV-1a hash of a command name.
+********************************************************************************/
+static size_t HashName(const char *name) {
+  size_t hash = 2166136261u;
+  while (*name != '\0') {
+    hash = (hash ^ (unsigned char) *name++) * 16777619u;
+  }
+  return hash;
+}
+
+/********************************************************************************
+* Description: CurrentPath()
+*   This function returns the PATH the shell would search right now.
+********************************************************************************/
+static const char *CurrentPath(void) {
+  const char *path = getenv("PATH");
+  return path != NULL ? path : DEFAULT_PATH;
+}
+
+/********************************************************************************
+* Description: GrowBuckets()
+*   This function doubles the bucket array and moves every entry into it, so
+*   chains stay about one entry long.
+********************************************************************************/
+static void GrowBuckets(void) {
+  size_t newCount = commandPaths.bucketCount * 2;
+  struct pathEntry **newBuckets;
+  struct pathEntry *entry;
+  struct pathEntry *next;
+  size_t i;
+
+  newBuckets = (struct pathEntry **) calloc(newCount, sizeof(struct pathEntry *));
+  for (i = 0; i < commandPaths.bucketCount; i++) {
+    for (entry = commandPaths.buckets[i]; entry != NULL; entry = next) {
+      next = entry->next;
+      entry->next = newBuckets[HashName(entry->name) & (newCount - 1)];
+      newBuckets[HashName(entry->name) & (newCount - 1)] = entry;
+    }
+  }
+  free(commandPaths.buckets);
+  commandPaths.buckets = newBuckets;
+  commandPaths.bucketCount = newCount;
+}
+
+/********************************************************************************
+* Description: SearchPath()
+*   This function walks the directories in PATH the same way execvp does and
+*   returns a newly allocated path to the first executable regular file named
+*   name, or NULL. An empty PATH entry means the current directory. A result
+*   from a relative directory is flagged through isRelative since it must not be
+*   cached.
+********************************************************************************/
+static char *SearchPath(const char *name, bool *isRelative) {
+  const char *dir = CurrentPath();
+  const char *end;
+  struct stat fileInfo;
+  size_t dirLength;
+  size_t nameLength = strlen(name);
+  char *candidate;
+
+  while (true) {
+    end = strchr(dir, ':');
+    dirLength = end != NULL ? (size_t) (end - dir) : strlen(dir);
+
+    candidate = (char *) malloc(dirLength + nameLength + 3);
+    if (dirLength == 0) {
+      strcpy(candidate, "./");
+    } else {
+      memcpy(candidate, dir, dirLength);
+      candidate[dirLength] = '/';
+      candidate[dirLength + 1] = '\0';
+    }
+    strcat(candidate, name);
+
+    if (stat(candidate, &fileInfo) == 0 && S_ISREG(fileInfo.st_mode) &&
+        access(candidate, X_OK) == 0) {
+      *isRelative = candidate[0] != '/';
+      return candidate;
+    }
+    free(candidate);
+
+    if (end == NULL) {
+      return NULL;
+    }
+    dir = end + 1;
+  }
+}
+
+/********************************************************************************
+* Description: FindEntry()
+*   This function returns the cached entry for name, or NULL.
+********************************************************************************/
+static struct pathEntry *FindEntry(const char *name) {
+  struct pathEntry *entry;
+
+  if (commandPaths.bucketCount == 0) {
+    return NULL;
+  }
+  entry = commandPaths.buckets[HashName(name) & (commandPaths.bucketCount - 1)];
+  while (entry != NULL && strcmp(entry->name, name) != 0) {
+    entry = entry->next;
+  }
+  return entry;
+}
+
+/********************************************************************************
+* Description: LookupCommand()
+*   This function returns the path to launch for a command name. A name with a
+*   '/' in it is returned unchanged. Otherwise the cache is checked and, on a
+*   miss, PATH is searched and the result remembered. If PATH has changed since
+*   the entries were found, the whole cache is dropped first. Returns NULL if the
+*   command is not found. The returned string stays valid until the next call.
+********************************************************************************/
+const char *LookupCommand(const char *name) {
+  static char *uncached = NULL; /* Result from a relative PATH directory */
+  struct pathEntry *entry;
+  bool isRelative = false;
+  char *path;
+  size_t bucket;
+
+  if (strchr(name, '/') != NULL) {
+    return name;
+  }
+
+  if (commandPaths.searchPath != NULL &&
+      strcmp(commandPaths.searchPath, CurrentPath()) != 0) {
+    ClearPathCache();
+  }
+
+  entry = FindEntry(name);
+  if (entry != NULL) {
+    entry->hits++;
+    commandPaths.hits++;
+    return entry->path;
+  }
+
+  commandPaths.misses++;
+  path = SearchPath(name, &isRelative);
+  if (path == NULL) {
+    return NULL;
+  }
+  if (isRelative) {
+    free(uncached);
+    uncached = path;
+    return path;
+  }
+
+  if (commandPaths.bucketCount == 0) {
+    commandPaths.bucketCount = PATH_CACHE_BUCKETS;
+    commandPaths.buckets = (struct pathEntry **) calloc(PATH_CACHE_BUCKETS,
+                                                        sizeof(struct pathEntry *));
+  } else if (commandPaths.entryCount >= commandPaths.bucketCount) {
+    GrowBuckets();
+  }
+  if (commandPaths.searchPath == NULL) {
+    commandPaths.searchPath = strdup(CurrentPath());
+  }
+
+  entry = (struct pathEntry *) malloc(sizeof(struct pathEntry));
+  entry->name = strdup(name);
+  entry->path = path;
+  entry->hits = 0;
+  bucket = HashName(name) & (commandPaths.bucketCount - 1);
+  entry->next = commandPaths.buckets[bucket];
+  commandPaths.buckets[bucket] = entry;
+  commandPaths.entryCount++;
+  return entry->path;
+}
+
+/********************************************************************************
+* Description: ForgetCommand()
+*   This function drops the cached entry for name, if there is one. It is used
+*   when the remembered program has disappeared.
+********************************************************************************/
+void ForgetCommand(const char *name) {
+  struct pathEntry **link;
+  struct pathEntry *entry;
+
+  if (commandPaths.bucketCount == 0) {
+    return;
+  }
+  link = &commandPaths.buckets[HashName(name) & (commandPaths.bucketCount - 1)];
+  while ((entry = *link) != NULL) {
+    if (strcmp(entry->name, name) == 0) {
+      *link = entry->next;
+      free(entry->name);
+      free(entry->path);
+      free(entry);
+      commandPaths.entryCount--;
+      return;
+    }
+    link = &entry->next;
+  }
+}
+
+/********************************************************************************
+* Description: ClearPathCache()
+*   This function drops every cached entry. The hit and miss counters are kept.
+********************************************************************************/
+void ClearPathCache(void) {
+  struct pathEntry *entry;
+  struct pathEntry *next;
+  size_t i;
+
+  for (i = 0; i < commandPaths.bucketCount; i++) {
+    for (entry = commandPaths.buckets[i]; entry != NULL; entry = next) {
+      next = entry->next;
+      free(entry->name);
+      free(entry->path);
+      free(entry);
+    }
+    commandPaths.buckets[i] = NULL;
+  }
+  commandPaths.entryCount = 0;
+  free(commandPaths.searchPath);
+  commandPaths.searchPath = NULL;
+}
+
+/********************************************************************************
+* Description: PrintPathCache()
+*   This function prints every cached command with its hit count, followed by
+*   the cache-wide hit and miss counters.
+********************************************************************************/
+void PrintPathCache(FILE *output) {
+  struct pathEntry *entry;
+  size_t i;
+
+  if (commandPaths.entryCount > 0) {
+    fprintf(output, "hits\tcommand\n");
+  }
+  for (i = 0; i < commandPaths.bucketCount; i++) {
+    for (entry = commandPaths.buckets[i]; entry != NULL; entry = entry->next) {
+      fprintf(output, "%4lu\t%s\n", entry->hits, entry->path);
+    }
+  }
+  fprintf(output, "cache: %zu entries, %lu hits, %lu misses\n",
+          commandPaths.entryCount, commandPaths.hits, commandPaths.misses);
+}
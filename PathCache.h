@@ -0,0 +1,36 @@
+/********************************************************************************
+* Program Name: PathCache.h
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: Header file for PathCache.c. A hash table from command names to
+*   the absolute paths found by searching PATH, used by the launch path and by
+*   the "hash" builtin.
+********************************************************************************/
+#ifndef PATHCACHE_H
+#define PATHCACHE_H
+
+#include <stdio.h>
+
+struct pathEntry {
+  char *name;
+  char *path;             /* Absolute path of the program */
+  unsigned long hits;     /* Lookups answered by this entry */
+  struct pathEntry *next; /* Next entry in the same bucket */
+};
+
+struct pathCache {
+  struct pathEntry **buckets;
+  size_t bucketCount;
+  size_t entryCount;
+  char *searchPath;       /* Value of PATH the entries were found with */
+  unsigned long hits;
+  unsigned long misses;
+};
+
+extern struct pathCache commandPaths;
+
+const char *LookupCommand(const char *name);
+void ForgetCommand(const char *name);
+void ClearPathCache(void);
+void PrintPathCache(FILE *output);
+#endif
@@ -0,0 +1,561 @@
+/********************************************************************************
+* Program Name: ScriptCache.c
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: This is the compiled form of a script file. The first run
+*   splits every line with ReadTokens() and writes the tokens to a cache file:
+*   each word with its quoting already removed, each redirection and pipe as a
+*   one byte marker, and each word that holds a reference or a wildcard as
+*   written, marked to be expanded when the line runs. Blank lines and
+*   comments are left out. A line that starts an if, while or for block, or
+*   that holds a ';', is kept as text and read again when it runs, since ';'
+*   separates commands only inside those blocks and is part of a word
+*   everywhere else. Later runs map the cache file and step through it, so a
+*   script is read and split once however often it is run.
+*
+*   The cache lives in SMALLSH_SCRIPT_CACHE, $XDG_CACHE_HOME/smallsh or
+*   ~/.cache/smallsh, one file per script named by a hash of its real path.
+*   The header records the script's path, size, mtime, inode and device, and
+*   any difference compiles the script again. With SMALLSH_SCRIPT_CACHE=off
+*   (or empty) the shell runs scripts from their text as before. A cache file
+*   that cannot be written only costs the compile, which is run from memory.
+*
+*   Each time a cache file is written the directory is pruned: files of an
+*   older CACHE_VERSION and files whose script is gone are removed, and past
+*   CACHE_MAX_FILES the ones compiled longest ago go too, so the cache stays
+*   bounded however many scripts are run.
+********************************************************************************/
+#include "ScriptCache.h"
+#include "Control.h"
+#include "Trace.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CACHE_MAGIC "smallshc"
+#define CACHE_VERSION 3  /* Raise when the records or enum tokenKind change */
+#define CACHE_MAX_FILES 256 /* Cache files kept in the directory after pruning */
+#define LINE_TOKENS 'T'  /* Token count, then kind, quoted flag and text of each */
+#define LINE_TEXT 'L'    /* A line run as text: ReadTokens() refused it, or it has */
+                         /* a control keyword or a ';' for the control parser */
+
+struct cacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t pathLength;   /* The script's real path follows, then a NUL */
+  uint64_t imageSize;    /* The whole file */
+  int64_t mtimeSec;      /* The script as it was compiled */
+  int64_t mtimeNsec;
+  uint64_t sourceSize;
+  uint64_t inode;
+  uint64_t device;
+};
+
+struct cacheFile {       /* A cache file that survived the first pruning pass */
+  char name[NAME_MAX + 1];
+  struct timespec mtime; /* When it was last compiled */
+};
+
+struct imageBuffer {
+  char *data;
+  size_t size;
+  size_t capacity;
+};
+
+/********************************************************************************
+* Description: AppendImage()
+*   This function adds bytes to the end of an image being compiled, doubling
+*   its buffer when it is full. Returns false if the buffer cannot grow.
+********************************************************************************/
+static bool AppendImage(struct imageBuffer *image, const void *bytes, size_t length) {
+  char *grown;
+  size_t capacity = image->capacity == 0 ? 4096 : image->capacity;
+
+  while (image->size + length > capacity) {
+    capacity *= 2;
+  }
+  if (capacity != image->capacity) {
+    grown = (char *) realloc(image->data, capacity);
+    if (grown == NULL) {
+      return false;
+    }
+    image->data = grown;
+    image->capacity = capacity;
+  }
+  memcpy(image->data + image->size, bytes, length);
+  image->size += length;
+  return true;
+}
+
+/********************************************************************************
+* Description: FillHeader()
+*   This function records the script a cache file was compiled from.
+********************************************************************************/
+static void FillHeader(struct cacheHeader *header, const struct stat *info,
+                       const char *realPath) {
+  memset(header, 0, sizeof(struct cacheHeader));
+  memcpy(header->magic, CACHE_MAGIC, sizeof(header->magic));
+  header->version = CACHE_VERSION;
+  header->pathLength = strlen(realPath);
+  header->mtimeSec = info->st_mtim.tv_sec;
+  header->mtimeNsec = info->st_mtim.tv_nsec;
+  header->sourceSize = info->st_size;
+  header->inode = info->st_ino;
+  header->device = info->st_dev;
+}
+
+/********************************************************************************
+* Description: IsScriptCacheOff()
+*   This function returns true if SMALLSH_SCRIPT_CACHE turns the cache off,
+*   in which case a script is better run straight from its text.
+********************************************************************************/
+bool IsScriptCacheOff(void) {
+  const char *setting = getenv("SMALLSH_SCRIPT_CACHE");
+
+  return setting != NULL && (setting[0] == '\0' || strcmp(setting, "off") == 0);
+}
+
+/********************************************************************************
+* Description: CachePath()
+*   This function names the cache file for a script, creating the cache
+*   directory if it is missing. The name is the FNV-1a hash of the script's
+*   real path. Returns false if caching is off or there is nowhere to put it.
+********************************************************************************/
+static bool CachePath(const char *realPath, char *cachePath, size_t size) {
+  char directory[PATH_MAX];
+  const char *setting = getenv("SMALLSH_SCRIPT_CACHE");
+  uint64_t hash = 14695981039346656037ULL;
+  const char *c;
+
+  if (IsScriptCacheOff()) {
+    return false;
+  } else if (setting != NULL) {
+    snprintf(directory, sizeof(directory), "%s", setting);
+  } else if (getenv("XDG_CACHE_HOME") != NULL && getenv("XDG_CACHE_HOME")[0] == '/') {
+    mkdir(getenv("XDG_CACHE_HOME"), 0700);
+    snprintf(directory, sizeof(directory), "%s/smallsh", getenv("XDG_CACHE_HOME"));
+  } else if (getenv("HOME") != NULL) {
+    snprintf(directory, sizeof(directory), "%s/.cache", getenv("HOME"));
+    mkdir(directory, 0700);
+    snprintf(directory, sizeof(directory), "%s/.cache/smallsh", getenv("HOME"));
+  } else {
+    return false;
+  }
+  if (mkdir(directory, 0700) < 0 && errno != EEXIST) {
+    return false;
+  }
+
+  for (c = realPath; *c != '\0'; c++) {
+    hash = (hash ^ (unsigned char) *c) * 1099511628211ULL;
+  }
+  return snprintf(cachePath, size, "%s/%016llx.smc", directory,
+                  (unsigned long long) hash) < (int) size;
+}
+
+/********************************************************************************
+* Description: MapCache()
+*   This function maps a script's cache file if it was compiled from the
+*   script as it is now. The mapping is private and writable, so a line kept
+*   as text can be terminated in place like a mapped script. Returns false if
+*   there is no such file or it is out of date.
+********************************************************************************/
+static bool MapCache(const char *cachePath, const struct stat *info,
+                     const char *realPath, struct compiledScript *script) {
+  struct cacheHeader expected;
+  struct cacheHeader *header;
+  struct stat cacheInfo;
+  char *image;
+  int fd;
+
+  fd = open(cachePath, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  if (fstat(fd, &cacheInfo) < 0 ||
+      (size_t) cacheInfo.st_size < sizeof(struct cacheHeader) + strlen(realPath) + 1) {
+    close(fd);
+    return false;
+  }
+  image = mmap(NULL, cacheInfo.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (image == MAP_FAILED) {
+    return false;
+  }
+
+  /* Everything but the image size has to match what the script is now */
+  header = (struct cacheHeader *) image;
+  FillHeader(&expected, info, realPath);
+  expected.imageSize = cacheInfo.st_size;
+  if (memcmp(header, &expected, sizeof(struct cacheHeader)) != 0 ||
+      memcmp(image + sizeof(struct cacheHeader), realPath, expected.pathLength + 1) != 0) {
+    munmap(image, cacheInfo.st_size);
+    return false;
+  }
+  madvise(image, cacheInfo.st_size, MADV_SEQUENTIAL);
+  script->image = image;
+  script->size = cacheInfo.st_size;
+  script->isMapped = true;
+  return true;
+}
+
+/********************************************************************************
+* Description: CompileScript()
+*   This function compiles a script into an image in memory: the header, then
+*   one record for every line that is not blank or a comment. Returns false
+*   with errno set if the script cannot be read.
+********************************************************************************/
+static bool CompileScript(const char *realPath, const struct stat *info,
+                          struct compiledScript *script) {
+  struct imageBuffer image = {NULL, 0, 0};
+  struct cacheHeader header;
+  struct token *tokens;
+  struct arena arena;
+  char *source;
+  char *cursor;
+  char *end;
+  char *line;
+  char *text;
+  size_t sourceLength;
+  uint32_t count;
+  char record[2];
+  bool isComplete;
+  int lineCount = 0;
+  int tokenCount;
+  int i;
+
+  source = MapScript(realPath, &sourceLength);
+  if (source == NULL) {
+    return false;
+  }
+  TRACE('B', "compile", NULL, 0);
+  InitArena(&arena);
+  FillHeader(&header, info, realPath);
+  isComplete = AppendImage(&image, &header, sizeof(header)) &&
+               AppendImage(&image, realPath, header.pathLength + 1);
+
+  cursor = source;
+  end = source + sourceLength;
+  while (isComplete && (line = NextScriptLine(&cursor, end)) != NULL) {
+    text = ArenaStrndup(&arena, line, strlen(line)); /* ReadTokens() splits it in place */
+    tokenCount = ReadTokens(line, &tokens, &arena);
+    if (tokenCount != 0 && (StartsControl(text) || strchr(text, ';') != NULL)) {
+      tokenCount = -1; /* The control parser reads the ';'s the tokens have lost */
+    }
+    if (tokenCount < 0) {
+      record[0] = LINE_TEXT;
+      isComplete = AppendImage(&image, record, 1) &&
+                   AppendImage(&image, text, strlen(text) + 1);
+    } else if (tokenCount > 0) {
+      record[0] = LINE_TOKENS;
+      count = tokenCount;
+      isComplete = AppendImage(&image, record, 1) &&
+                   AppendImage(&image, &count, sizeof(count));
+      for (i = 0; isComplete && i < tokenCount; i++) {
+        record[0] = (char) tokens[i].kind;
+        record[1] = (char) tokens[i].isQuoted;
+        isComplete = AppendImage(&image, record, 2) &&
+                     (tokens[i].text == NULL ||
+                      AppendImage(&image, tokens[i].text, strlen(tokens[i].text) + 1));
+      }
+    }
+    lineCount++;
+    ResetArena(&arena);
+  }
+  FreeArena(&arena);
+  UnmapScript(source, sourceLength);
+  TRACE('E', "compile", "lines", lineCount);
+
+  if (!isComplete) {
+    free(image.data);
+    errno = ENOMEM;
+    return false;
+  }
+  ((struct cacheHeader *) image.data)->imageSize = image.size;
+  script->image = image.data;
+  script->size = image.size;
+  script->isMapped = false;
+  return true;
+}
+
+/********************************************************************************
+* Description: WriteCache()
+*   This function saves a compiled image as a script's cache file. It is
+*   written under a temporary name and renamed over the old one, so a shell
+*   mapping the cache file never sees it half written. A failure only means
+*   the script is compiled again next time. Returns true if it was saved.
+********************************************************************************/
+static bool WriteCache(const char *cachePath, const char *image, size_t size) {
+  char tempPath[PATH_MAX];
+  ssize_t written;
+  size_t done = 0;
+  int fd;
+
+  if (snprintf(tempPath, sizeof(tempPath), "%s.%d", cachePath, (int) getpid()) >=
+      (int) sizeof(tempPath)) {
+    return false;
+  }
+  fd = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+  if (fd < 0) {
+    return false;
+  }
+  while (done < size) {
+    written = write(fd, image + done, size - done);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      break;
+    }
+    done += written;
+  }
+  if (close(fd) < 0 || done < size || rename(tempPath, cachePath) < 0) {
+    unlink(tempPath);
+    return false;
+  }
+  return true;
+}
+
+/********************************************************************************
+* Description: IsCacheCurrent()
+*   This function reads the header of the cache file at entryPath and returns
+*   true if it is of this CACHE_VERSION and its script still exists.
+********************************************************************************/
+static bool IsCacheCurrent(const char *entryPath) {
+  struct cacheHeader header;
+  char source[PATH_MAX];
+  bool isCurrent = false;
+  int fd;
+
+  fd = open(entryPath, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return true; /* Not ours to judge, it may be being renamed into place */
+  }
+  if (read(fd, &header, sizeof(header)) == (ssize_t) sizeof(header) &&
+      memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+      header.version == CACHE_VERSION && header.pathLength < sizeof(source) &&
+      read(fd, source, header.pathLength + 1) == (ssize_t) header.pathLength + 1 &&
+      source[header.pathLength] == '\0') {
+    isCurrent = access(source, F_OK) == 0 || errno != ENOENT;
+  }
+  close(fd);
+  return isCurrent;
+}
+
+/********************************************************************************
+* Description: CompareCacheFiles()
+*   This function orders cache files newest first for qsort().
+********************************************************************************/
+static int CompareCacheFiles(const void *a, const void *b) {
+  const struct cacheFile *first = (const struct cacheFile *) a;
+  const struct cacheFile *second = (const struct cacheFile *) b;
+
+  if (first->mtime.tv_sec != second->mtime.tv_sec) {
+    return first->mtime.tv_sec < second->mtime.tv_sec ? 1 : -1;
+  }
+  if (first->mtime.tv_nsec != second->mtime.tv_nsec) {
+    return first->mtime.tv_nsec < second->mtime.tv_nsec ? 1 : -1;
+  }
+  return 0;
+}
+
+/********************************************************************************
+* Description: PruneCache()
+*   This function bounds the directory that holds cachePath. The ".smc" files
+*   of another version or whose script is gone are removed, and if more than
+*   CACHE_MAX_FILES remain, the ones compiled longest ago are removed as well.
+*   It runs only after a cache file is written, never on a run that hits.
+********************************************************************************/
+static void PruneCache(const char *cachePath) {
+  char directory[PATH_MAX];
+  char entryPath[PATH_MAX];
+  struct cacheFile *files = NULL;
+  struct cacheFile *grown;
+  struct dirent *entry;
+  struct stat info;
+  size_t nameLength;
+  int capacity = 0;
+  int count = 0;
+  int i;
+  DIR *listing;
+  char *slash;
+
+  snprintf(directory, sizeof(directory), "%s", cachePath);
+  slash = strrchr(directory, '/');
+  if (slash == NULL) {
+    return;
+  }
+  *slash = '\0';
+  listing = opendir(directory);
+  if (listing == NULL) {
+    return;
+  }
+
+  /* First pass: drop what can never be used again, remember the rest */
+  while ((entry = readdir(listing)) != NULL) {
+    nameLength = strlen(entry->d_name);
+    if (nameLength < 4 || strcmp(entry->d_name + nameLength - 4, ".smc") != 0 ||
+        snprintf(entryPath, sizeof(entryPath), "%s/%s", directory, entry->d_name) >=
+        (int) sizeof(entryPath) || stat(entryPath, &info) < 0) {
+      continue;
+    }
+    if (!IsCacheCurrent(entryPath)) {
+      unlink(entryPath);
+      continue;
+    }
+    if (count == capacity) {
+      capacity = capacity == 0 ? 64 : capacity * 2;
+      grown = (struct cacheFile *) realloc(files, capacity * sizeof(struct cacheFile));
+      if (grown == NULL) {
+        break;
+      }
+      files = grown;
+    }
+    snprintf(files[count].name, sizeof(files[count].name), "%s", entry->d_name);
+    files[count].mtime = info.st_mtim;
+    count++;
+  }
+  closedir(listing);
+
+  /* Second pass: keep only the CACHE_MAX_FILES compiled most recently */
+  if (count > CACHE_MAX_FILES) {
+    qsort(files, count, sizeof(struct cacheFile), CompareCacheFiles);
+    for (i = CACHE_MAX_FILES; i < count; i++) {
+      if (snprintf(entryPath, sizeof(entryPath), "%s/%s", directory, files[i].name) <
+          (int) sizeof(entryPath)) {
+        unlink(entryPath);
+      }
+    }
+  }
+  free(files);
+}
+
+/********************************************************************************
+* Description: OpenCompiledScript()
+*   This function opens a script file compiled, mapping its cache file when
+*   that is up to date and compiling it (and saving the cache) otherwise.
+*   Returns false with errno set if the script cannot be read.
+********************************************************************************/
+bool OpenCompiledScript(const char *path, struct compiledScript *script) {
+  char realPath[PATH_MAX];
+  char cachePath[PATH_MAX];
+  struct stat info;
+  bool hasCache;
+
+  if (realpath(path, realPath) == NULL || stat(realPath, &info) < 0) {
+    return false;
+  }
+  hasCache = CachePath(realPath, cachePath, sizeof(cachePath));
+  if (!hasCache || !MapCache(cachePath, &info, realPath, script)) {
+    if (!CompileScript(realPath, &info, script)) {
+      return false;
+    }
+    if (hasCache && WriteCache(cachePath, script->image, script->size)) {
+      PruneCache(cachePath);
+    }
+  }
+  script->cursor = script->image + sizeof(struct cacheHeader) +
+                   ((struct cacheHeader *) script->image)->pathLength + 1;
+  script->end = script->image + script->size;
+  return true;
+}
+
+/********************************************************************************
+* Description: DecodeTokens()
+*   This function decodes the tokens of a LINE_TOKENS record, starting after
+*   its kind byte. Returns where the record ends, or NULL if it runs past the
+*   end of the image or holds an unknown token.
+********************************************************************************/
+static char *DecodeTokens(char *cursor, char *end, struct compiledLine *line,
+                          struct arena *arena) {
+  struct token *token;
+  char *nul;
+  uint32_t count;
+  uint32_t i;
+
+  if ((size_t) (end - cursor) < sizeof(count)) {
+    return NULL;
+  }
+  memcpy(&count, cursor, sizeof(count));
+  cursor += sizeof(count);
+  if (count == 0 || count > (size_t) (end - cursor) / 2) {
+    return NULL;
+  }
+
+  line->tokens = (struct token *) ArenaAlloc(arena, count * sizeof(struct token));
+  for (i = 0; i < count; i++) {
+    token = &line->tokens[i];
+    if (end - cursor < 2 || cursor[0] < TOKEN_WORD || cursor[0] > TOKEN_PIPE) {
+      return NULL;
+    }
+    token->kind = (enum tokenKind) cursor[0];
+    token->isQuoted = cursor[1] != 0;
+    token->text = NULL;
+    cursor += 2;
+    if (token->kind == TOKEN_WORD || token->kind == TOKEN_PATTERN ||
+        token->kind == TOKEN_RAW) {
+      nul = memchr(cursor, '\0', end - cursor);
+      if (nul == NULL) {
+        return NULL;
+      }
+      token->text = cursor;
+      cursor = nul + 1;
+    }
+  }
+  line->tokenCount = count;
+  return cursor;
+}
+
+/********************************************************************************
+* Description: NextCompiledLine()
+*   This function decodes the next line of a compiled script. Its tokens are
+*   allocated in the arena and their text is left in the image, which outlives
+*   them. Returns false at the end of the script, or with an error printed if
+*   the image is damaged.
+********************************************************************************/
+bool NextCompiledLine(struct compiledScript *script, struct compiledLine *line,
+                      struct arena *arena) {
+  char *cursor = script->cursor;
+  char *next = NULL;
+
+  if (cursor >= script->end) {
+    return false;
+  }
+  line->tokens = NULL;
+  line->tokenCount = 0;
+  line->text = NULL;
+
+  if (*cursor == LINE_TEXT) {
+    next = memchr(cursor + 1, '\0', script->end - cursor - 1);
+    if (next != NULL) {
+      line->text = cursor + 1;
+      next++;
+    }
+  } else if (*cursor == LINE_TOKENS) {
+    next = DecodeTokens(cursor + 1, script->end, line, arena);
+  }
+
+  if (next == NULL) {
+    fprintf(stderr, "smallsh: compiled script is damaged\n");
+    script->cursor = script->end;
+    return false;
+  }
+  script->cursor = next;
+  return true;
+}
+
+/********************************************************************************
+* Description: CloseCompiledScript()
+*   This function releases a script opened by OpenCompiledScript().
+********************************************************************************/
+void CloseCompiledScript(struct compiledScript *script) {
+  if (script->isMapped) {
+    munmap(script->image, script->size);
+  } else {
+    free(script->image);
+  }
+  script->image = NULL;
+}
@@ -0,0 +1,33 @@
+/********************************************************************************
+* Program Name: ScriptCache.h
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: Header file for ScriptCache.c. Scripts compiled once into
+*   tokens, kept in a cache file that later runs map instead of parsing.
+********************************************************************************/
+#ifndef SCRIPTCACHE_H
+#define SCRIPTCACHE_H
+
+#include "CommandLine.h"
+#include "Arena.h"
+
+struct compiledScript {
+  char *image;         /* Header, then one record per line */
+  size_t size;
+  bool isMapped;       /* Mapped from the cache file, otherwise malloc()ed */
+  char *cursor;        /* Next record */
+  char *end;
+};
+
+struct compiledLine {
+  struct token *tokens; /* In the arena, their text in the image */
+  int tokenCount;
+  char *text;           /* Instead of tokens, a line kept as written */
+};
+
+bool IsScriptCacheOff(void);
+bool OpenCompiledScript(const char *path, struct compiledScript *script);
+bool NextCompiledLine(struct compiledScript *script, struct compiledLine *line,
+                      struct arena *arena);
+void CloseCompiledScript(struct compiledScript *script);
+#endif
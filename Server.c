@@ -0,0 +1,953 @@
+/********************************************************************************
+* Program Name: Server.c
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: This is the set of functions behind "smallsh --serve path", a
+*   long running executor that takes command lines from any number of local
+*   clients over a Unix stream socket. Each line is built with CreatePipeline()
+*   and launched with LaunchPipeline(), the same as at the prompt, and every
+*   job goes into the shell's job table, so deadlines and resource usage work
+*   as they do there.
+*
+*   A client sends one request per line:
+*     run <command line>      run it with stdin, stdout and stderr on /dev/null
+*     capture <command line>  run it and send back what it writes
+*   Requests are numbered per client from 1 and all of them run at once. The
+*   replies for a request are frames that start with its number:
+*     <id> out <n>\n<n bytes>  some of its stdout, only for capture
+*     <id> err <n>\n<n bytes>  some of its stderr, only for capture
+*     <id> time <usage>\n      what it used, if it had a "time" prefix
+*   followed by exactly one final frame:
+*     <id> exit <value>[ timeout]\n
+*     <id> signal <number>[ timeout][ killed: <resource> limit]\n
+*     <id> error <message>\n   it could not be run at all
+*   The final frame is sent once every process has been reaped and the
+*   captured output has all been sent.
+*
+*   Each client has its own working directory, an O_PATH descriptor that the
+*   daemon fchdir()s to before it builds and launches a request, and its own $?,
+*   the status of its request that finished last. cd, status and exit work on
+*   that session; the other builtins that change the shell cannot be used.
+*
+*   One epoll set holds the listening socket, every client, every capture pipe,
+*   a signalfd for SIGTERM, SIGINT and SIGHUP, and the job table's supervisor.
+*   SIGCHLD stays blocked, so children are only reaped when the supervisor
+*   says so and no system call is interrupted. Replies that a client is slow to
+*   read are buffered, and past OUTPUT_LIMIT the capture pipes feeding it stop
+*   being read until it catches up. The first signal stops new connections and
+*   sends SIGTERM to every job, and the daemon exits once they are finished; a
+*   second signal sends SIGKILL.
+********************************************************************************/
+#include "Server.h"
+#include "Builtins.h"
+#include "Jobs.h"
+#include "Spawn.h"
+#include "Trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define SERVER_EVENTS 256        /* epoll events handled per wakeup */
+#define SERVER_START 16          /* Starting number of clients and requests, doubled as needed */
+#define READ_SIZE 65536          /* Bytes read from a socket or pipe at a time */
+#define REQUEST_LIMIT 65536      /* Longest request line a client may send */
+#define OUTPUT_LIMIT (1024 * 1024) /* Unsent reply bytes before capture pipes are paused */
+#define FRAME_HEADER 48          /* Room for "<id> <kind> <length>\n" */
+#define DETAIL_SIZE 320          /* Room for a frame's text, even a usage summary */
+
+#define EVENT(type, index) (((uint64_t) (type) << 32) | (uint32_t) (index))
+
+enum serverEvent {       /* What an epoll event is for, in the top half of its data */
+  EVENT_LISTEN,
+  EVENT_SIGNAL,
+  EVENT_SUPERVISOR,
+  EVENT_CLIENT,          /* The bottom half is the client */
+  EVENT_OUT,             /* The bottom half is the request */
+  EVENT_ERR
+};
+
+struct client {
+  int fd;                /* Connected socket, -1 once the client has gone */
+  int dirFd;             /* O_PATH descriptor of its working directory */
+  int lastStatus;        /* $? for its next request */
+  int lastSignal;        /* Signal that ended its last request, 0 for none */
+  int nextId;            /* Number of its next request */
+  int running;           /* Requests that have not had their final frame */
+  char *in;              /* Bytes received but not yet a whole line */
+  size_t inLength;
+  size_t inSize;
+  char *out;             /* Bytes not yet sent, starting at outStart */
+  size_t outStart;
+  size_t outLength;
+  size_t outSize;
+  bool isWriting;        /* EPOLLOUT is armed because out has a backlog */
+  bool isClosing;        /* It said "exit" or sent EOF, close once every reply is sent */
+  bool isUsed;
+};
+
+struct request {
+  int client;
+  int id;
+  int job;               /* Index in the job table, -1 once the job is finished */
+  int outFd;             /* Read end of the captured stdout, -1 when closed or not captured */
+  int errFd;             /* Read end of the captured stderr, likewise */
+  int waitStatus;        /* Of the last stage, once the job is finished */
+  bool lastStarted;      /* The last stage started, otherwise the request failed */
+  bool timedOut;
+  bool isTimed;          /* Send a time frame with the usage */
+  bool isPaused;         /* Its pipes are out of the epoll set until the client catches up */
+  struct jobUsage usage;
+  struct resourceLimits limits; /* What its last stage ran with */
+  bool isUsed;
+};
+
+struct server {
+  int listenFd;
+  int epollFd;
+  int signalFd;          /* SIGTERM, SIGINT and SIGHUP */
+  int nullFd;            /* /dev/null for requests that are not captured */
+  int startDirFd;        /* Working directory a new client starts in */
+  struct client *clients;
+  int clientCapacity;
+  int *freeClients;      /* Stack of unused client indices */
+  int freeClientCount;
+  struct request *requests;
+  int requestCapacity;
+  int *freeRequests;     /* Stack of unused request indices */
+  int freeRequestCount;
+  int requestCount;      /* Requests in use */
+  int *tableRequests;    /* Request of each job in the job table */
+  int tableCapacity;
+  int stopSignals;       /* Shutdown signals received so far */
+  struct arena arena;    /* Holds the pipeline being launched */
+};
+
+static struct server server;
+
+/********************************************************************************
+* Description: GrowClients()
+*   This function doubles the client array and pushes the new indices on the
+*   free stack.
+********************************************************************************/
+static void GrowClients(void) {
+  int oldCapacity = server.clientCapacity;
+  int i;
+
+  server.clientCapacity = oldCapacity == 0 ? SERVER_START : oldCapacity * 2;
+  server.clients = (struct client *) realloc(server.clients,
+                                             server.clientCapacity * sizeof(struct client));
+  server.freeClients = (int *) realloc(server.freeClients, server.clientCapacity * sizeof(int));
+  memset(server.clients + oldCapacity, 0,
+         (server.clientCapacity - oldCapacity) * sizeof(struct client));
+  for (i = server.clientCapacity - 1; i >= oldCapacity; i--) {
+    server.freeClients[server.freeClientCount++] = i;
+  }
+}
+
+/********************************************************************************
+* Description: GrowRequests()
+*   This function doubles the request array and pushes the new indices on the
+*   free stack.
+********************************************************************************/
+static void GrowRequests(void) {
+  int oldCapacity = server.requestCapacity;
+  int i;
+
+  server.requestCapacity = oldCapacity == 0 ? SERVER_START : oldCapacity * 2;
+  server.requests = (struct request *) realloc(server.requests,
+                                               server.requestCapacity * sizeof(struct request));
+  server.freeRequests = (int *) realloc(server.freeRequests, server.requestCapacity * sizeof(int));
+  memset(server.requests + oldCapacity, 0,
+         (server.requestCapacity - oldCapacity) * sizeof(struct request));
+  for (i = server.requestCapacity - 1; i >= oldCapacity; i--) {
+    server.freeRequests[server.freeRequestCount++] = i;
+  }
+}
+
+/********************************************************************************
+* Description: Watch()
+*   This function adds a descriptor to the epoll set, or changes or removes
+*   what it is watched for. events of 0 with isNew false removes it.
+********************************************************************************/
+static void Watch(int fd, uint32_t events, enum serverEvent type, int index, bool isNew) {
+  struct epoll_event event = {0};
+
+  event.events = events;
+  event.data.u64 = EVENT(type, index);
+  if (isNew) {
+    epoll_ctl(server.epollFd, EPOLL_CTL_ADD, fd, &event);
+  } else if (events == 0) {
+    epoll_ctl(server.epollFd, EPOLL_CTL_DEL, fd, NULL);
+  } else {
+    epoll_ctl(server.epollFd, EPOLL_CTL_MOD, fd, &event);
+  }
+}
+
+/********************************************************************************
+* Description: WatchClient()
+*   This function sets what a client's socket is watched for from its state:
+*   input until it closes its end, and room to write while it has a backlog.
+*   A client with neither stays in the set with no events, where only a hang
+*   up is reported.
+********************************************************************************/
+static void WatchClient(int index) {
+  struct client *entry = &server.clients[index];
+  struct epoll_event event = {0};
+
+  if (entry->fd < 0) {
+    return;
+  }
+  event.events = (entry->isClosing ? 0 : EPOLLIN) | (entry->isWriting ? EPOLLOUT : 0);
+  event.data.u64 = EVENT(EVENT_CLIENT, index);
+  epoll_ctl(server.epollFd, EPOLL_CTL_MOD, entry->fd, &event);
+}
+
+/********************************************************************************
+* Description: ReleaseClient()
+*   This function frees a client slot once its socket is closed and none of
+*   its requests are left.
+********************************************************************************/
+static void ReleaseClient(int index) {
+  struct client *entry = &server.clients[index];
+
+  close(entry->dirFd);
+  free(entry->in);
+  free(entry->out);
+  memset(entry, 0, sizeof(*entry));
+  entry->fd = -1;
+  server.freeClients[server.freeClientCount++] = index;
+}
+
+/********************************************************************************
+* Description: DropClient()
+*   This function closes a client's socket. Its requests that are still
+*   running are left to finish, but their capture pipes are closed, so one that
+*   keeps writing gets SIGPIPE as it would if the reader of a pipeline went away.
+********************************************************************************/
+static void DropClient(int index) {
+  struct client *entry = &server.clients[index];
+  struct request *request;
+  int i;
+
+  if (entry->fd < 0) {
+    return;
+  }
+  close(entry->fd); /* Also takes it out of the epoll set */
+  entry->fd = -1;
+  entry->isClosing = true;
+  entry->outLength = 0;
+  for (i = 0; entry->running > 0 && i < server.requestCapacity; i++) {
+    request = &server.requests[i];
+    if (request->isUsed && request->client == index) {
+      if (request->outFd >= 0) {
+        close(request->outFd);
+        request->outFd = -1;
+      }
+      if (request->errFd >= 0) {
+        close(request->errFd);
+        request->errFd = -1;
+      }
+    }
+  }
+  if (entry->running == 0) {
+    ReleaseClient(index);
+  }
+}
+
+/********************************************************************************
+* Description: ResumeRequests()
+*   This function puts back the capture pipes that were paused because the
+*   client had too much unsent output.
+********************************************************************************/
+static void ResumeRequests(int index) {
+  struct request *entry;
+  int i;
+
+  for (i = 0; i < server.requestCapacity; i++) {
+    entry = &server.requests[i];
+    if (entry->isUsed && entry->isPaused && entry->client == index) {
+      entry->isPaused = false;
+      if (entry->outFd >= 0) {
+        Watch(entry->outFd, EPOLLIN, EVENT_OUT, i, true);
+      }
+      if (entry->errFd >= 0) {
+        Watch(entry->errFd, EPOLLIN, EVENT_ERR, i, true);
+      }
+    }
+  }
+}
+
+/********************************************************************************
+* Description: FlushClient()
+*   This function sends as much of a client's backlog as its socket takes. The
+*   rest waits for EPOLLOUT. Once the backlog is small again any paused
+*   requests resume, and a closing client with nothing left is closed.
+********************************************************************************/
+static void FlushClient(int index) {
+  struct client *entry = &server.clients[index];
+  bool wasFull = entry->outLength >= OUTPUT_LIMIT;
+  ssize_t sent;
+
+  while (entry->fd >= 0 && entry->outLength > 0) {
+    sent = send(entry->fd, entry->out + entry->outStart, entry->outLength,
+                MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        DropClient(index); /* The client has gone away */
+        return;
+      }
+      break;
+    }
+    entry->outStart += sent;
+    entry->outLength -= sent;
+  }
+  if (entry->fd < 0) {
+    return;
+  }
+  if (entry->outLength == 0) {
+    entry->outStart = 0;
+  }
+
+  if (entry->isWriting != (entry->outLength > 0)) {
+    entry->isWriting = entry->outLength > 0;
+    WatchClient(index);
+  }
+  if (wasFull && entry->outLength < OUTPUT_LIMIT) {
+    ResumeRequests(index);
+  }
+  if (entry->isClosing && entry->running == 0 && entry->outLength == 0) {
+    DropClient(index);
+  }
+}
+
+/********************************************************************************
+* Description: SendFrame()
+*   This function queues one reply frame for a client and tries to send it.
+*   With data the frame is "<id> <kind> <length>\n" and the bytes, and without
+*   it "<id> <kind>" followed by the text in detail and a newline. Nothing is
+*   queued for a client that has gone.
+********************************************************************************/
+static void SendFrame(int index, int id, const char *kind, const char *data, size_t length,
+                      const char *detail) {
+  struct client *entry = &server.clients[index];
+  size_t needed;
+  char *end;
+
+  if (entry->fd < 0) {
+    return;
+  }
+  needed = FRAME_HEADER + strlen(kind) + length + (detail != NULL ? strlen(detail) : 0);
+
+  /* Move the backlog to the front before growing the buffer */
+  if (entry->outStart > 0 && entry->outStart + entry->outLength + needed > entry->outSize) {
+    memmove(entry->out, entry->out + entry->outStart, entry->outLength);
+    entry->outStart = 0;
+  }
+  if (entry->outLength + needed > entry->outSize) {
+    while (entry->outLength + needed > entry->outSize) {
+      entry->outSize = entry->outSize == 0 ? READ_SIZE : entry->outSize * 2;
+    }
+    entry->out = (char *) realloc(entry->out, entry->outSize);
+  }
+
+  end = entry->out + entry->outStart + entry->outLength;
+  if (data != NULL) {
+    end += sprintf(end, "%d %s %zu\n", id, kind, length);
+    memcpy(end, data, length);
+    end += length;
+  } else {
+    end += sprintf(end, "%d %s%s\n", id, kind, detail);
+  }
+  entry->outLength = end - (entry->out + entry->outStart);
+
+  if (!entry->isWriting) {
+    FlushClient(index);
+  }
+}
+
+/********************************************************************************
+* Description: FinishRequest()
+*   This function sends a request's final frame once its job is finished and
+*   both capture pipes have reached end of file, sets the client's $? from it,
+*   and frees it.
+********************************************************************************/
+static void FinishRequest(int index) {
+  struct request *entry = &server.requests[index];
+  struct client *owner = &server.clients[entry->client];
+  char detail[DETAIL_SIZE];
+  const char *late;
+  int limit;
+
+  if (entry->job >= 0 || entry->outFd >= 0 || entry->errFd >= 0) {
+    return;
+  }
+
+  late = entry->timedOut ? " timeout" : "";
+  if (entry->isTimed) {
+    detail[0] = ' ';
+    FormatUsage(detail + 1, sizeof(detail) - 1, &entry->usage);
+    SendFrame(entry->client, entry->id, "time", NULL, 0, detail);
+  }
+  if (!entry->lastStarted) {
+    owner->lastStatus = 1;
+    owner->lastSignal = 0;
+    SendFrame(entry->client, entry->id, "error", NULL, 0, " last stage did not start");
+  } else if (WIFSIGNALED(entry->waitStatus)) {
+    owner->lastSignal = WTERMSIG(entry->waitStatus);
+    owner->lastStatus = 128 + owner->lastSignal;
+    limit = LimitViolation(entry->waitStatus, entry->usage.userUs + entry->usage.systemUs,
+                           &entry->limits);
+    snprintf(detail, sizeof(detail), " %d%s%s%s", owner->lastSignal, late,
+             limit >= 0 ? " killed: " : "", limit >= 0 ? LimitMessage(limit) : "");
+    SendFrame(entry->client, entry->id, "signal", NULL, 0, detail);
+  } else {
+    owner->lastStatus = WEXITSTATUS(entry->waitStatus);
+    owner->lastSignal = 0;
+    snprintf(detail, sizeof(detail), " %d%s", owner->lastStatus, late);
+    SendFrame(entry->client, entry->id, "exit", NULL, 0, detail);
+  }
+
+  entry->isUsed = false;
+  server.freeRequests[server.freeRequestCount++] = index;
+  server.requestCount--;
+
+  owner->running--;
+  if (owner->fd < 0 && owner->running == 0) {
+    ReleaseClient(entry->client);
+  } else if (owner->isClosing && owner->running == 0 && owner->outLength == 0) {
+    DropClient(entry->client);
+  }
+}
+
+/********************************************************************************
+* Description: ReadCapture()
+*   This function reads what a request wrote to one of its capture pipes and
+*   sends it to the client as an out or err frame. At end of file the pipe is
+*   closed, and the request may be finished. If the client's backlog is too
+*   big, the request's pipes are paused.
+********************************************************************************/
+static void ReadCapture(int index, enum serverEvent type) {
+  static char buffer[READ_SIZE];
+  struct request *entry = &server.requests[index];
+  int *fd = type == EVENT_OUT ? &entry->outFd : &entry->errFd;
+  ssize_t count;
+
+  if (!entry->isUsed || *fd < 0) {
+    return;
+  }
+  count = read(*fd, buffer, sizeof(buffer));
+  if (count < 0 && (errno == EAGAIN || errno == EINTR)) {
+    return;
+  }
+  if (count <= 0) {
+    close(*fd); /* Also takes it out of the epoll set */
+    *fd = -1;
+    FinishRequest(index);
+    return;
+  }
+
+  SendFrame(entry->client, entry->id, type == EVENT_OUT ? "out" : "err", buffer, count, NULL);
+  if (server.clients[entry->client].outLength >= OUTPUT_LIMIT && !entry->isPaused) {
+    entry->isPaused = true;
+    if (entry->outFd >= 0) {
+      Watch(entry->outFd, 0, EVENT_OUT, index, false);
+    }
+    if (entry->errFd >= 0) {
+      Watch(entry->errFd, 0, EVENT_ERR, index, false);
+    }
+  }
+}
+
+/********************************************************************************
+* Description: CollectJobs()
+*   This function lets the job table reap whatever has finished and enforce
+*   deadlines, then records each finished job in its request.
+********************************************************************************/
+static void CollectJobs(void) {
+  struct request *entry;
+  int request;
+  int job;
+
+  ServiceJobs();
+  while ((job = TakeDoneJob()) >= 0) {
+    request = server.tableRequests[job];
+    entry = &server.requests[request];
+    entry->waitStatus = FinishJob(job, &entry->timedOut, &entry->usage);
+    entry->job = -1;
+    FinishRequest(request);
+  }
+}
+
+/********************************************************************************
+* Description: SessionBuiltin()
+*   This function runs cd, status or exit for a client and returns the exit
+*   value. cd opens the directory relative to the client's own. Messages are
+*   sent as out or err frames when the request is captured.
+********************************************************************************/
+static int SessionBuiltin(int index, int id, struct command *input, bool isCapture) {
+  struct client *entry = &server.clients[index];
+  char message[PATH_MAX + 64];
+  const char *target;
+  int length;
+  int fd;
+
+  switch (input->builtin->id) {
+    case BUILTIN_CD:
+      target = input->argCount > 1 ? input->args[1] : getenv("HOME");
+      if (target == NULL) {
+        target = "/";
+      }
+      fd = open(target, O_PATH | O_DIRECTORY | O_CLOEXEC);
+      if (fd < 0) {
+        if (isCapture) {
+          length = snprintf(message, sizeof(message), "cd: %s: %s\n", target, strerror(errno));
+          SendFrame(index, id, "err", message, length, NULL);
+        }
+        return 1;
+      }
+      close(entry->dirFd);
+      entry->dirFd = fd;
+      return 0;
+    case BUILTIN_STATUS:
+      if (isCapture) {
+        if (entry->lastSignal != 0) {
+          length = sprintf(message, "terminated by signal %d\n", entry->lastSignal);
+        } else {
+          length = sprintf(message, "exit value %d\n", entry->lastStatus);
+        }
+        SendFrame(index, id, "out", message, length, NULL);
+      }
+      return 0;
+    default: /* exit, the rest of the client's lines are ignored */
+      entry->isClosing = true;
+      return 0;
+  }
+}
+
+/********************************************************************************
+* Description: LaunchRequest()
+*   This function launches a built pipeline for a client in a process group of
+*   its own, with its stdout and stderr going to capture pipes or /dev/null,
+*   and adds it to the job table. Returns an error message, or NULL if it is
+*   now running.
+********************************************************************************/
+static const char *LaunchRequest(int index, int id, struct pipeline *input, bool isCapture) {
+  struct launchOptions ends;
+  struct request *entry;
+  int outPipe[2] = {-1, -1};
+  int errPipe[2] = {-1, -1};
+  pid_t *pids;
+  pid_t pgid;
+  bool lastStarted;
+  int pidCount;
+  int request;
+  int job;
+  int i;
+
+  InitLaunchOptions(&ends);
+  ends.pipeIn = server.nullFd;
+  ends.pipeOut = server.nullFd;
+  ends.errorOut = server.nullFd;
+  ends.pgid = 0;
+  if (isCapture) {
+    if (pipe2(outPipe, O_CLOEXEC) < 0) {
+      return strerror(errno);
+    }
+    if (pipe2(errPipe, O_CLOEXEC) < 0) {
+      close(outPipe[0]);
+      close(outPipe[1]);
+      return strerror(errno);
+    }
+    fcntl(outPipe[0], F_SETFL, O_NONBLOCK); /* Only the daemon's ends */
+    fcntl(errPipe[0], F_SETFL, O_NONBLOCK);
+    ends.pipeOut = outPipe[1];
+    ends.errorOut = errPipe[1];
+  }
+  for (i = 0; i < input->stageCount; i++) {
+    input->stages[i].isForeground = false;
+  }
+
+  pids = (pid_t *) ArenaAlloc(&server.arena, input->stageCount * sizeof(pid_t));
+  pidCount = LaunchPipeline(input, &ends, pids, &pgid, &lastStarted);
+  if (isCapture) {
+    close(outPipe[1]);
+    close(errPipe[1]);
+  }
+  if (pidCount == 0) {
+    if (isCapture) {
+      close(outPipe[0]);
+      close(errPipe[0]);
+    }
+    return "could not start";
+  }
+
+  job = AddJob(pids, pidCount, pgid, false, input->timeoutMs, input->isTimed);
+  GraceJob(job, input->graceMs);
+  if (server.freeRequestCount == 0) {
+    GrowRequests();
+  }
+  if (job >= server.tableCapacity) {
+    server.tableCapacity = jobTable.jobCapacity;
+    server.tableRequests = (int *) realloc(server.tableRequests,
+                                           server.tableCapacity * sizeof(int));
+  }
+  request = server.freeRequests[--server.freeRequestCount];
+  server.tableRequests[job] = request;
+  server.requestCount++;
+  server.clients[index].running++;
+
+  entry = &server.requests[request];
+  memset(entry, 0, sizeof(*entry));
+  entry->client = index;
+  entry->id = id;
+  entry->job = job;
+  entry->outFd = outPipe[0];
+  entry->errFd = errPipe[0];
+  entry->lastStarted = lastStarted;
+  entry->isTimed = jobTable.jobs[job].isTimed;
+  MergeLimits(input->stages[input->stageCount - 1].limits, &entry->limits);
+  entry->isUsed = true;
+  if (isCapture) {
+    Watch(entry->outFd, EPOLLIN, EVENT_OUT, request, true);
+    Watch(entry->errFd, EPOLLIN, EVENT_ERR, request, true);
+  }
+  return NULL;
+}
+
+/********************************************************************************
+* Description: HandleRequest()
+*   This function runs one request line from a client, in the client's working
+*   directory and with its $?. The line is tokenized in place. Requests that
+*   finish at once, such as cd or a syntax error, get their final frame here.
+********************************************************************************/
+static void HandleRequest(int index, int id, char *line) {
+  struct client *entry = &server.clients[index];
+  struct pipeline input;
+  const char *error = NULL;
+  char detail[128];
+  bool isCapture;
+  bool isParsed;
+  int result;
+  int i;
+
+  if (strncmp(line, "run ", 4) == 0) {
+    isCapture = false;
+    line += 4;
+  } else if (strncmp(line, "capture ", 8) == 0) {
+    isCapture = true;
+    line += 8;
+  } else {
+    SendFrame(index, id, "error", NULL, 0, " expected \"run\" or \"capture\"");
+    return;
+  }
+
+  fchdir(entry->dirFd);
+  SetLastStatus(entry->lastStatus);
+  if (line[strspn(line, " \t")] == '\0' || IsComment(line)) {
+    SendFrame(index, id, "exit", NULL, 0, " 0");
+    return;
+  }
+  TRACE('B', "parse", NULL, 0);
+  isParsed = CreatePipeline(line, &input, &server.arena);
+  TRACE('E', "parse", NULL, 0);
+  if (!isParsed) {
+    error = "syntax error";
+  } else if (input.stageCount == 1 && input.stages[0].builtin != NULL &&
+             (input.stages[0].builtin->id == BUILTIN_CD ||
+              input.stages[0].builtin->id == BUILTIN_STATUS ||
+              input.stages[0].builtin->id == BUILTIN_EXIT)) {
+    result = SessionBuiltin(index, id, &input.stages[0], isCapture);
+    entry->lastStatus = result;
+    entry->lastSignal = 0;
+    snprintf(detail, sizeof(detail), " %d", result);
+    SendFrame(index, id, "exit", NULL, 0, detail);
+  } else {
+    /* The builtins that change the shell have no meaning in a daemon */
+    for (i = 0; i < input.stageCount && error == NULL; i++) {
+      if (input.stages[i].builtin != NULL && input.stages[i].builtin->run == NULL) {
+        error = "builtin cannot be used over the socket";
+      }
+    }
+    if (error == NULL) {
+      error = LaunchRequest(index, id, &input, isCapture);
+    }
+  }
+  ResetArena(&server.arena);
+
+  if (error != NULL) {
+    entry->lastStatus = 1;
+    entry->lastSignal = 0;
+    snprintf(detail, sizeof(detail), " %s", error);
+    SendFrame(index, id, "error", NULL, 0, detail);
+  }
+}
+
+/********************************************************************************
+* Description: ReadClient()
+*   This function reads what a client has sent and runs every whole line in
+*   it. End of file means the client is done sending, and it is closed once
+*   its requests have all been answered. A line that is too long closes it.
+********************************************************************************/
+static void ReadClient(int index) {
+  struct client *entry = &server.clients[index];
+  ssize_t count;
+  char *line;
+  char *newline;
+  size_t used;
+  int id;
+
+  if (entry->inSize - entry->inLength < READ_SIZE) {
+    entry->inSize = entry->inLength + READ_SIZE;
+    entry->in = (char *) realloc(entry->in, entry->inSize + 1);
+  }
+  count = read(entry->fd, entry->in + entry->inLength, entry->inSize - entry->inLength);
+  if (count < 0 && (errno == EAGAIN || errno == EINTR)) {
+    return;
+  }
+  if (count < 0) {
+    DropClient(index);
+    return;
+  }
+  entry->inLength += count;
+  if (count == 0 && entry->inLength > 0) {
+    entry->in[entry->inLength++] = '\n'; /* A last line without a newline still runs */
+  }
+
+  /* Run each whole line, NUL terminating it where its newline was. A request */
+  /* can close the client, or after "exit" stop reading from it */
+  line = entry->in;
+  while (entry->fd >= 0 && !entry->isClosing &&
+         (newline = memchr(line, '\n', entry->inLength - (line - entry->in))) != NULL) {
+    *newline = '\0';
+    id = entry->nextId++;
+    TRACE('B', "request", NULL, 0);
+    HandleRequest(index, id, line);
+    TRACE('E', "request", "id", id);
+    line = newline + 1;
+  }
+  if (entry->fd < 0) {
+    return;
+  }
+  used = line - entry->in;
+  memmove(entry->in, line, entry->inLength - used);
+  entry->inLength -= used;
+
+  if (entry->inLength > REQUEST_LIMIT) {
+    SendFrame(index, entry->nextId++, "error", NULL, 0, " request too long");
+    entry->isClosing = true;
+  } else if (count == 0) {
+    entry->isClosing = true;
+  }
+  if (entry->fd >= 0 && entry->isClosing) {
+    entry->inLength = 0; /* Nothing more is read */
+    WatchClient(index);
+    if (entry->running == 0 && entry->outLength == 0) {
+      DropClient(index);
+    }
+  }
+}
+
+/********************************************************************************
+* Description: AcceptClients()
+*   This function accepts every connection that is waiting. A new client
+*   starts in the directory the daemon was started in, with a $? of 0.
+********************************************************************************/
+static void AcceptClients(void) {
+  struct client *entry;
+  int index;
+  int fd;
+
+  while ((fd = accept4(server.listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+    if (server.freeClientCount == 0) {
+      GrowClients();
+    }
+    index = server.freeClients[--server.freeClientCount];
+    entry = &server.clients[index];
+    memset(entry, 0, sizeof(*entry));
+    entry->fd = fd;
+    entry->dirFd = fcntl(server.startDirFd, F_DUPFD_CLOEXEC, 0);
+    entry->nextId = 1;
+    entry->isUsed = true;
+    Watch(fd, EPOLLIN, EVENT_CLIENT, index, true);
+  }
+  if (errno == EMFILE || errno == ENFILE) {
+    perror("accept4()"); /* The connection waits until a descriptor is free */
+  }
+}
+
+/********************************************************************************
+* Description: Stop()
+*   This function handles a shutdown signal. The first one stops new
+*   connections and asks every job to terminate, and a second one kills them.
+********************************************************************************/
+static void Stop(void) {
+  struct signalfd_siginfo info;
+
+  while (read(server.signalFd, &info, sizeof(info)) > 0) {
+    server.stopSignals++;
+  }
+  if (server.listenFd >= 0) {
+    close(server.listenFd);
+    server.listenFd = -1;
+  }
+  SignalJobs(server.stopSignals > 1 ? SIGKILL : SIGTERM);
+}
+
+/********************************************************************************
+* Description: OpenSocket()
+*   This function creates the listening socket at path. A socket already there
+*   is replaced unless a daemon is still answering on it, and anything else
+*   there is left alone. Returns the descriptor, or -1 after printing an error.
+********************************************************************************/
+static int OpenSocket(const char *path) {
+  struct sockaddr_un address = {0};
+  struct stat info;
+  int fd;
+
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "%s: socket path too long\n", path);
+    return -1;
+  }
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, path);
+
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    perror("socket()");
+    return -1;
+  }
+  if (lstat(path, &info) == 0 && S_ISSOCK(info.st_mode)) {
+    if (connect(fd, (struct sockaddr *) &address, sizeof(address)) == 0 || errno == EAGAIN) {
+      fprintf(stderr, "%s: already being served\n", path);
+      close(fd);
+      return -1;
+    }
+    close(fd);
+    unlink(path); /* Left behind by a daemon that is gone */
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  }
+  if (bind(fd, (struct sockaddr *) &address, sizeof(address)) < 0 ||
+      listen(fd, SOMAXCONN) < 0) {
+    perror(path);
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/********************************************************************************
+* Description: Serve()
+*   This function responds to "smallsh --serve path". It listens on path and
+*   runs the requests of every client that connects until it gets SIGTERM,
+*   SIGINT or SIGHUP and its jobs have finished. The soft limit on open files
+*   is raised to the hard one, since every job that is captured holds two
+*   pipes. Returns the exit value for the shell.
+********************************************************************************/
+int Serve(const char *path) {
+  struct epoll_event events[SERVER_EVENTS];
+  struct sigaction restore_action = {{0}};
+  struct rlimit files;
+  sigset_t stopMask;
+  sigset_t oldMask;
+  enum serverEvent type;
+  int index;
+  int count;
+  int i;
+
+  if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max) {
+    files.rlim_cur = files.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &files);
+  }
+
+  /* The shell ignores SIGINT, but an ignored signal never reaches a signalfd */
+  restore_action.sa_handler = SIG_DFL;
+  sigaction(SIGINT, &restore_action, NULL);
+  sigemptyset(&stopMask);
+  sigaddset(&stopMask, SIGTERM);
+  sigaddset(&stopMask, SIGINT);
+  sigaddset(&stopMask, SIGHUP);
+  sigprocmask(SIG_BLOCK, &stopMask, NULL);
+  BlockChildSignal(&oldMask);
+
+  server.listenFd = OpenSocket(path);
+  if (server.listenFd < 0) {
+    return 1;
+  }
+  server.epollFd = epoll_create1(EPOLL_CLOEXEC);
+  server.signalFd = signalfd(-1, &stopMask, SFD_NONBLOCK | SFD_CLOEXEC);
+  server.nullFd = open("/dev/null", O_RDWR | O_CLOEXEC);
+  server.startDirFd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+  InitArena(&server.arena);
+  Watch(server.listenFd, EPOLLIN, EVENT_LISTEN, 0, true);
+  Watch(server.signalFd, EPOLLIN, EVENT_SIGNAL, 0, true);
+  Watch(jobTable.supervisorFd, EPOLLIN, EVENT_SUPERVISOR, 0, true);
+
+  while (server.listenFd >= 0 || server.requestCount > 0) {
+    count = epoll_wait(server.epollFd, events, SERVER_EVENTS, -1);
+    if (count < 0 && errno != EINTR) {
+      perror("epoll_wait()");
+      break;
+    }
+    for (i = 0; i < count; i++) {
+      type = (enum serverEvent) (events[i].data.u64 >> 32);
+      index = (int) (uint32_t) events[i].data.u64;
+      switch (type) {
+        case EVENT_LISTEN:
+          if (server.listenFd >= 0) {
+            AcceptClients();
+          }
+          break;
+        case EVENT_SIGNAL:
+          Stop();
+          break;
+        case EVENT_SUPERVISOR:
+          CollectJobs();
+          break;
+        case EVENT_CLIENT:
+          /* A slot freed earlier in this batch may have an old event */
+          if (!server.clients[index].isUsed || server.clients[index].fd < 0) {
+            break;
+          }
+          if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+            DropClient(index);
+          } else if (events[i].events & EPOLLIN) {
+            ReadClient(index);
+          } else if (events[i].events & EPOLLOUT) {
+            FlushClient(index);
+          }
+          break;
+        case EVENT_OUT:
+        case EVENT_ERR:
+          ReadCapture(index, type);
+          break;
+      }
+    }
+  }
+
+  /* Give every client what is left of its replies, then close it */
+  for (i = 0; i < server.clientCapacity; i++) {
+    if (server.clients[i].isUsed && server.clients[i].fd >= 0) {
+      FlushClient(i);
+      DropClient(i);
+    }
+  }
+  if (server.listenFd >= 0) {
+    close(server.listenFd);
+  }
+  unlink(path);
+  RestoreChildSignal(&oldMask);
+  FreeArena(&server.arena);
+  return 0;
+}
@@ -0,0 +1,14 @@
+/********************************************************************************
+* Program Name: Server.h
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: Header file for Server.c. "smallsh --serve path" runs command
+*   lines sent by local clients over a Unix socket.
+********************************************************************************/
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "CommandLine.h"
+
+int Serve(const char *path);
+#endif
@@ -0,0 +1,463 @@
+/********************************************************************************
+* Program Name: Spawn.c
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: This is the set of functions that start an external command for
+*   smallsh. The default path uses posix_spawn so that the shell's page tables
+*   are never copied, with fork() kept as a fallback.
+********************************************************************************/
+#include "Spawn.h"
+#include "Builtins.h"
+#include "Limits.h"
+#include "PathCache.h"
+#include "Trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/stat.h>
+
+#define PIPE_BUFFER_SIZE (1024 * 1024) /* Requested capacity of pipes between stages */
+
+/* glibc 2.35 added a file action that hands the terminal to the new group */
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 35)
+#define SPAWN_SETS_TERMINAL true
+#else
+#define SPAWN_SETS_TERMINAL false
+#endif
+
+extern char **environ;
+
+enum spawnMode spawnMode = SPAWN_POSIX;
+
+/* Runs a builtin in a forked copy of the shell, set by SetForkedBuiltin() */
+static int (*runForked)(struct command *input) = NULL;
+
+/********************************************************************************
+* Description: SetSpawnMode()
+*   This function selects the launch path by name. "fork" selects the fork()
+*   path, anything else (including NULL) selects posix_spawn.
+********************************************************************************/
+void SetSpawnMode(const char *name) {
+  if (name != NULL && strcmp(name, "fork") == 0) {
+    spawnMode = SPAWN_FORK;
+  } else {
+    spawnMode = SPAWN_POSIX;
+  }
+}
+
+/********************************************************************************
+* Description: SetForkedBuiltin()
+*   This function sets how a builtin that only reads the shell, such as
+*   "history", is run as a pipeline stage: by a fork of the shell, which has
+*   a copy of everything it reads, calling run and exiting with its result.
+********************************************************************************/
+void SetForkedBuiltin(int (*run)(struct command *input)) {
+  runForked = run;
+}
+
+/********************************************************************************
+* Description: CloseRedirects()
+*   This function closes the descriptors opened by OpenRedirects(). Pipe ends
+*   belong to the caller and are left open.
+********************************************************************************/
+static void CloseRedirects(struct launchOptions *options, int fdI, int fdO) {
+  if (fdI >= 0 && fdI != options->pipeIn) {
+    close(fdI);
+  }
+  if (fdO >= 0 && fdO != options->pipeOut) {
+    close(fdO);
+  }
+}
+
+/********************************************************************************
+* Description: InitLaunchOptions()
+*   This function sets launch options for a plain command: no pipes, the
+*   shell's stderr and left in the shell's process group, which keeps the
+*   terminal. Commands start in the shell's own directory.
+********************************************************************************/
+void InitLaunchOptions(struct launchOptions *options) {
+  options->pipeIn = -1;
+  options->pipeOut = -1;
+  options->errorOut = -1;
+  options->pgid = -1;
+  options->takesTerminal = false;
+}
+
+/********************************************************************************
+* Description: OpenInputFile()
+*   This function opens a "<" file with O_CLOEXEC. Returns -1 and prints an
+*   error if it cannot be opened.
+********************************************************************************/
+static int OpenInputFile(const char *path) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    perror(path);
+  }
+  return fd;
+}
+
+/********************************************************************************
+* Description: OpenOutputFile()
+*   This function creates or truncates a ">" file with O_CLOEXEC. Returns -1
+*   and prints an error if it cannot be opened.
+********************************************************************************/
+static int OpenOutputFile(const char *path) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+  if (fd < 0) {
+    perror(path);
+  }
+  return fd;
+}
+
+/********************************************************************************
+* Description: OpenRedirects()
+*   This function opens the files a command reads from and writes to. A file
+*   redirect takes precedence over a pipe. Background commands with neither
+*   get /dev/null. The descriptors are opened in the shell with O_CLOEXEC so
+*   that only the dup2'd copies survive into the command. Returns -1 and
+*   prints an error if a file cannot be opened.
+********************************************************************************/
+static int OpenRedirects(struct command *input, struct launchOptions *options,
+                         int *fdI, int *fdO) {
+  const char *nullDir = "/dev/null";
+
+  *fdI = -1;
+  *fdO = -1;
+
+  /* Input redirection, defaulting to /dev/null for background commands */
+  if (input->isInputRedirect) {
+    *fdI = OpenInputFile(input->inputFile);
+    if (*fdI < 0) {
+      return -1;
+    }
+  } else if (options->pipeIn >= 0) {
+    *fdI = options->pipeIn;
+  } else if (!input->isForeground) {
+    *fdI = open(nullDir, O_RDONLY | O_CLOEXEC);
+  }
+
+  /* Output redirection, defaulting to /dev/null for background commands */
+  if (input->isOutputRedirect) {
+    *fdO = OpenOutputFile(input->outputFile);
+    if (*fdO < 0) {
+      CloseRedirects(options, *fdI, -1);
+      return -1;
+    }
+  } else if (options->pipeOut >= 0) {
+    *fdO = options->pipeOut;
+  } else if (!input->isForeground) {
+    *fdO = open(nullDir, O_WRONLY | O_CLOEXEC);
+  }
+  return 0;
+}
+
+/********************************************************************************
+* Description: SpawnPosix()
+*   This function launches the program at path with posix_spawn. The
+*   redirections, the process group, the SIGINT reset and the signal mask are
+*   all described through file actions and attributes, so no child code runs
+*   in the shell's address space. A group that takes the terminal is made its
+*   foreground before any redirection, while fd 0 is still the shell's own.
+*   Returns the errno value from posix_spawn.
+********************************************************************************/
+static int SpawnPosix(struct command *input, const char *path, struct launchOptions *options,
+                      int fdI, int fdO, pid_t *pid) {
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  sigset_t signals;
+  short flags = POSIX_SPAWN_SETSIGMASK;
+  int result;
+
+  posix_spawn_file_actions_init(&actions);
+  posix_spawnattr_init(&attr);
+
+#if SPAWN_SETS_TERMINAL
+  if (options->takesTerminal) {
+    posix_spawn_file_actions_addtcsetpgrp_np(&actions, STDIN_FILENO);
+  }
+#endif
+  if (fdI >= 0) {
+    posix_spawn_file_actions_adddup2(&actions, fdI, 0);
+  }
+  if (fdO >= 0) {
+    posix_spawn_file_actions_adddup2(&actions, fdO, 1);
+  }
+  if (options->errorOut >= 0) {
+    posix_spawn_file_actions_adddup2(&actions, options->errorOut, 2);
+  }
+  if (options->pgid >= 0) {
+    posix_spawnattr_setpgroup(&attr, options->pgid);
+    flags |= POSIX_SPAWN_SETPGROUP;
+  }
+
+  /* The shell ignores SIGINT and SIGTTOU, commands get SIGTTOU back, and */
+  /* foreground commands and those in a group of their own get SIGINT back */
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGTTOU);
+  if (input->isForeground || options->pgid >= 0) {
+    sigaddset(&signals, SIGINT);
+  }
+  posix_spawnattr_setsigdefault(&attr, &signals);
+  flags |= POSIX_SPAWN_SETSIGDEF;
+  sigemptyset(&signals);
+  posix_spawnattr_setsigmask(&attr, &signals);
+  posix_spawnattr_setflags(&attr, flags);
+
+  result = posix_spawn(pid, path, &actions, &attr, input->args, environ);
+
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&actions);
+  return result;
+}
+
+/********************************************************************************
+* Description: SpawnFork()
+*   This function launches the command with fork() and performs the same
+*   redirections, process group, terminal handoff and SIGINT reset in the
+*   child, and sets its resource limits, before calling execv on path. If the
+*   cached path has gone away, the child falls back to searching PATH with
+*   execvp. A NULL path runs the command's builtin in the child instead.
+*   Returns 0 or the errno value from fork().
+********************************************************************************/
+static int SpawnFork(struct command *input, const char *path, struct launchOptions *options,
+                     int fdI, int fdO, pid_t *pid) {
+  struct sigaction restore_action = {{0}};
+  sigset_t signals;
+  int result;
+
+  *pid = fork();
+  if (*pid < 0) {
+    return errno;
+  } else if (*pid > 0) {
+    /* Set the group from both sides so it exists before either one uses it */
+    if (options->pgid >= 0) {
+      setpgid(*pid, options->pgid);
+    }
+    return 0;
+  }
+
+  if (options->pgid >= 0) {
+    setpgid(0, options->pgid);
+  }
+  if (options->takesTerminal) {
+    tcsetpgrp(STDIN_FILENO, getpgrp()); /* SIGTTOU is still ignored here */
+  }
+  if (fdI >= 0 && dup2(fdI, 0) < 0) {
+    perror("dup2()");
+    _exit(1);
+  }
+  if (fdO >= 0 && dup2(fdO, 1) < 0) {
+    perror("dup2()");
+    _exit(1);
+  }
+  if (options->errorOut >= 0 && dup2(options->errorOut, 2) < 0) {
+    perror("dup2()");
+    _exit(1);
+  }
+  if (ApplyLimits(input->limits) < 0) {
+    perror("setrlimit()"); /* Never run a command without the limits it was given */
+    _exit(1);
+  }
+  restore_action.sa_handler = SIG_DFL;
+  sigaction(SIGTTOU, &restore_action, NULL);
+  if (input->isForeground || options->pgid >= 0) {
+    sigaction(SIGINT, &restore_action, NULL);
+  }
+  sigemptyset(&signals);
+  sigprocmask(SIG_SETMASK, &signals, NULL);
+
+  if (path == NULL) { /* A builtin, which runs in this copy of the shell */
+    result = runForked(input);
+    fflush(stdout);
+    _exit(result < 0 ? 128 - result : result);
+  }
+  execv(path, input->args);
+  if (path != input->args[0]) {
+    execvp(input->args[0], input->args);
+  }
+  perror(input->args[0]);
+  _exit(1);
+}
+
+/********************************************************************************
+* Description: LaunchCommand()
+*   This function starts an external command and returns its PID, or -1 after
+*   printing an error if the redirect files could not be opened or the program
+*   could not be started. The program is found through the PATH cache, and a
+*   cached path that no longer exists is dropped and searched for again. If
+*   posix_spawn is not usable on this system, the fork() path is selected for the
+*   rest of the session. A command with resource limits always takes the fork()
+*   path, and so does a builtin the shell left in a pipeline, as well as a job
+*   that takes the terminal where posix_spawn cannot hand it over.
+********************************************************************************/
+pid_t LaunchCommand(struct command *input, struct launchOptions *options) {
+  const char *path;
+  pid_t pid = -1;
+  int fdI;
+  int fdO;
+  int result = ENOENT;
+  bool needsFork;
+
+  if (OpenRedirects(input, options, &fdI, &fdO) < 0) {
+    return -1;
+  }
+  fflush(stdout); /* Keep the shell's buffered output ahead of the command's */
+  TRACE('B', "spawn", NULL, 0);
+
+  /* posix_spawn cannot set resource limits, so a limited command is forked */
+  /* along with one whose terminal handoff it cannot describe */
+  needsFork = HasLimits(input->limits) || (options->takesTerminal && !SPAWN_SETS_TERMINAL);
+  if (input->builtin != NULL && input->builtin->run == NULL && runForked != NULL) {
+    path = NULL; /* Never a program of the same name, so PATH is not searched */
+    result = SpawnFork(input, NULL, options, fdI, fdO, &pid);
+  } else {
+    path = LookupCommand(input->args[0]);
+  }
+  if (path != NULL && spawnMode == SPAWN_POSIX && !needsFork) {
+    result = SpawnPosix(input, path, options, fdI, fdO, &pid);
+    if (result == ENOENT && path != input->args[0]) {
+      ForgetCommand(input->args[0]);
+      path = LookupCommand(input->args[0]);
+      if (path != NULL) {
+        result = SpawnPosix(input, path, options, fdI, fdO, &pid);
+      }
+    } else if (result == ENOSYS) {
+      spawnMode = SPAWN_FORK;
+    }
+  }
+  if (path != NULL && (spawnMode == SPAWN_FORK || needsFork)) {
+    result = SpawnFork(input, path, options, fdI, fdO, &pid);
+  }
+
+  CloseRedirects(options, fdI, fdO);
+  TRACE('E', "spawn", "pid", result == 0 ? pid : -1);
+
+  if (result != 0) {
+    errno = result;
+    perror(input->args[0]);
+    return -1;
+  }
+  return pid;
+}
+
+/********************************************************************************
+* Description: LaunchPipeline()
+*   This function launches every stage of a pipeline. A pipeline of two or more
+*   stages gets one process group, led by the first stage that starts, and
+*   neighbouring stages are connected with pipe2(O_CLOEXEC) pipes. ends gives
+*   the outside of the pipeline: pipeIn is the first stage's stdin and pipeOut
+*   the last stage's stdout when they have no redirect, errorOut is every
+*   stage's stderr, a pgid of 0 puts even a single stage in a group of its
+*   own, and takesTerminal gives the group the terminal. The PIDs that
+*   started are stored in pids and their number is returned; lastStarted
+*   tells whether the last stage was one of them. The descriptors in ends
+*   stay open. SIGCHLD must be blocked.
+********************************************************************************/
+int LaunchPipeline(struct pipeline *input, struct launchOptions *ends,
+                   pid_t *pids, pid_t *pgid, bool *lastStarted) {
+  struct launchOptions options;
+  pid_t pid;
+  int pidCount = 0;
+  int pipeFds[2];
+  int firstIn = ends->pipeIn;
+  int readEnd = firstIn;
+  int last = input->stageCount - 1;
+  int i;
+
+  InitLaunchOptions(&options);
+  options.errorOut = ends->errorOut;
+  options.takesTerminal = ends->takesTerminal;
+  *pgid = input->stageCount > 1 || ends->pgid == 0 ? 0 : -1;
+  *lastStarted = false;
+
+  for (i = 0; i < input->stageCount; i++) {
+    options.pipeIn = readEnd;
+    options.pipeOut = i == last ? ends->pipeOut : -1;
+    if (i < last) {
+      if (pipe2(pipeFds, O_CLOEXEC) < 0) {
+        perror("pipe2()");
+        break;
+      }
+      fcntl(pipeFds[1], F_SETPIPE_SZ, PIPE_BUFFER_SIZE); /* Best effort */
+      options.pipeOut = pipeFds[1];
+    }
+    options.pgid = *pgid; /* The first stage to start leads the group */
+
+    pid = LaunchCommand(&input->stages[i], &options);
+    if (pid > 0) {
+      pids[pidCount++] = pid;
+      *lastStarted = i == last;
+      if (*pgid == 0) {
+        *pgid = pid;
+      }
+    }
+
+    /* The shell keeps only the read end that feeds the next stage */
+    if (readEnd >= 0 && readEnd != firstIn) {
+      close(readEnd);
+    }
+    readEnd = -1;
+    if (i < last) {
+      close(pipeFds[1]);
+      readEnd = pipeFds[0];
+    }
+  }
+  if (readEnd >= 0 && readEnd != firstIn) {
+    close(readEnd);
+  }
+  return pidCount;
+}
+
+/********************************************************************************
+* Description: SwapRedirects()
+*   This function points the shell's own stdin and stdout at a builtin's "<"
+*   and ">" files, keeping copies of the originals in saved. Unlike a launched
+*   command, a builtin has no /dev/null default. Returns -1 and prints an error
+*   if a file cannot be opened, with nothing swapped.
+********************************************************************************/
+int SwapRedirects(struct command *input, struct savedFds *saved) {
+  int fdI = -1;
+  int fdO = -1;
+
+  saved->stdinFd = -1;
+  saved->stdoutFd = -1;
+  if (input->isInputRedirect && (fdI = OpenInputFile(input->inputFile)) < 0) {
+    return -1;
+  }
+  if (input->isOutputRedirect && (fdO = OpenOutputFile(input->outputFile)) < 0) {
+    if (fdI >= 0) {
+      close(fdI);
+    }
+    return -1;
+  }
+
+  fflush(stdout); /* Earlier output belongs to the original stdout */
+  if (fdI >= 0) {
+    saved->stdinFd = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);
+    dup2(fdI, STDIN_FILENO);
+    close(fdI);
+  }
+  if (fdO >= 0) {
+    saved->stdoutFd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+    dup2(fdO, STDOUT_FILENO);
+    close(fdO);
+  }
+  return 0;
+}
+
+/********************************************************************************
+* Description: RestoreRedirects()
+*   This function puts back the stdin and stdout saved by SwapRedirects().
+********************************************************************************/
+void RestoreRedirects(struct savedFds *saved) {
+  fflush(stdout); /* The builtin's output belongs to the file */
+  if (saved->stdinFd >= 0) {
+    dup2(saved->stdinFd, STDIN_FILENO);
+    close(saved->stdinFd);
+  }
+  if (saved->stdoutFd >= 0) {
+    dup2(saved->stdoutFd, STDOUT_FILENO);
+    close(saved->stdoutFd);
+  }
+}
@@ -0,0 +1,43 @@
+/********************************************************************************
+* Program Name: Spawn.h
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: Header file for Spawn.c. Functions that launch an external
+*   command built by CommandLine.c, either through posix_spawn or through the
+*   original fork()/exec path, and that redirect a builtin run in the shell.
+********************************************************************************/
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include "CommandLine.h"
+#include <sys/types.h>
+
+enum spawnMode {
+  SPAWN_POSIX, /* posix_spawn, which glibc implements with clone(CLONE_VM|CLONE_VFORK) */
+  SPAWN_FORK   /* fork() and do the redirections in the child */
+};
+
+struct launchOptions {
+  int pipeIn;             /* Pipe read end to use as stdin, -1 for none */
+  int pipeOut;            /* Pipe write end to use as stdout, -1 for none */
+  int errorOut;           /* Descriptor to use as stderr, -1 for the shell's */
+  pid_t pgid;             /* Process group to join, 0 to lead a new one, -1 for the shell's */
+  bool takesTerminal;     /* Make the group the terminal's foreground before the program runs */
+};
+
+struct savedFds {         /* The shell's own descriptors while a builtin is redirected */
+  int stdinFd;            /* Copy of the original stdin, -1 if it was not swapped */
+  int stdoutFd;           /* Copy of the original stdout, -1 if it was not swapped */
+};
+
+extern enum spawnMode spawnMode;
+
+void SetSpawnMode(const char *name);
+void SetForkedBuiltin(int (*run)(struct command *input));
+void InitLaunchOptions(struct launchOptions *options);
+pid_t LaunchCommand(struct command *input, struct launchOptions *options);
+int LaunchPipeline(struct pipeline *input, struct launchOptions *ends,
+                   pid_t *pids, pid_t *pgid, bool *lastStarted);
+int SwapRedirects(struct command *input, struct savedFds *saved);
+void RestoreRedirects(struct savedFds *saved);
+#endif
@@ -0,0 +1,128 @@
+/********************************************************************************
+* Program Name: Trace.c
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: This is the set of functions behind SMALLSH_TRACE. When it
+*   names a file, every phase of every command (reading the line, parsing it,
+*   spawning each stage, running a builtin, waiting for the job and reaping
+*   each child) is recorded with its CLOCK_MONOTONIC time in a ring buffer,
+*   and the buffer is written to the file as Chrome Trace Event JSON when the
+*   shell exits, ready for chrome://tracing or Perfetto. The buffer holds
+*   SMALLSH_TRACE_EVENTS events, 262144 by default, and a longer run keeps
+*   the newest.
+*
+*   A slot is claimed with one atomic add on the head, so the SIGCHLD handler
+*   can record a reap in the middle of any other event without a lock. Each
+*   writer fills only the slot it claimed.
+********************************************************************************/
+#include "Trace.h"
+#include <signal.h>
+#include <time.h>
+
+#define TRACE_DEFAULT_EVENTS (1ul << 18)
+
+struct traceBuffer traceBuffer = {NULL, 0, 0, NULL, 0};
+
+/********************************************************************************
+* Description: InitTrace()
+*   This function turns tracing on, writing to path at exit. capacity, unless
+*   it is NULL, is the number of events to keep, rounded up to a power of two.
+*   Returns false with nothing changed if the buffer cannot be allocated.
+********************************************************************************/
+bool InitTrace(const char *path, const char *capacity) {
+  unsigned long wanted = TRACE_DEFAULT_EVENTS;
+  unsigned long size = 1;
+
+  if (capacity != NULL && atol(capacity) > 0) {
+    wanted = (unsigned long) atol(capacity);
+  }
+  while (size < wanted) {
+    size <<= 1;
+  }
+  traceBuffer.events = (struct traceEvent *) malloc(size * sizeof(struct traceEvent));
+  if (traceBuffer.events == NULL) {
+    return false;
+  }
+  traceBuffer.capacity = size;
+  traceBuffer.head = 0;
+  traceBuffer.path = path;
+  traceBuffer.ownerPid = (int) getpid();
+  atexit(FlushTrace);
+  return true;
+}
+
+/********************************************************************************
+* Description: TraceEvent()
+*   This function records one event. Call it through TRACE(), which skips it
+*   while tracing is off. It is async-signal-safe.
+********************************************************************************/
+void TraceEvent(char phase, const char *name, const char *argName, long arg) {
+  struct traceEvent *event;
+  struct timespec now;
+  unsigned long slot;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  slot = __atomic_fetch_add(&traceBuffer.head, 1, __ATOMIC_RELAXED);
+  event = &traceBuffer.events[slot & (traceBuffer.capacity - 1)];
+  event->ns = now.tv_sec * 1000000000LL + now.tv_nsec;
+  event->name = name;
+  event->argName = argName;
+  event->arg = arg;
+  event->phase = phase;
+}
+
+/********************************************************************************
+* Description: FlushTrace()
+*   This function writes the buffered events to the trace file, oldest first,
+*   and turns tracing off. It runs at exit. Times are in microseconds, as the
+*   format wants, with the nanoseconds kept as decimals.
+********************************************************************************/
+void FlushTrace(void) {
+  struct traceEvent *event;
+  sigset_t allSignals;
+  sigset_t oldMask;
+  unsigned long first;
+  unsigned long i;
+  FILE *output;
+  int pid = (int) getpid();
+
+  if (traceBuffer.events == NULL || pid != traceBuffer.ownerPid) {
+    return;
+  }
+  /* A reap recorded now could land in a slot that is being written out */
+  sigfillset(&allSignals);
+  sigprocmask(SIG_BLOCK, &allSignals, &oldMask);
+
+  output = fopen(traceBuffer.path, "w");
+  if (output == NULL) {
+    perror(traceBuffer.path);
+  } else {
+    first = traceBuffer.head > traceBuffer.capacity ?
+            traceBuffer.head - traceBuffer.capacity : 0;
+    fprintf(output, "{\"traceEvents\":[\n");
+    for (i = first; i < traceBuffer.head; i++) {
+      event = &traceBuffer.events[i & (traceBuffer.capacity - 1)];
+      fprintf(output, "%s{\"name\":\"%s\",\"cat\":\"smallsh\",\"ph\":\"%c\","
+              "\"ts\":%lld.%03lld,\"pid\":%d,\"tid\":%d",
+              i == first ? "" : ",\n", event->name, event->phase,
+              event->ns / 1000, event->ns % 1000, pid, pid);
+      if (event->phase == 'b' || event->phase == 'e') {
+        fprintf(output, ",\"id\":%ld", event->arg);
+      } else if (event->argName != NULL) {
+        fprintf(output, ",\"args\":{\"%s\":%ld}", event->argName, event->arg);
+      }
+      if (event->phase == 'i') {
+        fprintf(output, ",\"s\":\"t\"");
+      }
+      fprintf(output, "}");
+    }
+    fprintf(output, "\n],\"displayTimeUnit\":\"ns\",\"otherData\":{\"events\":%lu,"
+            "\"dropped\":%lu}}\n", traceBuffer.head, first);
+    if (fclose(output) != 0) {
+      perror(traceBuffer.path);
+    }
+  }
+  free(traceBuffer.events);
+  traceBuffer.events = NULL;
+  sigprocmask(SIG_SETMASK, &oldMask, NULL);
+}
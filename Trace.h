@@ -0,0 +1,44 @@
+/********************************************************************************
+* Program Name: Trace.h
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: Header file for Trace.c. An opt-in ring buffer of timestamped
+*   events for each phase of every command, written out as Chrome Trace Event
+*   JSON when the shell exits.
+********************************************************************************/
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "CommandLine.h"
+
+struct traceEvent {
+  long long ns;          /* CLOCK_MONOTONIC */
+  const char *name;      /* A string constant, the buffer outlives every command */
+  const char *argName;   /* Name of arg in the event's args, NULL for none */
+  long arg;              /* For 'b' and 'e' the id pairing the two */
+  char phase;            /* Chrome phase: 'B' begin, 'E' end, 'i' instant, 'b'/'e' async */
+};
+
+struct traceBuffer {
+  struct traceEvent *events; /* NULL while tracing is off */
+  unsigned long capacity;    /* Always a power of two */
+  unsigned long head;        /* Events ever recorded, the oldest are overwritten */
+  const char *path;          /* Where the JSON is written at exit */
+  int ownerPid;              /* Only this process writes it, not a forked child */
+};
+
+extern struct traceBuffer traceBuffer;
+
+/* Records an event only while tracing is on, so a shell that is not tracing */
+/* pays one predictable branch per event and never evaluates the arguments */
+#define TRACE(phase, name, argName, arg) \
+  do { \
+    if (traceBuffer.events != NULL) { \
+      TraceEvent((phase), (name), (argName), (arg)); \
+    } \
+  } while (0)
+
+bool InitTrace(const char *path, const char *capacity);
+void TraceEvent(char phase, const char *name, const char *argName, long arg);
+void FlushTrace(void);
+#endif
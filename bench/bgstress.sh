@@ -0,0 +1,38 @@
+#!/bin/sh
+################################################################################
+# Program Name: bgstress.sh
+# Author: Mathew Kagel
+# Date: 2026-10-16
+# Description: Background job stress test for smallsh. One script starts
+#   hundreds of concurrent "sleep" jobs, then sleeps in the foreground until
+#   they have all finished. Prints how long the launches took, the total run
+#   time past the sleep, and how many completions were reported, which must
+#   equal the number of jobs.
+#   Usage: bench/bgstress.sh [jobs] [sleep seconds]
+################################################################################
+
+SHELL_BIN=${SMALLSH:-./smallsh}
+JOBS=${1:-500}
+SLEEP=${2:-1}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+export SMALLSH_SCRIPT_CACHE="${SMALLSH_SCRIPT_CACHE-$WORK/cache}" # Keeps ~/.cache clean
+
+# The launches are timed from the shell's start to the "date" after the last one
+awk -v n="$JOBS" -v s="$SLEEP" -v w="$WORK" 'BEGIN {
+  for (i = 0; i < n; i++) print "sleep " s " &"
+  print "date +%s.%N > " w "/launched"
+  print "sleep " s + 0.5 }' > "$WORK/script"
+
+start=$(date +%s.%N)
+"$SHELL_BIN" "$WORK/script" > "$WORK/output"
+stop=$(date +%s.%N)
+launched=$(cat "$WORK/launched")
+reported=$(grep -c 'is done: exit value 0' "$WORK/output")
+
+awk -v n="$JOBS" -v r="$reported" -v s="$start" -v l="$launched" -v e="$stop" \
+    -v t="$SLEEP" 'BEGIN {
+  printf "bench=bgstress jobs=%d launch_seconds=%.3f launches_per_sec=%.0f " \
+         "overhead_seconds=%.3f reported=%d\n",
+         n, l - s, n / (l - s), e - s - (t + 0.5), r }'
+[ "$reported" -eq "$JOBS" ]
@@ -0,0 +1,45 @@
+#!/bin/sh
+################################################################################
+# Program Name: cachebench.sh
+# Author: Mathew Kagel
+# Date: 2026-10-16
+# Description: Cost of running a script from its compiled cache. Generates a
+#   script of builtin "true" lines with quoted words, escapes, a variable and
+#   a redirection, so reading and splitting the lines is most of the work,
+#   and runs it with the cache off, once cold (compiling and writing the
+#   cache) and then warm (mapping it). Prints lines per second for each.
+#   Usage: bench/cachebench.sh [lines] [runs]
+################################################################################
+
+SHELL_BIN=${SMALLSH:-./smallsh}
+LINES=${1:-5000}
+RUNS=${2:-5}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+awk -v n="$LINES" 'BEGIN { for (i = 0; i < n; i++)
+  printf "true \"quoted argument %d\" '\''single quoted'\'' escaped\\ word $HOME > /dev/null\n", i }' \
+  > "$WORK/script"
+
+for mode in off cold warm; do
+  if [ "$mode" = off ]; then
+    SMALLSH_SCRIPT_CACHE=off
+  else
+    SMALLSH_SCRIPT_CACHE="$WORK/cache"
+  fi
+  export SMALLSH_SCRIPT_CACHE
+  runs=$RUNS
+  if [ "$mode" = cold ]; then
+    runs=1
+  fi
+  start=$(date +%s.%N)
+  i=0
+  while [ "$i" -lt "$runs" ]; do
+    "$SHELL_BIN" "$WORK/script" > /dev/null
+    i=$((i + 1))
+  done
+  stop=$(date +%s.%N)
+  awk -v m="$mode" -v n="$LINES" -v r="$runs" -v s="$start" -v e="$stop" 'BEGIN {
+    printf "bench=cache mode=%s lines=%d runs=%d seconds=%.3f lines_per_sec=%.0f\n",
+           m, n, r, e - s, n * r / (e - s) }'
+done
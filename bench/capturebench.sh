@@ -0,0 +1,43 @@
+#!/bin/sh
+################################################################################
+# Program Name: capturebench.sh
+# Author: Mathew Kagel
+# Date: 2026-10-16
+# Description: Throughput of $(...) on large outputs. Generates a file of
+#   numbered lines and captures it quoted, so no splitting is measured, with
+#   the builtin "cat" (no fork, read back from a memfd) and with /bin/cat
+#   (through a pipe), in smallsh and in bash. Prints megabytes per second.
+#   Usage: bench/capturebench.sh [megabytes] [runs]
+################################################################################
+
+SHELL_BIN=${SMALLSH:-./smallsh}
+MEGABYTES=${1:-16}
+RUNS=${2:-5}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+SMALLSH_SCRIPT_CACHE="$WORK/cache"
+export SMALLSH_SCRIPT_CACHE
+
+awk -v n="$MEGABYTES" 'BEGIN { line = sprintf("%063d", 0)
+  for (i = 0; i < n * 16384; i++) print line }' > "$WORK/data"
+
+for shell in smallsh bash; do
+  for command in cat /bin/cat; do
+    if [ "$shell" = bash ] && [ "$command" = cat ]; then
+      continue  # bash has no builtin cat
+    fi
+    awk -v r="$RUNS" -v c="$command" -v f="$WORK/data" 'BEGIN {
+      for (i = 0; i < r; i++) printf "true \"$(%s %s)\"\n", c, f }' > "$WORK/script"
+    if [ "$shell" = smallsh ]; then
+      bin=$SHELL_BIN
+    else
+      bin=bash
+    fi
+    start=$(date +%s.%N)
+    "$bin" "$WORK/script"
+    stop=$(date +%s.%N)
+    awk -v sh="$shell" -v c="$command" -v m="$MEGABYTES" -v r="$RUNS" -v s="$start" -v e="$stop" 'BEGIN {
+      printf "bench=capture shell=%s command=%s megabytes=%d runs=%d seconds=%.3f mb_per_sec=%.0f\n",
+             sh, c, m, r, e - s, m * r / (e - s) }'
+  done
+done
@@ -0,0 +1,39 @@
+#!/bin/sh
+################################################################################
+# Program Name: copybench.sh
+# Author: Mathew Kagel
+# Date: 2026-10-16
+# Description: Throughput of the cat and cp builtins, which copy inside the
+#   kernel, against the cat and cp programs, which copy through a userspace
+#   buffer. Each is run through smallsh on the same large file (the programs
+#   by full path, so the builtins are not used) and the MB per second is
+#   printed, one key=value line per case.
+#   Usage: bench/copybench.sh [file GB]
+################################################################################
+
+SHELL_BIN=${SMALLSH:-./smallsh}
+SIZE_GB=${1:-2}
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/copybench.XXXXXX")
+trap 'rm -rf "$WORK"' EXIT
+
+# Random data, so that nothing can be skipped as sparse or compressed
+head -c $((SIZE_GB * 1024 * 1024 * 1024)) /dev/urandom > "$WORK/source"
+
+run() { # name, command line
+  rm -f "$WORK/target"
+  sync # Keep writeback of the last case out of this one
+  start=$(date +%s.%N)
+  "$SHELL_BIN" -c "$2"
+  stop=$(date +%s.%N)
+  cmp -s "$WORK/source" "$WORK/target" || echo "copybench: $1 copy differs" >&2
+  awk -v n="$1" -v g="$SIZE_GB" -v s="$start" -v e="$stop" 'BEGIN {
+    printf "bench=copy case=%s gb=%d seconds=%.3f mb_per_sec=%.0f\n",
+           n, g, e - s, g * 1024 / (e - s) }'
+}
+
+run builtin_cat "cat $WORK/source > $WORK/target"
+run program_cat "/bin/cat $WORK/source > $WORK/target"
+run builtin_cat_stdin "cat < $WORK/source > $WORK/target"
+run builtin_cp "cp $WORK/source $WORK/target"
+run program_cp "/bin/cp $WORK/source $WORK/target"
+run userspace_dd "/bin/dd if=$WORK/source of=$WORK/target bs=128K status=none"
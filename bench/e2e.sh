@@ -0,0 +1,29 @@
+#!/bin/sh
+################################################################################
+# Program Name: e2e.sh
+# Author: Mathew Kagel
+# Date: 2026-10-16
+# Description: End to end throughput of smallsh. Generates large scripts of
+#   "true" and "/bin/true" lines (found through PATH and given as a path) and
+#   of comments (parsed but never run), runs each through the shell and prints
+#   commands per second, one key=value line per script.
+#   Usage: bench/e2e.sh [lines]
+################################################################################
+
+SHELL_BIN=${SMALLSH:-./smallsh}
+LINES=${1:-5000}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+export SMALLSH_SCRIPT_CACHE="${SMALLSH_SCRIPT_CACHE-$WORK/cache}" # Keeps ~/.cache clean
+
+for command in true /bin/true '#comment'; do
+  awk -v n="$LINES" -v c="$command" 'BEGIN { for (i = 0; i < n; i++) print c }' \
+    > "$WORK/script"
+  start=$(date +%s.%N)
+  "$SHELL_BIN" "$WORK/script" > /dev/null
+  stop=$(date +%s.%N)
+  awk -v c="$command" -v n="$LINES" -v s="$start" -v e="$stop" 'BEGIN {
+    if (c ~ /^#/) c = "comment"
+    printf "bench=e2e command=%s lines=%d seconds=%.3f commands_per_sec=%.0f\n",
+           c, n, e - s, n / (e - s) }'
+done
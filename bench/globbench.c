@@ -0,0 +1,100 @@
+/********************************************************************************
+* Program Name: globbench.c
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: Benchmark for pathname expansion in Glob.c. Fills a directory
+*   with entries, a quarter of them *.log, and times libc glob(3) on a few
+*   patterns, then GlobWord() the first time (which reads the directory with
+*   getdents64) and on average afterwards (which uses the cached listing).
+*   Usage: globbench [entries]
+********************************************************************************/
+#include "../CommandLine.h"
+#include "../Glob.h"
+#include <fcntl.h>
+#include <glob.h>
+#include <time.h>
+
+/********************************************************************************
+* Description: Now()
+*   This function returns the monotonic clock in microseconds.
+********************************************************************************/
+static double Now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+int main(int argc, char *argv[]) {
+  const char *patterns[] = {"*.log", "app-0001??.*", "app-[0-4]*[13579].txt"};
+  struct timespec settle = {0, 50000000};
+  char directory[] = "/tmp/globbench.XXXXXX";
+  char name[64];
+  char pattern[128];
+  char **matches;
+  struct arena arena;
+  glob_t found;
+  double start;
+  double elapsed;
+  int entries = 100000;
+  int repeats = 20;
+  int count = 0;
+  int fd;
+  int p;
+  int i;
+
+  if (argc > 1) {
+    entries = atoi(argv[1]);
+  }
+  if (mkdtemp(directory) == NULL) {
+    perror("mkdtemp");
+    return 1;
+  }
+  for (i = 0; i < entries; i++) {
+    snprintf(name, sizeof(name), "%s/app-%06d.%s", directory, i, i % 4 == 0 ? "log" : "txt");
+    fd = open(name, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    close(fd);
+  }
+  InitArena(&arena);
+
+  /* Let the directory's mtime age past the window in which a cached listing */
+  /* is not trusted, so the warm runs measure the cache and not a re-read */
+  nanosleep(&settle, NULL);
+
+  for (p = 0; p < (int) (sizeof(patterns) / sizeof(patterns[0])); p++) {
+    snprintf(pattern, sizeof(pattern), "%s/%s", directory, patterns[p]);
+
+    start = Now();
+    for (i = 0; i < repeats; i++) {
+      glob(pattern, 0, NULL, &found);
+      count = found.gl_pathc;
+      globfree(&found);
+    }
+    elapsed = (Now() - start) / repeats;
+    printf("bench=glob entries=%d pattern=%s method=libc matches=%d usec=%.1f\n",
+           entries, patterns[p], count, elapsed);
+
+    ClearDirCache();
+    start = Now();
+    count = GlobWord(pattern, &arena, &matches);
+    ResetArena(&arena);
+    printf("bench=glob entries=%d pattern=%s method=cold matches=%d usec=%.1f\n",
+           entries, patterns[p], count, Now() - start);
+
+    start = Now();
+    for (i = 0; i < repeats; i++) {
+      count = GlobWord(pattern, &arena, &matches);
+      ResetArena(&arena);
+    }
+    elapsed = (Now() - start) / repeats;
+    printf("bench=glob entries=%d pattern=%s method=cached matches=%d usec=%.1f\n",
+           entries, patterns[p], count, elapsed);
+  }
+
+  for (i = 0; i < entries; i++) {
+    snprintf(name, sizeof(name), "%s/app-%06d.%s", directory, i, i % 4 == 0 ? "log" : "txt");
+    unlink(name);
+  }
+  rmdir(directory);
+  FreeArena(&arena);
+  return 0;
+}
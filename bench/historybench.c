@@ -0,0 +1,90 @@
+/********************************************************************************
+* Program Name: historybench.c
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: Benchmark for the command history in History.c. Writes a
+*   history file of synthetic command lines, then times opening it, the first
+*   lookup by number (which finds the lines), the first search (which builds
+*   the trigram index), and then the average prefix and substring searches.
+*   Usage: historybench [entries]
+********************************************************************************/
+#include "../History.h"
+#include <time.h>
+
+/********************************************************************************
+* Description: Now()
+*   This function returns the monotonic clock in microseconds.
+********************************************************************************/
+static double Now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+int main(int argc, char *argv[]) {
+  const char *commands[] = {"ls -la /var/log/app", "grep -r ERROR /srv/logs/service",
+                            "kubectl get pods -n production", "tail -f /var/log/syslog",
+                            "ssh deploy@host", "make -j8 all", "git log --oneline",
+                            "cat /etc/hosts"};
+  const char *prefixes[] = {"kubectl get", "ssh deploy@host1", "make -j8", "git log"};
+  const char *texts[] = {"pods -n", "ERROR /srv", "syslog 7", "deploy@host12"};
+  char path[] = "/tmp/historybench.XXXXXX";
+  size_t length;
+  double start;
+  double elapsed;
+  int entries = 300000;
+  int searches = 1000;
+  int found = 0;
+  int fd;
+  int i;
+  FILE *file;
+
+  if (argc > 1) {
+    entries = atoi(argv[1]);
+  }
+  fd = mkstemp(path);
+  file = fdopen(fd, "w");
+  for (i = 0; i < entries; i++) {
+    fprintf(file, "%s %d\n", commands[i % 8], i);
+  }
+  fclose(file);
+
+  start = Now();
+  InitHistory(path);
+  printf("bench=history entries=%d phase=open usec=%.1f\n", entries, Now() - start);
+
+  start = Now();
+  HistoryEntry(entries / 2, &length);
+  printf("bench=history entries=%d phase=first_lookup usec=%.1f\n", entries, Now() - start);
+
+  start = Now();
+  found += SearchHistory("pods", 4, false, 0) > 0;
+  printf("bench=history entries=%d phase=first_search usec=%.1f\n", entries, Now() - start);
+
+  start = Now();
+  for (i = 0; i < searches; i++) {
+    found += HistoryEntry(1 + (i * 7919) % entries, &length) != NULL;
+  }
+  elapsed = (Now() - start) / searches;
+  printf("bench=history entries=%d phase=lookup usec=%.3f\n", entries, elapsed);
+
+  start = Now();
+  for (i = 0; i < searches; i++) {
+    found += SearchHistory(prefixes[i % 4], strlen(prefixes[i % 4]), true,
+                           entries - (i * 7919) % entries) > 0;
+  }
+  elapsed = (Now() - start) / searches;
+  printf("bench=history entries=%d phase=prefix_search usec=%.3f\n", entries, elapsed);
+
+  start = Now();
+  for (i = 0; i < searches; i++) {
+    found += SearchHistory(texts[i % 4], strlen(texts[i % 4]), false,
+                           entries - (i * 7919) % entries) > 0;
+  }
+  elapsed = (Now() - start) / searches;
+  printf("bench=history entries=%d phase=substring_search usec=%.3f found=%d\n",
+         entries, elapsed, found);
+
+  unlink(path);
+  return 0;
+}
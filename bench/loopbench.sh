@@ -0,0 +1,43 @@
+#!/bin/sh
+################################################################################
+# Program Name: loopbench.sh
+# Author: Mathew Kagel
+# Date: 2026-10-16
+# Description: Cost of a loop run by the shell itself. Runs nested for loops
+#   whose body is an if on the builtin "test" and the builtin "true", so no
+#   iteration forks, through smallsh and through bash, and prints iterations
+#   per second for each.
+#   Usage: bench/loopbench.sh [iterations]
+################################################################################
+
+SHELL_BIN=${SMALLSH:-./smallsh}
+COUNT=${1:-20000}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+export SMALLSH_SCRIPT_CACHE="${SMALLSH_SCRIPT_CACHE-$WORK/cache}" # Keeps ~/.cache clean
+
+# Two nested loops of at most 100 words each, bash parses a long word list slowly
+awk -v n="$COUNT" 'BEGIN {
+  printf "for i in"
+  for (i = 0; i < int((n + 99) / 100); i++) printf " %d", i
+  printf "\ndo\n  for j in"
+  for (j = 0; j < 100; j++) printf " %d", j
+  printf "; do if test $j = -1; then echo never; else true; fi; done\ndone\n" }' \
+  > "$WORK/script"
+COUNT=$(( (COUNT + 99) / 100 * 100 ))
+
+for shell in smallsh bash; do
+  if [ "$shell" = bash ] && ! command -v bash > /dev/null; then
+    continue
+  fi
+  start=$(date +%s.%N)
+  if [ "$shell" = smallsh ]; then
+    "$SHELL_BIN" "$WORK/script" > /dev/null
+  else
+    bash "$WORK/script" > /dev/null
+  fi
+  stop=$(date +%s.%N)
+  awk -v s="$shell" -v n="$COUNT" -v b="$start" -v e="$stop" 'BEGIN {
+    printf "bench=loop shell=%s iterations=%d seconds=%.3f iterations_per_sec=%.0f\n",
+           s, n, e - b, n / (e - b) }'
+done
@@ -0,0 +1,37 @@
+#!/bin/sh
+################################################################################
+# Program Name: parallel.sh
+# Author: Mathew Kagel
+# Date: 2026-10-16
+# Description: Runs the same batch of CPU bound commands through the smallsh
+#   "parallel" builtin at increasing worker counts and prints the wall time and
+#   speedup over -j 1 for each, one key=value line per run.
+#   Usage: bench/parallel.sh [commands] [max jobs]
+################################################################################
+
+SHELL_BIN=${SMALLSH:-./smallsh}
+COMMANDS=${1:-64}
+MAX_JOBS=${2:-$(getconf _NPROCESSORS_ONLN)}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# Each command hashes its own 8 MB file so the work is CPU bound
+head -c 8388608 /dev/urandom > "$WORK/data"
+i=0
+while [ $i -lt "$COMMANDS" ]; do
+  echo "sha256sum $WORK/data > /dev/null" >> "$WORK/commands"
+  i=$((i + 1))
+done
+
+base=""
+jobs=1
+while [ $jobs -le "$MAX_JOBS" ]; do
+  start=$(date +%s.%N)
+  "$SHELL_BIN" -c "parallel -j $jobs $WORK/commands" > /dev/null
+  stop=$(date +%s.%N)
+  seconds=$(awk "BEGIN { print $stop - $start }")
+  [ -z "$base" ] && base=$seconds
+  awk "BEGIN { printf \"bench=parallel jobs=%d commands=%d seconds=%.3f speedup=%.2f\\n\",
+               $jobs, $COMMANDS, $seconds, $base / $seconds }"
+  jobs=$((jobs * 2))
+done
@@ -0,0 +1,86 @@
+/********************************************************************************
+* Program Name: parsebench.c
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: Microbenchmark for the command line parser in CommandLine.c.
+*   Builds synthetic lines with a varying number of arguments, one of which
+*   contains $$, plus an input and output redirect, and prints how many lines
+*   per second CreatePipeline() can turn into commands.
+*   Usage: parsebench [seconds per case]
+********************************************************************************/
+#include "../CommandLine.h"
+#include <time.h>
+
+/********************************************************************************
+* Description: Now()
+*   This function returns the monotonic clock in seconds.
+********************************************************************************/
+static double Now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/********************************************************************************
+* Description: BuildLine()
+*   This function writes a command line with the given number of arguments
+*   into line and returns its length.
+********************************************************************************/
+static int BuildLine(char *line, int argCount) {
+  int length = sprintf(line, "command");
+  int i;
+
+  for (i = 1; i < argCount; i++) {
+    if (i == argCount / 2) {
+      length += sprintf(line + length, " file$$.%d", i);
+    } else {
+      length += sprintf(line + length, " argument%d", i);
+    }
+  }
+  length += sprintf(line + length, " < input.txt > output.txt\n");
+  return length;
+}
+
+int main(int argc, char *argv[]) {
+  int argCounts[] = {1, 4, 16, 64, 256};
+  struct pipeline parsed;
+  struct arena arena;
+  char line[8192];
+  char work[8192];
+  double seconds = 1.0;
+  double start;
+  double elapsed;
+  long lines;
+  int length;
+  int c;
+  int i;
+
+  if (argc > 1) {
+    seconds = atof(argv[1]);
+  }
+  InitArena(&arena);
+  InitPidString();
+
+  for (c = 0; c < (int) (sizeof(argCounts) / sizeof(argCounts[0])); c++) {
+    length = BuildLine(line, argCounts[c]);
+    lines = 0;
+    start = Now();
+    do {
+      /* Check the clock every 1024 lines so it stays out of the measurement */
+      for (i = 0; i < 1024; i++) {
+        memcpy(work, line, length + 1);
+        CreatePipeline(work, &parsed, &arena);
+        DestroyPipeline(&parsed);
+        ResetArena(&arena);
+      }
+      lines += 1024;
+      elapsed = Now() - start;
+    } while (elapsed < seconds);
+
+    printf("bench=parse args=%d bytes=%d lines_per_sec=%.0f\n",
+           argCounts[c], length, lines / elapsed);
+  }
+
+  FreeArena(&arena);
+  return 0;
+}
@@ -0,0 +1,35 @@
+#!/bin/sh
+################################################################################
+# Program Name: pipebench.sh
+# Author: Mathew Kagel
+# Date: 2026-10-16
+# Description: Throughput of commands piped into the shell's standard input,
+#   which is read by GetInput() rather than mapped like a script file. Pipes
+#   lines of the builtin "true", of comments and of blank lines through cat
+#   into smallsh and into bash, and prints lines per second for each.
+#   Usage: bench/pipebench.sh [lines]
+################################################################################
+
+SHELL_BIN=${SMALLSH:-./smallsh}
+LINES=${1:-1000000}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+for kind in true comment blank; do
+  awk -v n="$LINES" -v k="$kind" 'BEGIN {
+    line = k == "true" ? "true a b c" : k == "comment" ? "# a comment line" : ""
+    for (i = 0; i < n; i++) print line }' > "$WORK/input"
+  for shell in smallsh bash; do
+    if [ "$shell" = smallsh ]; then
+      bin=$SHELL_BIN
+    else
+      bin=bash
+    fi
+    start=$(date +%s.%N)
+    cat "$WORK/input" | "$bin" > /dev/null
+    stop=$(date +%s.%N)
+    awk -v sh="$shell" -v k="$kind" -v n="$LINES" -v s="$start" -v e="$stop" 'BEGIN {
+      printf "bench=pipe shell=%s input=%s lines=%d seconds=%.3f lines_per_sec=%.0f\n",
+             sh, k, n, e - s, n / (e - s) }'
+  done
+done
@@ -0,0 +1,201 @@
+/********************************************************************************
+* Program Name: servebench.c
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: Benchmark for "smallsh --serve". Starts a daemon, connects a
+*   number of clients that together send the given number of requests all at
+*   once, and times until every final frame is back, with the commands run
+*   and with their output captured. For comparison it then runs the same
+*   command the same number of times through a fresh "smallsh -c" each.
+*   Usage: servebench [requests] [clients]
+********************************************************************************/
+#include "../CommandLine.h"
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+/********************************************************************************
+* Description: Now()
+*   This function returns the monotonic clock in microseconds.
+********************************************************************************/
+static double Now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+/********************************************************************************
+* Description: Connect()
+*   This function connects to the daemon, retrying while it starts up.
+********************************************************************************/
+static int Connect(struct sockaddr_un *address) {
+  struct timespec pause = {0, 10000000};
+  int fd;
+  int tries;
+
+  for (tries = 0; tries < 300; tries++) {
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (connect(fd, (struct sockaddr *) address, sizeof(*address)) == 0) {
+      return fd;
+    }
+    close(fd);
+    nanosleep(&pause, NULL);
+  }
+  return -1;
+}
+
+/********************************************************************************
+* Description: CountFinals()
+*   This function counts the final frames in a block of replies. Output frames
+*   are skipped by their length, so their bytes are never mistaken for one.
+*   header and skip carry a partial frame header or output between calls.
+********************************************************************************/
+static int CountFinals(char *data, size_t length, char *header, size_t *headerLength,
+                       size_t *skip) {
+  size_t used;
+  size_t i = 0;
+  char kind[16];
+  int finals = 0;
+  int id;
+
+  while (i < length) {
+    if (*skip > 0) {
+      used = length - i < *skip ? length - i : *skip;
+      *skip -= used;
+      i += used;
+      continue;
+    }
+    header[(*headerLength)++] = data[i++];
+    if (header[*headerLength - 1] != '\n') {
+      continue;
+    }
+    header[*headerLength] = '\0';
+    *headerLength = 0;
+    if (sscanf(header, "%d %15s %zu", &id, kind, &used) == 3 &&
+        (strcmp(kind, "out") == 0 || strcmp(kind, "err") == 0)) {
+      *skip = used;
+    } else if (strcmp(kind, "time") != 0) {
+      finals++;
+    }
+  }
+  return finals;
+}
+
+/********************************************************************************
+* Description: RunClients()
+*   This function sends requests spread over clients and returns the
+*   microseconds until every one of them has had its final frame.
+********************************************************************************/
+static double RunClients(struct sockaddr_un *address, const char *request, int requests,
+                         int clients) {
+  static char data[65536];
+  char header[256];
+  size_t headerLength;
+  size_t skip;
+  double start;
+  ssize_t count;
+  int finals;
+  int fd;
+  int c;
+  int *fds = (int *) malloc(clients * sizeof(int));
+  int *counts = (int *) malloc(clients * sizeof(int));
+  char *batch;
+  size_t requestLength = strlen(request);
+  int each;
+  int i;
+
+  start = Now();
+  for (c = 0; c < clients; c++) {
+    fds[c] = Connect(address);
+    counts[c] = requests / clients + (c < requests % clients ? 1 : 0);
+  }
+  for (c = 0; c < clients; c++) {
+    each = counts[c];
+    batch = (char *) malloc(each * requestLength + 1);
+    for (i = 0; i < each; i++) {
+      memcpy(batch + i * requestLength, request, requestLength);
+    }
+    write(fds[c], batch, each * requestLength);
+    shutdown(fds[c], SHUT_WR);
+    free(batch);
+  }
+  for (c = 0; c < clients; c++) {
+    fd = fds[c];
+    finals = 0;
+    headerLength = 0;
+    skip = 0;
+    while ((count = read(fd, data, sizeof(data))) > 0) {
+      finals += CountFinals(data, count, header, &headerLength, &skip);
+    }
+    if (finals != counts[c]) {
+      fprintf(stderr, "client %d: %d of %d replies\n", c, finals, counts[c]);
+    }
+    close(fd);
+  }
+  free(fds);
+  free(counts);
+  return Now() - start;
+}
+
+int main(int argc, char *argv[]) {
+  char *serveArgs[] = {"./smallsh", "--serve", NULL, NULL};
+  char *scriptArgs[] = {"./smallsh", "-c", "echo hello", NULL};
+  char path[] = "/tmp/servebench.XXXXXX";
+  struct sockaddr_un address = {0};
+  double elapsed;
+  int requests = 2000;
+  int clients = 8;
+  pid_t daemon;
+  pid_t pid;
+  int i;
+
+  if (argc > 1) {
+    requests = atoi(argv[1]);
+  }
+  if (argc > 2) {
+    clients = atoi(argv[2]);
+  }
+  if (mkdtemp(path) == NULL) {
+    perror("mkdtemp");
+    return 1;
+  }
+  address.sun_family = AF_UNIX;
+  snprintf(address.sun_path, sizeof(address.sun_path), "%s/sock", path);
+  serveArgs[2] = address.sun_path;
+  if (posix_spawn(&daemon, serveArgs[0], NULL, NULL, serveArgs, environ) != 0) {
+    perror("posix_spawn");
+    return 1;
+  }
+
+  elapsed = RunClients(&address, "run echo hello\n", requests, clients);
+  printf("bench=serve mode=run requests=%d clients=%d usec=%.0f per_sec=%.0f\n",
+         requests, clients, elapsed, requests / (elapsed / 1e6));
+  elapsed = RunClients(&address, "capture echo hello\n", requests, clients);
+  printf("bench=serve mode=capture requests=%d clients=%d usec=%.0f per_sec=%.0f\n",
+         requests, clients, elapsed, requests / (elapsed / 1e6));
+
+  kill(daemon, SIGTERM);
+  waitpid(daemon, NULL, 0);
+  rmdir(path);
+
+  /* The same command through a new shell each time */
+  elapsed = Now();
+  for (i = 0; i < requests; i++) {
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+    posix_spawn(&pid, scriptArgs[0], &actions, NULL, scriptArgs, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    waitpid(pid, NULL, 0);
+  }
+  elapsed = Now() - elapsed;
+  printf("bench=serve mode=fresh-shell requests=%d usec=%.0f per_sec=%.0f\n",
+         requests, elapsed, requests / (elapsed / 1e6));
+  return 0;
+}
@@ -0,0 +1,73 @@
+/********************************************************************************
+* Program Name: spawnbench.c
+* Author: Mathew Kagel
+* Date: 2026-10-16
+* Description: Microbenchmark for LaunchCommand() in Spawn.c. Starts /bin/true
+*   repeatedly through both the posix_spawn and fork() paths while the process
+*   holds a configurable amount of touched memory, and prints the average
+*   launch-and-reap latency for each path.
+*   Usage: spawnbench [iterations] [ballast MB]
+********************************************************************************/
+#include "../Spawn.h"
+#include <sys/wait.h>
+#include <time.h>
+
+/********************************************************************************
+* Description: RunPath()
+*   This function launches the command the given number of times with the given
+*   spawn mode and returns the average microseconds per launch and reap.
+********************************************************************************/
+static double RunPath(struct command *input, enum spawnMode mode, int iterations) {
+  struct launchOptions options;
+  struct timespec start;
+  struct timespec end;
+  int childExitMethod;
+  int i;
+
+  InitLaunchOptions(&options);
+  spawnMode = mode;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < iterations; i++) {
+    pid_t pid = LaunchCommand(input, &options);
+    if (pid < 0) {
+      exit(1);
+    }
+    waitpid(pid, &childExitMethod, 0);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  return ((end.tv_sec - start.tv_sec) * 1e6 +
+          (end.tv_nsec - start.tv_nsec) / 1e3) / iterations;
+}
+
+int main(int argc, char *argv[]) {
+  struct command input;
+  char *args[] = {"/bin/true", NULL};
+  int iterations = 1000;
+  long ballastMB = 256;
+  char *ballast;
+
+  if (argc > 1) {
+    iterations = atoi(argv[1]);
+  }
+  if (argc > 2) {
+    ballastMB = atol(argv[2]);
+  }
+
+  /* Touch the ballast so that it is part of the resident set fork() must copy */
+  ballast = malloc(ballastMB * 1024 * 1024 + 1);
+  memset(ballast, 1, ballastMB * 1024 * 1024 + 1);
+
+  memset(&input, 0, sizeof(input));
+  input.args = args;
+  input.argCount = 1;
+  input.isForeground = true;
+
+  printf("bench=spawn mode=posix_spawn ballast_mb=%ld iterations=%d usec=%.1f\n",
+         ballastMB, iterations, RunPath(&input, SPAWN_POSIX, iterations));
+  printf("bench=spawn mode=fork ballast_mb=%ld iterations=%d usec=%.1f\n",
+         ballastMB, iterations, RunPath(&input, SPAWN_FORK, iterations));
+
+  free(ballast);
+  return 0;
+}
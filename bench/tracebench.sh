@@ -0,0 +1,42 @@
+#!/bin/sh
+################################################################################
+# Program Name: tracebench.sh
+# Author: Mathew Kagel
+# Date: 2026-10-16
+# Description: Cost of SMALLSH_TRACE. Runs the same scripts of "true" (a
+#   builtin) and "/bin/true" lines with tracing off and on, and prints commands
+#   per second for each along with how many events the trace held, so the
+#   overhead of recording can be read off one pair of lines. The time with
+#   tracing on includes writing the JSON at exit.
+#   Usage: bench/tracebench.sh [lines]
+################################################################################
+
+SHELL_BIN=${SMALLSH:-./smallsh}
+LINES=${1:-5000}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+export SMALLSH_SCRIPT_CACHE="${SMALLSH_SCRIPT_CACHE-$WORK/cache}" # Keeps ~/.cache clean
+
+for command in true /bin/true; do
+  awk -v n="$LINES" -v c="$command" 'BEGIN { for (i = 0; i < n; i++) print c }' \
+    > "$WORK/script"
+  for trace in off on; do
+    if [ "$trace" = on ]; then
+      SMALLSH_TRACE="$WORK/trace.json"
+    else
+      SMALLSH_TRACE=
+    fi
+    export SMALLSH_TRACE
+    start=$(date +%s.%N)
+    "$SHELL_BIN" "$WORK/script" > /dev/null
+    stop=$(date +%s.%N)
+    events=0
+    if [ "$trace" = on ]; then
+      events=$(grep -c '"ph":' "$WORK/trace.json")
+    fi
+    awk -v c="$command" -v t="$trace" -v n="$LINES" -v s="$start" -v e="$stop" \
+        -v v="$events" 'BEGIN {
+      printf "bench=trace command=%s trace=%s lines=%d seconds=%.3f " \
+             "commands_per_sec=%.0f events=%d\n", c, t, n, e - s, n / (e - s), v }'
+  done
+done
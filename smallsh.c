@@ -6,24 +6,45 @@
 *   the user and executing the commands. 
 ********************************************************************************/
 #include "CommandLine.h"
+#include "Builtins.h"
+#include "Control.h"
+#include "Directory.h"
+#include "History.h"
+#include "Limits.h"
+#include "Jobs.h"
+#include "PathCache.h"
+#include "Server.h"
+#include "ScriptCache.h"
+#include "Spawn.h"
+#include "Trace.h"
+#include <errno.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <termios.h>
 
-int forkCount = 0; /* Count of fork calls that are currently running */
-int countBG = 0; /* Count of background processes that haven't been reported to */
-                 /* the user yet */
-pid_t processBG[512]; /* Array of background processes */
+struct arena commandArena; /* Holds everything built for the current command line */
 
 bool firstStop = false; /* Used by SIGTSTP to tell the shell to enter foreground only mode */
 bool secondStop = false; /* Used by SIGTSTP to tell the shell to leave foreground only mode */
+bool stopFlag = false; /* True while the shell is in foreground only mode */
+bool jobControl = false; /* Interactive on a terminal: each job gets its own process group */
+struct controlParser control; /* The if, while and for blocks being read */
+int jumpLevels = 0; /* Loops a break or continue still has to leave */
 
 struct statusValues { /* Used by the "status" command to report exit status or */
   int exitStatus;     /* terminate signal, but not both */
   int termSignal;
+  bool timedOut;      /* The command was stopped for running past its deadline */
+  int limit;          /* Resource whose limit killed the command, -1 for none */
+  struct jobUsage usage; /* Resources used by the last foreground job */
+  bool hasUsage;      /* A foreground job has finished, so usage is set */
 };
+struct statusValues *shellStatus = NULL; /* The status of main(), seen inside $(...) */
+struct inputReader *shellInput = NULL; /* The reader of main(), where "parallel" reads stdin */
 
 /********************************************************************************
 * Description: catchSIGTSTP()
@@ -44,91 +65,6 @@ void catchSIGTSTP(int signo) {
 }
 
 
-/********************************************************************************
-* Description: catchSIGUSR1()
-*   This function is the signal handler for SIGUSR1.
-********************************************************************************/
-void catchSIGUSR1(int signo) {
-  char *message;
-  char number[20];
-  int n;
-  int i;
-  int j;
-  int maxProcessToClear = 10; /* Can clear 10 background processes at once */
-  int processesCleared = 0;  
-  int index;
-  pid_t childPid = -5;  
-  int childExitMethod = -5;
-  int exitStatus = -5;
-  int termSignal = -5; 
-
-  /* If there are background processes, terminate them one by one */
-  if (countBG > 0) {
-    do {
-      fflush(stdout);
-      /* Look for process that has finished and is zombied */
-      childPid = waitpid(-1, &childExitMethod, WNOHANG);
-  
-      /* If a child process has been found then terminate the process */
-      if (childPid > 0) {
-        /* Match the child PID to an index in processBG[] */
-        for (i = 0; i < countBG; i++) {
-          if (childPid == processBG[i]) {
-            index = i;
-            break;
-          }
-        }
-        
-        /* Determine exit/terminate condition */
-        if (WIFEXITED(childExitMethod) != 0) {
-          exitStatus = WEXITSTATUS(childExitMethod);
-        } else if (WIFSIGNALED(childExitMethod) != 0) {
-          termSignal = WTERMSIG(childExitMethod); 
-        }
-
-        /* Print appropriate message for how background process terminated */
-        message = "background pid ";
-        write(STDOUT_FILENO, message, 15);
-        n = sprintf(number, "%d", processBG[index]);
-        write(STDOUT_FILENO, number, n);
-        message = " is done: ";
-        write(STDOUT_FILENO, message, 10);
-        if (exitStatus >= 0) {
-          message = "exit value ";
-          write(STDOUT_FILENO, message, 11);
-          n = sprintf(number, "%d", childExitMethod);
-          write(STDOUT_FILENO, number, n); 
-        } else if (termSignal >= 0) {
-          message = "terminated by signal ";
-          write(STDOUT_FILENO, message, 21);
-          n = sprintf(number, "%d", childExitMethod);
-          write(STDOUT_FILENO, number, n);
-        }
-        message = "\n";
-        write(STDOUT_FILENO, message, 1);
-        
-        /* Remove child PID from processBG[], fill the gap left behind */
-        if (index != countBG) {
-          for (j = index; j < countBG - 1; j++) {
-            processBG[j] = processBG[j + 1];
-          }
-        }
-     
-        /* Reset exit/terminate values */
-        exitStatus = -5;
-        termSignal = -5;
-
-        countBG--; 
-      }
-
-      processesCleared++;
-      
-      /* If a background process cannot be found to terminate, or if the maximum */
-      /* number of processes to terimate has been reached, leave the loop */
-    } while (childPid > 0 && processesCleared < maxProcessToClear);
-  }
-}
-
 /********************************************************************************
 * Description: CheckResult()
 *   This function is a wrapper for perror(relevant info); exit(1). This gets used
@@ -146,236 +82,1774 @@ void CheckResult(int result, char *errorMessage) {
 *   This function responds to the command "exit". It terminate all running
 *   processes prior to the shell exiting.
 ********************************************************************************/
-int ExitSmallSh(char currentDir[]) {
-  int result;
-  int i;
-  for (i = 0; i < countBG; i++) {
-    result = kill(processBG[i], 15); /* Send terminate signal to each background process */
-    if (result < 0) {
-      return result;
+int ExitSmallSh(void) {
+  SignalJobs(SIGTERM); /* Send terminate signal to each background process */
+  return 0;
+}
+
+/********************************************************************************
+* Description: ChangeDir()
+*   This function responds to the command "cd". It changes to the directory the
+*   user gives as an argument, or to HOME with no argument. Relative paths are
+*   resolved against the real working directory, which children inherit.
+********************************************************************************/
+int ChangeDir(struct command *input) {
+  const char *path = input->argCount == 1 ? getenv("HOME") : input->args[1];
+
+  if (path == NULL) {
+    fprintf(stderr, "cd: HOME not set\n");
+    return 1;
+  }
+  if (SetDirectory(path) < 0) {
+    perror("chdir()");
+    return 1;
+  }
+  return 0;
+}
+
+/********************************************************************************
+* Description: PushDir()
+*   This function responds to the command "pushd". It saves the working
+*   directory on the stack and changes to the argument, or with no argument
+*   swaps the working directory with the top of the stack, then prints the stack.
+********************************************************************************/
+int PushDir(struct command *input) {
+  if (input->argCount > 2) {
+    fprintf(stderr, "usage: pushd [dir]\n");
+    return 1;
+  }
+  if (PushDirectory(input->argCount == 2 ? input->args[1] : NULL) < 0) {
+    if (input->argCount == 1 && errno == EINVAL) {
+      fprintf(stderr, "pushd: no other directory\n");
+    } else {
+      perror("pushd");
     }
+    return 1;
   }
+  PrintDirectories(stdout, false);
   return 0;
 }
 
 /********************************************************************************
-* Description: ChangeDir()
-*   This function responds to the command "cd". It attempts to change the
-*   directory to what the user inputs as an argument.
+* Description: PopDir()
+*   This function responds to the command "popd". It changes back to the
+*   directory on top of the stack, removes it and prints the stack.
 ********************************************************************************/
-int ChangeDir(struct command *input, char currentDir[]) {
-  int result;
-  char tempDir[1024];
+int PopDir(struct command *input) {
+  if (input->argCount > 1) {
+    fprintf(stderr, "usage: popd\n");
+    return 1;
+  }
+  if (PopDirectory() < 0) {
+    if (errno == EINVAL) {
+      fprintf(stderr, "popd: directory stack empty\n");
+    } else {
+      perror("popd");
+    }
+    return 1;
+  }
+  PrintDirectories(stdout, false);
+  return 0;
+}
 
-  /* Check for command "cd" with no arguments */
+/********************************************************************************
+* Description: ShowDirs()
+*   This function responds to the command "dirs". It prints the working
+*   directory and the stack below it, one numbered line each with -v, or
+*   empties the stack with -c.
+********************************************************************************/
+int ShowDirs(struct command *input) {
   if (input->argCount == 1) {
-    memset(currentDir, '\0', 512 * sizeof(char));
-    strcpy(currentDir, getenv("HOME")); /* Change directory to HOME path */
+    PrintDirectories(stdout, false);
+  } else if (input->argCount == 2 && strcmp(input->args[1], "-v") == 0) {
+    PrintDirectories(stdout, true);
+  } else if (input->argCount == 2 && strcmp(input->args[1], "-c") == 0) {
+    ClearDirectories();
+  } else {
+    fprintf(stderr, "usage: dirs [-c | -v]\n");
+    return 1;
+  }
+  return 0;
+}
+
+/********************************************************************************
+* Description: FindJob()
+*   This function returns the job a word names, or -1 after printing an error.
+*   A word starting with "%" is a job spec (see FindJobSpec()), and any other
+*   is a PID for "kill" and "wait", or a job number for "fg" and "bg". With no
+*   word it is the current job. SIGCHLD must be blocked.
+********************************************************************************/
+int FindJob(const char *name, const char *word, bool isPid) {
+  char spec[32];
+  int job;
+
+  if (word == NULL) {
+    job = FindJobSpec("%+");
+  } else if (word[0] == '%') {
+    job = FindJobSpec(word);
+  } else if (word[strspn(word, "0123456789")] != '\0' || word[0] == '\0') {
+    job = -1;
+  } else if (isPid) {
+    job = FindJobPid((pid_t) atol(word));
+  } else {
+    snprintf(spec, sizeof(spec), "%%%s", word);
+    job = FindJobSpec(spec);
+  }
+  if (job < 0) {
+    fprintf(stderr, "%s: %s: no such job\n", name, word != NULL ? word : "current");
+  }
+  return job;
+}
+
+/********************************************************************************
+* Description: Jobs()
+*   This function responds to the command "jobs". It lists the background and
+*   stopped jobs with their numbers and states, and with -l their PIDs.
+********************************************************************************/
+int Jobs(struct command *input) {
+  sigset_t oldMask;
+
+  if (input->argCount > 2 || (input->argCount == 2 && strcmp(input->args[1], "-l") != 0)) {
+    fprintf(stderr, "usage: jobs [-l]\n");
+    return 1;
+  }
+  BlockChildSignal(&oldMask);
+  PrintJobs(stdout, input->argCount == 2);
+  RestoreChildSignal(&oldMask);
+  return 0;
+}
+
+/********************************************************************************
+* Description: Background()
+*   This function responds to the command "bg". It continues each stopped job
+*   it is given, or the current job, in the background.
+********************************************************************************/
+int Background(struct command *input) {
+  sigset_t oldMask;
+  int result = 0;
+  int job;
+  int i = 1;
+
+  BlockChildSignal(&oldMask);
+  do {
+    job = FindJob("bg", i < input->argCount ? input->args[i] : NULL, false);
+    if (job < 0) {
+      result = 1;
+    } else if (IsJobDone(job)) {
+      fprintf(stderr, "bg: job %d has terminated\n", jobTable.jobs[job].number);
+      result = 1;
+    } else if (!IsJobStopped(job)) {
+      fprintf(stderr, "bg: job %d already in background\n", jobTable.jobs[job].number);
+    } else {
+      ContinueJob(job, false);
+      printf("[%d] %s &\n", jobTable.jobs[job].number, jobTable.jobs[job].name);
+    }
+  } while (++i < input->argCount);
+  RestoreChildSignal(&oldMask);
+  return result;
+}
+
+/* Signal names for "kill", without the SIG prefix */
+static const struct {
+  const char *name;
+  int signo;
+} signalNames[] = {
+  {"HUP", SIGHUP}, {"INT", SIGINT}, {"QUIT", SIGQUIT}, {"ILL", SIGILL}, {"TRAP", SIGTRAP},
+  {"ABRT", SIGABRT}, {"BUS", SIGBUS}, {"FPE", SIGFPE}, {"KILL", SIGKILL}, {"USR1", SIGUSR1},
+  {"SEGV", SIGSEGV}, {"USR2", SIGUSR2}, {"PIPE", SIGPIPE}, {"ALRM", SIGALRM},
+  {"TERM", SIGTERM}, {"CHLD", SIGCHLD}, {"CONT", SIGCONT}, {"STOP", SIGSTOP},
+  {"TSTP", SIGTSTP}, {"TTIN", SIGTTIN}, {"TTOU", SIGTTOU}, {"URG", SIGURG},
+  {"XCPU", SIGXCPU}, {"XFSZ", SIGXFSZ}, {"VTALRM", SIGVTALRM}, {"PROF", SIGPROF},
+  {"WINCH", SIGWINCH}, {"IO", SIGIO}, {"SYS", SIGSYS}
+};
+
+/********************************************************************************
+* Description: ParseSignal()
+*   This function returns the signal a name (with or without "SIG", in any
+*   case) or number stands for, or -1.
+********************************************************************************/
+int ParseSignal(const char *text) {
+  size_t i;
+
+  if (text[0] >= '0' && text[0] <= '9') {
+    return text[strspn(text, "0123456789")] == '\0' && atoi(text) < NSIG ? atoi(text) : -1;
+  }
+  if (strncasecmp(text, "SIG", 3) == 0) {
+    text += 3;
+  }
+  for (i = 0; i < sizeof(signalNames) / sizeof(signalNames[0]); i++) {
+    if (strcasecmp(text, signalNames[i].name) == 0) {
+      return signalNames[i].signo;
+    }
+  }
+  return -1;
+}
+
+/********************************************************************************
+* Description: Kill()
+*   This function responds to the command "kill". It sends a signal, SIGTERM
+*   unless one is given with -s, -NAME or -N, to each job or PID. A job gets it
+*   through its process group, and a stopped job is continued afterwards so
+*   that it acts on it. "kill -l" lists the signal names, and "kill -l N" names
+*   signal N, or the one that gave exit status N.
+********************************************************************************/
+int Kill(struct command *input) {
+  sigset_t oldMask;
+  int signo = SIGTERM;
+  int result = 0;
+  int job;
+  size_t j;
+  int k;
+  int i = 1;
+
+  if (input->argCount == 2 && strcmp(input->args[1], "-l") == 0) {
+    for (j = 0; j < sizeof(signalNames) / sizeof(signalNames[0]); j++) {
+      printf("%2d) SIG%s\n", signalNames[j].signo, signalNames[j].name);
+    }
     return 0;
-  } else { 
-    /* Attempt to run chdir() with user input as absolute path */
-    result = chdir(input->args[1]);
-    /* If absolute doesn't work, try chdir() with relative path */
-    if (result != 0) {
-      memset(tempDir, '\0', sizeof(tempDir));
-      strcpy(tempDir, currentDir);
-      strcat(tempDir, "/");
-      strcat(tempDir, input->args[1]);
-      result = chdir(tempDir);
-    }
-   
-    /* If chdir() works, actually change the directory string that the */
-    /* shell is tracking */
-    if (result == 0) {
-      if (input->args[1][0] == '/') { /* absolute path */
-        memset(currentDir, '\0', 512 * sizeof(char));
-        strcpy(currentDir, input->args[1]);
+  } else if (input->argCount == 3 && strcmp(input->args[1], "-l") == 0) {
+    signo = atoi(input->args[2]) > 128 ? atoi(input->args[2]) - 128 : atoi(input->args[2]);
+    for (j = 0; j < sizeof(signalNames) / sizeof(signalNames[0]); j++) {
+      if (signalNames[j].signo == signo) {
+        printf("%s\n", signalNames[j].name);
+        return 0;
+      }
+    }
+    fprintf(stderr, "kill: %s: invalid signal specification\n", input->args[2]);
+    return 1;
+  }
+  if (i + 1 < input->argCount && strcmp(input->args[i], "-s") == 0) {
+    signo = ParseSignal(input->args[i + 1]);
+    i += 2;
+  } else if (i < input->argCount && input->args[i][0] == '-' && input->args[i][1] != '\0') {
+    signo = ParseSignal(input->args[i] + 1);
+    i++;
+  }
+  if (signo < 0 || i >= input->argCount) {
+    fprintf(stderr, "usage: kill [-s signal | -signal] %%job | pid ...\n");
+    return 1;
+  }
+
+  BlockChildSignal(&oldMask);
+  for (; i < input->argCount; i++) {
+    if (input->args[i][0] != '%') {
+      if (input->args[i][0] == '\0' ||
+          input->args[i][strspn(input->args[i], "0123456789")] != '\0') {
+        fprintf(stderr, "kill: %s: not a job or PID\n", input->args[i]);
+        result = 1;
+      } else if (kill((pid_t) atol(input->args[i]), signo) < 0) {
+        fprintf(stderr, "kill: %s: %s\n", input->args[i], strerror(errno));
+        result = 1;
+      }
+      continue;
+    }
+    job = FindJob("kill", input->args[i], true);
+    if (job < 0) {
+      result = 1;
+    } else if (!IsJobDone(job)) {
+      if (jobTable.jobs[job].pgid > 0) {
+        kill(-jobTable.jobs[job].pgid, signo);
       } else {
-        strcat(currentDir, "/"); /* relative path */
-        strcat(currentDir, input->args[1]);
+        for (k = 0; k < jobTable.jobs[job].pidCount; k++) {
+          kill(jobTable.jobs[job].pids[k], signo);
+        }
+      }
+      if (jobTable.jobs[job].stopped > 0 && signo != SIGSTOP && signo != SIGTSTP &&
+          signo != SIGTTIN && signo != SIGTTOU && signo != SIGCONT) {
+        ContinueJob(job, false);
       }
-      return 0;
-    }  
+    }
   }
-  
-  /* If neither absolute or relative work, print error */
-  perror("chdir()"); 
-  return 1;
+  RestoreChildSignal(&oldMask);
+  return result;
+}
+
+/********************************************************************************
+* Description: WaitStatus()
+*   This function returns the value "wait" gives for a job that is done or
+*   stopped.
+********************************************************************************/
+int WaitStatus(int job) {
+  if (!IsJobDone(job)) {
+    return 128 + jobTable.jobs[job].stopSignal;
+  }
+  return JobExitValue(jobTable.jobs[job].waitStatus);
+}
+
+/********************************************************************************
+* Description: Wait()
+*   This function responds to the command "wait". With no arguments it waits
+*   for every background job that is running, and otherwise for each job or
+*   PID it is given, and returns the status of the last one. It sleeps on the
+*   job supervisor, so it costs nothing while the jobs run, and Ctrl-C stops
+*   it. A job that stops counts as finished. The jobs it waits for are still
+*   reported as done before the next prompt.
+********************************************************************************/
+int Wait(struct command *input) {
+  struct sigaction oldAction;
+  sigset_t oldMask;
+  int *waitJobs;
+  int count = 0;
+  int result = 0;
+  int job;
+  int i;
+
+  BlockChildSignal(&oldMask);
+  waitJobs = (int *) ArenaAlloc(&commandArena,
+                                (jobTable.jobCapacity + input->argCount) * sizeof(int));
+  if (input->argCount == 1) {
+    for (job = 0; job < jobTable.jobCapacity; job++) {
+      if (jobTable.jobs[job].isUsed && !jobTable.jobs[job].isForeground) {
+        waitJobs[count++] = job;
+      }
+    }
+  }
+  for (i = 1; i < input->argCount; i++) {
+    job = FindJob("wait", input->args[i], true);
+    if (job < 0) {
+      result = 127;
+    } else {
+      waitJobs[count++] = job;
+    }
+  }
+
+  /* Nothing removes a job while SIGCHLD is blocked, so the indices hold */
+  AllowInterrupt(&oldAction);
+  for (i = 0; i < count && !interrupted; i++) {
+    while (!IsJobDone(waitJobs[i]) && !IsJobStopped(waitJobs[i]) && !interrupted) {
+      WaitForChildren();
+    }
+    if (input->argCount > 1 && !interrupted) {
+      result = WaitStatus(waitJobs[i]);
+    }
+  }
+  EndInterrupt(&oldAction);
+  RestoreChildSignal(&oldMask);
+  return interrupted ? -SIGINT : result;
+}
+
+/********************************************************************************
+* Description: PrintUsage()
+*   This function prints the resources a job used on one line.
+********************************************************************************/
+void PrintUsage(FILE *stream, struct jobUsage *usage) {
+  char text[256];
+
+  FormatUsage(text, sizeof(text), usage);
+  fprintf(stream, "%s\n", text);
 }
 
 /********************************************************************************
 * Description: Status()
 *   This function responds to the command "status". It prints the exit value or
-*   terminating signal of the last command, but not both. As a side note, Status()
+*   terminating signal of the last command, but not both, and names the
+*   resource limit when one was what killed it. "status -v" also prints
+*   the resources used by the last foreground job. As a side note, Status()
 *   returns 0, so running "status" twice will list an exit value of 0.
 ********************************************************************************/
-int Status(struct statusValues *commandStatus) {
+int Status(struct command *input, struct statusValues *commandStatus) {
+  const char *timedOut = commandStatus->timedOut ? " (timed out)" : "";
+
+  if (input->argCount > 2 || (input->argCount == 2 && strcmp(input->args[1], "-v") != 0)) {
+    fprintf(stderr, "usage: status [-v]\n");
+    return 1;
+  }
+
   if (commandStatus->exitStatus >= 0) {
-    printf("exit value %d\n", commandStatus->exitStatus);  
+    printf("exit value %d%s\n", commandStatus->exitStatus, timedOut);  
+  } else if (commandStatus->limit >= 0) {
+    printf("killed: %s (signal %d)\n", LimitMessage(commandStatus->limit),
+           commandStatus->termSignal);
   } else if (commandStatus->termSignal >= 0) {
-    printf("terminated by signal %d\n", commandStatus->termSignal);
+    printf("terminated by signal %d%s\n", commandStatus->termSignal, timedOut);
+  }
+  if (input->argCount == 2 && commandStatus->hasUsage) {
+    PrintUsage(stdout, &commandStatus->usage);
+  }
+  return 0;
+}
+
+/********************************************************************************
+* Description: Time()
+*   This function responds to the command "time" when it is not a prefix. With
+*   no arguments it prints which jobs have their usage reported. "time -a" turns
+*   on reporting for every job, and "time -p" goes back to only the jobs with a
+*   "time" prefix.
+********************************************************************************/
+int Time(struct command *input) {
+  if (input->argCount == 1) {
+    printf("time: %s\n", jobTable.timeAll ? "every job" : "prefixed jobs");
+    return 0;
+  } else if (input->argCount == 2 && strcmp(input->args[1], "-a") == 0) {
+    jobTable.timeAll = true;
+    return 0;
+  } else if (input->argCount == 2 && strcmp(input->args[1], "-p") == 0) {
+    jobTable.timeAll = false;
+    return 0;
+  }
+  fprintf(stderr, "usage: time [-a | -p] [command ...]\n");
+  return 1;
+}
+
+/********************************************************************************
+* Description: PrintDuration()
+*   This function prints a number of milliseconds in seconds, or "none" for 0.
+********************************************************************************/
+void PrintDuration(const char *label, long milliseconds) {
+  if (milliseconds > 0) {
+    printf("%s %gs", label, milliseconds / 1000.0);
+  } else {
+    printf("%s none", label);
+  }
+}
+
+/********************************************************************************
+* Description: Timeout()
+*   This function responds to the command "timeout" when it is not a prefix.
+*   With no arguments it prints the shell-wide deadline and grace period.
+*   "timeout <duration>" sets the deadline every later job gets unless it has
+*   its own (0 turns it off), and "timeout -k <duration>" sets how long a late
+*   job has between SIGTERM and SIGKILL.
+********************************************************************************/
+int Timeout(struct command *input) {
+  long milliseconds;
+
+  if (input->argCount == 1) {
+    PrintDuration("default", jobTable.defaultTimeoutMs);
+    PrintDuration(", grace", jobTable.graceMs);
+    printf("\n");
+    return 0;
+  } else if (input->argCount == 2 && ParseDuration(input->args[1], &milliseconds)) {
+    jobTable.defaultTimeoutMs = milliseconds;
+    return 0;
+  } else if (input->argCount == 3 && strcmp(input->args[1], "-k") == 0 &&
+             ParseDuration(input->args[2], &milliseconds)) {
+    jobTable.graceMs = milliseconds;
+    return 0;
+  }
+  fprintf(stderr, "usage: timeout [-k] duration [command ...]\n");
+  return 1;
+}
+
+/********************************************************************************
+* Description: Limit()
+*   This function responds to the command "limit" when it is not a prefix.
+*   With no arguments it prints the limit every launched command gets for each
+*   resource, "limit <resource>" prints one, and "limit <resource> <value>"
+*   sets the default for every later command ("unlimited" removes it).
+********************************************************************************/
+int Limit(struct command *input) {
+  rlim_t value;
+  int resource;
+
+  if (input->argCount == 1) {
+    PrintLimits(stdout, NULL);
+    return 0;
+  } else if (input->argCount == 2 && PrintLimits(stdout, input->args[1])) {
+    return 0;
+  } else if (input->argCount == 3 &&
+             (resource = ParseLimit(input->args[1], input->args[2], &value)) >= 0) {
+    if (value == RLIM_INFINITY) {
+      shellLimits.setMask &= ~(1u << resource); /* Commands inherit the shell's own */
+    } else {
+      SetLimit(&shellLimits, resource, value);
+    }
+    return 0;
+  }
+  fprintf(stderr, "usage: limit [resource [value]] [command ...]\n");
+  return 1;
+}
+
+/********************************************************************************
+* Description: ShowHistory()
+*   This function responds to the command "history". With no arguments it
+*   lists every entry with its number, "history n" lists the last n, and
+*   "history -s text ..." lists the entries containing the text, newest first.
+********************************************************************************/
+int ShowHistory(struct command *input) {
+  const char *entry;
+  char text[2049];
+  size_t length;
+  int count = HistoryCount();
+  int first = 1;
+  int number;
+  int i;
+
+  if (input->argCount > 2 && strcmp(input->args[1], "-s") == 0) {
+    text[0] = '\0';
+    for (i = 2; i < input->argCount; i++) { /* The words make up one search */
+      snprintf(text + strlen(text), sizeof(text) - strlen(text), i > 2 ? " %s" : "%s",
+               input->args[i]);
+    }
+    for (number = SearchHistory(text, strlen(text), false, 0); number > 0;
+         number = SearchHistory(text, strlen(text), false, number)) {
+      entry = HistoryEntry(number, &length);
+      printf("%5d  %.*s\n", number, (int) length, entry);
+    }
+    return 0;
+  } else if (input->argCount == 2 && input->args[1][strspn(input->args[1], "0123456789")] == '\0') {
+    first = count - atoi(input->args[1]) + 1;
+    first = first < 1 ? 1 : first;
+  } else if (input->argCount != 1) {
+    fprintf(stderr, "usage: history [n | -s text]\n");
+    return 1;
+  }
+
+  for (number = first; number <= count; number++) {
+    entry = HistoryEntry(number, &length);
+    printf("%5d  %.*s\n", number, (int) length, entry);
+  }
+  return 0;
+}
+
+/********************************************************************************
+* Description: HashCommands()
+*   This function responds to the command "hash". With no arguments it lists the
+*   cached command paths with their hit counts and the cache's hit and miss
+*   counters. "hash -r" empties the cache, and "hash name ..." looks each name up
+*   so that it is cached before its first use.
+********************************************************************************/
+int HashCommands(struct command *input) {
+  int result = 0;
+  int i;
+
+  if (input->argCount == 1) {
+    PrintPathCache(stdout);
+    return 0;
+  }
+  for (i = 1; i < input->argCount; i++) {
+    if (strcmp(input->args[i], "-r") == 0) {
+      ClearPathCache();
+    } else if (LookupCommand(input->args[i]) == NULL) {
+      fprintf(stderr, "hash: %s: not found\n", input->args[i]);
+      result = 1;
+    }
+  }
+  return result;
+}
+
+/********************************************************************************
+* Description: IsForkedBuiltin()
+*   This function returns whether a builtin only reads the shell, so that a
+*   fork of the shell can run it as a pipeline stage, as in "history | grep".
+********************************************************************************/
+bool IsForkedBuiltin(const struct builtin *entry) {
+  switch (entry->id) {
+    case BUILTIN_DIRS:
+    case BUILTIN_HASH:
+    case BUILTIN_HISTORY:
+    case BUILTIN_JOBS:
+    case BUILTIN_STATUS:
+      return true;
+    default:
+      return false;
+  }
+}
+
+/********************************************************************************
+* Description: RunForkedBuiltin()
+*   This function runs one of the builtins IsForkedBuiltin() accepts in the
+*   fork Spawn.c makes of the shell, whose stdin and stdout are the stage's.
+*   Returns the exit value.
+********************************************************************************/
+int RunForkedBuiltin(struct command *input) {
+  switch (input->builtin->id) {
+    case BUILTIN_DIRS:
+      return ShowDirs(input);
+    case BUILTIN_HASH:
+      return HashCommands(input);
+    case BUILTIN_HISTORY:
+      return ShowHistory(input);
+    case BUILTIN_JOBS:
+      return Jobs(input);
+    case BUILTIN_STATUS:
+      return Status(input, shellStatus);
+    default:
+      return 1;
+  }
+}
+
+/********************************************************************************
+* Description: HasBuiltinStage()
+*   This function returns whether any stage of a pipeline is a builtin that
+*   changes the shell itself, printing an error for the first one. Those cannot
+*   run as a separate process. Utilities such as echo are launched as programs,
+*   and so is a kill stage, since the kill program takes the same signals and
+*   PIDs; only a %job has to be killed from the shell. The builtins that only
+*   read the shell are run by a fork of it with RunForkedBuiltin().
+********************************************************************************/
+bool HasBuiltinStage(struct pipeline *input) {
+  int i;
+  for (i = 0; i < input->stageCount; i++) {
+    if (input->stages[i].builtin != NULL && input->stages[i].builtin->id == BUILTIN_KILL) {
+      input->stages[i].builtin = NULL;
+    } else if (input->stages[i].builtin != NULL && input->stages[i].builtin->run == NULL &&
+               !IsForkedBuiltin(input->stages[i].builtin)) {
+      fprintf(stderr, "%s: builtins cannot be used in a pipeline\n",
+              input->stages[i].args[0]);
+      return true;
+    }
+  }
+  return false;
+}
+
+/********************************************************************************
+* Description: NextParallelLine()
+*   This function returns the next command line for "parallel", either from the
+*   mapped file or, if there is none, from the shell's own input reader, which
+*   may already hold the lines after "parallel". A terminal is prompted with
+*   "> ", and its end of input ends only the block. Returns NULL at the end.
+********************************************************************************/
+char *NextParallelLine(char **cursor, char *end) {
+  char *line;
+
+  if (cursor != NULL) {
+    return NextScriptLine(cursor, end);
+  }
+  if (shellInput == NULL) {
+    return NULL;
+  }
+  line = GetInput(shellInput, "> ", -1, NULL);
+  if (line == NULL && shellInput->isTerminal) {
+    shellInput->isDone = false; /* Leave the terminal usable for the prompt */
+  }
+  return line;
+}
+
+/********************************************************************************
+* Description: Parallel()
+*   This function responds to the command "parallel [-j N] [file]". It reads
+*   command lines from the file (or a "<" redirect, or stdin) and keeps exactly N
+*   of them running, N being the number of online processors by default. The
+*   next line is started as soon as a running one finishes. The commands read
+*   /dev/null instead of the shell's stdin, and a command killed by SIGINT stops
+*   any more from starting. At the end the results are summed up, and the exit
+*   value is 1 if any command failed.
+********************************************************************************/
+int Parallel(struct command *input) {
+  struct arena lineArena;
+  struct pipeline lineJob;
+  sigset_t oldMask;
+  const char *path = NULL;
+  char *script = NULL;
+  char *cursor = NULL;
+  char *end = NULL;
+  char *next;
+  size_t scriptLength = 0;
+  long workers = sysconf(_SC_NPROCESSORS_ONLN);
+  int *slots;
+  bool *slotFailed;
+  pid_t *pids;
+  pid_t pgid;
+  int pidCount;
+  bool lastStarted;
+  struct jobUsage usage;
+  bool timedOut;
+  bool isTimed;
+  bool stopped = false;
+  bool isDrained = false;
+  int running = 0;
+  int started = 0, succeeded = 0, failed = 0, signaled = 0, late = 0;
+  int childExitMethod;
+  struct launchOptions ends;
+  int nullFd;
+  int i = 1;
+
+  /* Options */
+  if (i + 1 < input->argCount && strcmp(input->args[i], "-j") == 0) {
+    workers = atol(input->args[i + 1]);
+    i += 2;
+  } else if (i < input->argCount && strncmp(input->args[i], "-j", 2) == 0) {
+    workers = atol(input->args[i] + 2);
+    i++;
+  }
+  if (i < input->argCount) {
+    path = input->args[i++];
+  } else if (input->isInputRedirect) {
+    path = input->inputFile;
+  }
+  if (workers < 1 || i < input->argCount) {
+    fprintf(stderr, "usage: parallel [-j N] [file]\n");
+    return 1;
+  }
+
+  if (path != NULL) {
+    script = MapScript(path, &scriptLength);
+    if (script == NULL) {
+      perror(path);
+      return 1;
+    }
+    cursor = script;
+    end = script + scriptLength;
+  }
+
+  slots = (int *) malloc(workers * sizeof(int));
+  slotFailed = (bool *) malloc(workers * sizeof(bool));
+  nullFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+  InitLaunchOptions(&ends);
+  ends.pipeIn = nullFd; /* Lines do not read the shell's stdin */
+  InitArena(&lineArena);
+  BlockChildSignal(&oldMask);
+
+  while (true) {
+    /* Fill every free slot */
+    while (running < workers && !stopped && !isDrained) {
+      next = NextParallelLine(cursor != NULL ? &cursor : NULL, end);
+      if (next == NULL) {
+        isDrained = true; /* A terminal is not read again after its end */
+        continue;
+      }
+      if (next[strspn(next, " \t\n")] == '\0' || IsComment(next)) {
+        continue;
+      }
+      if (!CreatePipeline(next, &lineJob, &lineArena) || HasBuiltinStage(&lineJob)) {
+        failed++;
+        ResetArena(&lineArena);
+        continue;
+      }
+      for (i = 0; i < lineJob.stageCount; i++) {
+        lineJob.stages[i].isForeground = true; /* Ctrl-C reaches them */
+      }
+
+      pids = (pid_t *) ArenaAlloc(&lineArena, lineJob.stageCount * sizeof(pid_t));
+      pidCount = LaunchPipeline(&lineJob, &ends, pids, &pgid, &lastStarted);
+      started++;
+      if (pidCount > 0) {
+        slots[running] = AddJob(pids, pidCount, pgid, true, lineJob.timeoutMs,
+                                lineJob.isTimed);
+        GraceJob(slots[running], lineJob.graceMs);
+        slotFailed[running] = !lastStarted;
+        running++;
+      } else {
+        failed++;
+      }
+      ResetArena(&lineArena);
+    }
+    if (running == 0) {
+      break;
+    }
+
+    /* Collect whatever has finished */
+    WaitForChildren();
+    for (i = 0; i < running; ) {
+      if (!IsJobDone(slots[i])) {
+        i++;
+        continue;
+      }
+      isTimed = jobTable.jobs[slots[i]].isTimed;
+      childExitMethod = FinishJob(slots[i], &timedOut, &usage);
+      if (isTimed) {
+        PrintUsage(stderr, &usage);
+      }
+      if (timedOut) {
+        late++;
+      }
+      if (WIFSIGNALED(childExitMethod)) {
+        signaled++;
+        stopped = stopped || WTERMSIG(childExitMethod) == SIGINT;
+      } else if (slotFailed[i] || WEXITSTATUS(childExitMethod) != 0) {
+        failed++;
+      } else {
+        succeeded++;
+      }
+      running--;
+      slots[i] = slots[running];
+      slotFailed[i] = slotFailed[running];
+    }
+  }
+
+  RestoreChildSignal(&oldMask);
+  FreeArena(&lineArena);
+  close(nullFd);
+  free(slots);
+  free(slotFailed);
+  if (script != NULL) {
+    UnmapScript(script, scriptLength);
+  }
+
+  printf("parallel: %d started, %d succeeded, %d failed, %d signaled, %d timed out\n",
+         started, succeeded, failed, signaled, late);
+  return failed + signaled > 0 ? 1 : 0;
+}
+
+/********************************************************************************
+* Description: WaitForeground()
+*   This function waits for a job in the foreground. If the job has a process
+*   group and the shell has the terminal, the terminal is handed to the group
+*   so that Ctrl-C and Ctrl-Z reach all of it, and taken back with its modes
+*   afterwards. When the job is done the status is set from its last process,
+*   whose resource limits explain how it ended, and a timed job has its usage
+*   printed to stderr. A job that stops is given a number and reported, and
+*   stays in the table for "fg" and "bg". stages name the job if it has no
+*   name yet. SIGCHLD must be blocked.
+********************************************************************************/
+void WaitForeground(int job, struct command *stages, int stageCount,
+                    struct statusValues *commandStatus) {
+  struct resourceLimits limits = jobTable.jobs[job].limits;
+  bool isTimed = jobTable.jobs[job].isTimed;
+  pid_t pgid = jobTable.jobs[job].pgid;
+  struct termios modes;
+  bool hasModes = false;
+  bool hasTerminal = false;
+  pid_t owner = -1;
+  int childExitMethod;
+
+  /* Hand the terminal to the process group so that Ctrl-C reaches all of it. */
+  /* A job launched to take the terminal may already have it, or have exited */
+  /* with it, and the shell must take it back all the same */
+  if (pgid > 0 && isatty(STDIN_FILENO)) {
+    owner = tcgetpgrp(STDIN_FILENO);
+  }
+  if (owner > 0 && (owner == getpgrp() || owner == pgid)) {
+    hasModes = tcgetattr(STDIN_FILENO, &modes) == 0;
+    hasTerminal = true;
+    if (owner == getpgrp()) {
+      tcsetpgrp(STDIN_FILENO, pgid);
+    }
   }
+
+  /* For foreground process, flush stdout, and sit there until the job completes */
+  fflush(stdout);
+  TRACE('B', "wait", NULL, 0);
+  childExitMethod = WaitForJob(job, &commandStatus->timedOut, &commandStatus->usage);
+  TRACE('E', "wait", "waitStatus", childExitMethod);
+  if (hasTerminal) {
+    tcsetpgrp(STDIN_FILENO, getpgrp());
+    if (hasModes) {
+      tcsetattr(STDIN_FILENO, TCSADRAIN, &modes); /* A stopped editor leaves raw mode on */
+    }
+  }
+
+  /* A stopped job waits for "fg" or "bg", $? is 128 plus the stop signal */
+  if (childExitMethod < 0) {
+    if (jobTable.jobs[job].name == NULL) {
+      NameJob(job, stages, stageCount);
+    }
+    printf("\n[%d]+  Stopped  %s\n", NumberJob(job), jobTable.jobs[job].name);
+    commandStatus->exitStatus = 128 + jobTable.jobs[job].stopSignal;
+    commandStatus->termSignal = -5;
+    commandStatus->timedOut = false;
+    commandStatus->limit = -1;
+    return;
+  }
+  commandStatus->hasUsage = true;
+  if (isTimed) {
+    PrintUsage(stderr, &commandStatus->usage);
+  }
+
+  /* Check exit value or terminate signal, and whether a limit sent it */
+  commandStatus->limit = LimitViolation(childExitMethod,
+                                        commandStatus->usage.userUs +
+                                        commandStatus->usage.systemUs, &limits);
+  if (WIFEXITED(childExitMethod) != 0) {
+    commandStatus->exitStatus = WEXITSTATUS(childExitMethod);
+    commandStatus->termSignal = -5;
+  } else if (WIFSIGNALED(childExitMethod) != 0) {
+    commandStatus->termSignal = WTERMSIG(childExitMethod); 
+    commandStatus->exitStatus = -5;
+    if (commandStatus->limit >= 0) {
+      printf("killed: %s (signal %d)\n", LimitMessage(commandStatus->limit),
+             commandStatus->termSignal);
+    } else {
+      printf("terminated by signal %d\n", commandStatus->termSignal); 
+    }
+  }
+}
+
+/********************************************************************************
+* Description: Foreground()
+*   This function responds to the command "fg". It continues the job it is
+*   given, or the current job, in the foreground and waits for it like any
+*   other foreground job, which sets the status. Returns 1 if there is no such
+*   job, or 0 once the job has been waited for.
+********************************************************************************/
+int Foreground(struct command *input, struct statusValues *commandStatus) {
+  sigset_t oldMask;
+  int job;
+
+  if (input->argCount > 2) {
+    fprintf(stderr, "usage: fg [%%job]\n");
+    return 1;
+  }
+  BlockChildSignal(&oldMask);
+  job = FindJob("fg", input->argCount == 2 ? input->args[1] : NULL, false);
+  if (job >= 0 && IsJobDone(job)) {
+    fprintf(stderr, "fg: job %d has terminated\n", jobTable.jobs[job].number);
+    job = -1;
+  }
+  if (job < 0) {
+    RestoreChildSignal(&oldMask);
+    return 1;
+  }
+  printf("%s\n", jobTable.jobs[job].name);
+  ContinueJob(job, true);
+  WaitForeground(job, NULL, 0, commandStatus);
+  RestoreChildSignal(&oldMask);
   return 0;
 }
 
+/********************************************************************************
+* Description: RunsInShell()
+*   This function returns whether a builtin utility can run inside the shell.
+*   It is launched as a program instead when running in the shell would not
+*   behave the same: in the background, under a deadline or resource limits,
+*   when its resource usage is wanted, or with an option only the program has.
+********************************************************************************/
+bool RunsInShell(struct command *input) {
+  return input->isForeground && !input->isTimed && !jobTable.timeAll &&
+         input->timeoutMs == 0 && input->limits == NULL &&
+         !(input->builtin->mayBlock && (jobTable.defaultTimeoutMs > 0 || HasLimits(NULL))) &&
+         HandlesOptions(input);
+}
+
 /********************************************************************************
 * Description: RunBuiltin()
-*   This function matches the command to a builtin function, and then runs that
-*   builtin function.
+*   This function runs a builtin inside the shell with its "<" and ">" files
+*   swapped in for the shell's stdin and stdout. The builtins that change the
+*   shell are run here, and the utilities through the registry. It then sets
+*   the status from the result.
 ********************************************************************************/
-void RunBuiltin(struct command *input, struct statusValues *commandStatus, char currentDir[]) {
-  if (!input->isComment) {
-    if (strcmp(input->args[0], "exit") == 0) {
-      commandStatus->exitStatus = ExitSmallSh(currentDir);
-    } else if (strcmp(input->args[0], "cd") == 0) {
-      commandStatus->exitStatus = ChangeDir(input, currentDir);  
-    } else if (strcmp(input->args[0], "status") == 0) {
-      commandStatus->exitStatus = Status(commandStatus);
+void RunBuiltin(struct command *input, struct statusValues *commandStatus) {
+  struct savedFds saved;
+  int result = 0;
+
+  if (input->isComment) {
+    return;
+  }
+  if (SwapRedirects(input, &saved) < 0) {
+    commandStatus->exitStatus = 1;
+    commandStatus->termSignal = -5;
+    commandStatus->timedOut = false;
+    return;
+  }
+
+  TRACE('B', input->builtin->name, NULL, 0);
+  switch (input->builtin->id) {
+    case BUILTIN_EXIT:
+      result = ExitSmallSh();
+      break;
+    case BUILTIN_CD:
+      result = ChangeDir(input);
+      break;
+    case BUILTIN_PUSHD:
+      result = PushDir(input);
+      break;
+    case BUILTIN_POPD:
+      result = PopDir(input);
+      break;
+    case BUILTIN_DIRS:
+      result = ShowDirs(input);
+      break;
+    case BUILTIN_STATUS:
+      result = Status(input, commandStatus);
+      break;
+    case BUILTIN_HASH:
+      result = HashCommands(input);
+      break;
+    case BUILTIN_TIMEOUT:
+      result = Timeout(input);
+      break;
+    case BUILTIN_LIMIT:
+      result = Limit(input);
+      break;
+    case BUILTIN_PARALLEL:
+      result = Parallel(input);
+      break;
+    case BUILTIN_TIME:
+      result = Time(input);
+      break;
+    case BUILTIN_HISTORY:
+      result = ShowHistory(input);
+      break;
+    case BUILTIN_JOBS:
+      result = Jobs(input);
+      break;
+    case BUILTIN_FG:
+      if (Foreground(input, commandStatus) == 0) {
+        TRACE('E', input->builtin->name, NULL, 0);
+        RestoreRedirects(&saved);
+        return; /* The job has set the status */
+      }
+      result = 1;
+      break;
+    case BUILTIN_BG:
+      result = Background(input);
+      break;
+    case BUILTIN_KILL:
+      result = Kill(input);
+      break;
+    case BUILTIN_WAIT:
+      result = Wait(input);
+      break;
+    default:
+      result = input->builtin->run(input);
+      break;
+  }
+  TRACE('E', input->builtin->name, "result", result);
+  RestoreRedirects(&saved);
+
+  /* A negative result is the signal that stopped the utility */
+  if (result < 0) {
+    commandStatus->exitStatus = -5;
+    commandStatus->termSignal = -result;
+    commandStatus->limit = -1;
+    printf("terminated by signal %d\n", commandStatus->termSignal);
+  } else {
+    commandStatus->exitStatus = result;
+    commandStatus->termSignal = -5;
+  }
+  commandStatus->timedOut = false;
+}
+
+/********************************************************************************
+* Description: RunJob()
+*   This function records processes that have just been launched as one job.
+*   A foreground job is waited for with WaitForeground(). A background job is
+*   given a job number and a name, it prints the last PID and the shell
+*   proceeds. Either kind is stopped if it runs past timeoutMs (see AddJob()),
+*   with the grace period of the stage that set it.
+*   stages are the job's commands, the last of which has the resource limits
+*   that explain how the job ended. SIGCHLD must be blocked.
+********************************************************************************/
+void RunJob(pid_t *pids, int pidCount, pid_t pgid, bool isForeground, long timeoutMs,
+            bool isTimed, struct command *stages, int stageCount,
+            struct statusValues *commandStatus) {
+  struct resourceLimits limits;
+  int job;
+  int i;
+
+  job = AddJob(pids, pidCount, pgid, isForeground, timeoutMs, isTimed);
+  MergeLimits(stages[stageCount - 1].limits, &limits);
+  LimitJob(job, &limits);
+  for (i = 0; i < stageCount; i++) {
+    if (stages[i].timeoutMs != 0) {
+      GraceJob(job, stages[i].graceMs);
     }
   }
+
+  if (isForeground) {
+    WaitForeground(job, stages, stageCount, commandStatus);
+  } else {
+    /* For background process, print PID and the shell proceeds */
+    NameJob(job, stages, stageCount);
+    NumberJob(job);
+    printf("background pid is %d\n", pids[pidCount - 1]);
+    SetLastBackground(pids[pidCount - 1]);
+  }
 }
 
 /********************************************************************************
 * Description: ExecuteCommand()
 *   This function executes a command that is passed to it.
 ********************************************************************************/
-void ExecuteCommand(struct command *input, struct statusValues *commandStatus, char currentDir[]) {
+void ExecuteCommand(struct command *input, struct statusValues *commandStatus) {
+  struct launchOptions options;
+  sigset_t oldMask;
   pid_t spawnpid = -5;
-  int childExitMethod = -5;
-  int fdI = -10;
-  int fdO = -10;
-  int dupResult = -10;
-  char nullDir[64] = "/dev/null";
-  int result;
 
-  /* The shell and background processes ignore the SIGINT signal by default */
-  /* This restores default SIGINT behavior to foreground processes, so */
-  /* that they can be terminated by Ctrl-C */
-  struct sigaction restore_action = {{0}};
-  restore_action.sa_handler = SIG_DFL;
+  /* Check for builtin */
+  if (input->builtin != NULL && (input->builtin->run == NULL || RunsInShell(input))) {
+    RunBuiltin(input, commandStatus);
+  } else {    
+    /* Execute command */
+    /* LaunchCommand() handles redirection, /dev/null for background processes */
+    /* and default SIGINT behavior for foreground processes */
+    InitLaunchOptions(&options);
+    if (jobControl) {
+      options.pgid = 0; /* A job of its own for the terminal and for Ctrl-Z */
+      options.takesTerminal = input->isForeground;
+    }
+    BlockChildSignal(&oldMask);
+    spawnpid = LaunchCommand(input, &options);
 
-  /* If forkCount is getting high, then there is probably a fork bomb, so abort */
-  if (forkCount > 50) {
-    abort();
+    if (spawnpid < 0) {
+      /* The error has already been printed, report it like a failed exec */
+      if (input->isForeground) {
+        commandStatus->exitStatus = 1;
+        commandStatus->termSignal = -5;
+        commandStatus->timedOut = false;
+      }
+    } else {
+      RunJob(&spawnpid, 1, options.pgid == 0 ? spawnpid : -1, input->isForeground,
+             input->timeoutMs, input->isTimed, input, 1, commandStatus);
+    }
+    RestoreChildSignal(&oldMask);
   }
+}
 
-  /* Check for builtin */
-  if (input->isBuiltin) {
-    RunBuiltin(input, commandStatus, currentDir);
+/********************************************************************************
+* Description: ExecutePipeline()
+*   This function executes a pipeline of two or more commands. The stages that
+*   started are run as one job, so a foreground pipeline is waited for as a unit
+*   with the last stage setting the status, and a background pipeline reports
+*   the PID of its last stage.
+********************************************************************************/
+void ExecutePipeline(struct pipeline *input, struct statusValues *commandStatus) {
+  struct launchOptions ends;
+  sigset_t oldMask;
+  pid_t *pids;
+  pid_t pgid;
+  int pidCount;
+  bool lastStarted;
+
+  /* The builtins change the shell itself, so they cannot be a stage */
+  if (HasBuiltinStage(input)) {
+    commandStatus->exitStatus = 1;
     commandStatus->termSignal = -5;
-  } else {    
-    /* Execute command */
-    /* Use fork() */
-    forkCount++;
-    spawnpid = fork();
- 
-    switch (spawnpid) {
-      case -1: {
-        perror("We have just lost cabin pressure...\n");
-        exit(1);
+    commandStatus->timedOut = false;
+    return;
+  }
+
+  pids = (pid_t *) ArenaAlloc(&commandArena, input->stageCount * sizeof(pid_t));
+  BlockChildSignal(&oldMask);
+  InitLaunchOptions(&ends);
+  ends.takesTerminal = jobControl && input->isForeground;
+  pidCount = LaunchPipeline(input, &ends, pids, &pgid, &lastStarted);
+
+  if (pidCount > 0) {
+    RunJob(pids, pidCount, pgid, input->isForeground, input->timeoutMs, input->isTimed,
+           input->stages, input->stageCount, commandStatus);
+  }
+  /* If the last stage never started, report it like a failed exec */
+  if (input->isForeground && !lastStarted) {
+    commandStatus->exitStatus = 1;
+    commandStatus->termSignal = -5;
+    commandStatus->timedOut = false;
+  }
+  RestoreChildSignal(&oldMask);
+}
+
+/********************************************************************************
+* Description: ReadOutput()
+*   This function reads fd to its end into a buffer that starts at 64KB and
+*   doubles with realloc() whenever it fills, each read going straight into
+*   the free space at its end. Returns the malloc()ed buffer and sets *length.
+********************************************************************************/
+char *ReadOutput(int fd, size_t *length) {
+  char *buffer = NULL;
+  char *grown;
+  size_t capacity = 0;
+  ssize_t n = 1;
+
+  *length = 0;
+  while (n != 0) {
+    if (*length == capacity) {
+      capacity = capacity == 0 ? 65536 : capacity * 2;
+      grown = (char *) realloc(buffer, capacity);
+      if (grown == NULL) {
+        perror("$(...)");
         break;
       }
-      case 0: {
-        /* Input redirection */
-        if (input->isInputRedirect) {                                                 
-          fdI = open(input->inputFile, O_RDONLY);
-          fcntl(fdI, F_SETFD, FD_CLOEXEC);
-          CheckResult(fdI, "open()");
-          dupResult = dup2(fdI, 0);
-          CheckResult(dupResult, "dup2()");
-        /* Default input redirection to /dev/null for background (when none other specified) */
-        } else if (!input->isForeground) {
-          fdI = open(nullDir, O_RDONLY);
-          fcntl(fdI, F_SETFD, FD_CLOEXEC);
-          CheckResult(fdI, "open()");
-          dupResult = dup2(fdI, 0);
-          CheckResult(dupResult, "dup2()");
-        }
-       
-        /* Output redirection */ 
-        if (input->isOutputRedirect) {
-          fdO = open(input->outputFile, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
-          fcntl(fdO, F_SETFD, FD_CLOEXEC);
-          CheckResult(fdO, "open()");
-          dupResult = dup2(fdO, 1);
-          CheckResult(dupResult, "dup2()");
-        /* Default output redirection to /dev/null for background (when none other specified) */
-        } else if (!input->isForeground) {
-          fdO = open(nullDir, O_RDONLY);
-          fcntl(fdO, F_SETFD, FD_CLOEXEC);
-          CheckResult(fdO, "open()");
-          dupResult = dup2(fdO, 1);
-          CheckResult(dupResult, "dup2()");
-        } 
-
-        /* Change child directory */ 
-        result = chdir(currentDir);
-        CheckResult(result, "chdir()");
-
-        /* Give foreground processes default SIGINT behavior */
-        if (input->isForeground) {
-          sigaction(SIGINT, &restore_action, NULL);  
+      buffer = grown;
+    }
+    n = read(fd, buffer + *length, capacity - *length);
+    if (n < 0 && errno != EINTR) {
+      perror("$(...)");
+      break;
+    } else if (n > 0) {
+      *length += n;
+    }
+  }
+  return buffer;
+}
+
+/********************************************************************************
+* Description: CaptureBuiltin()
+*   This function runs a builtin for $(...) in the shell, without a fork,
+*   with its stdout pointed at a memfd. A pipe could fill up with nobody
+*   reading it. The output is read back once the builtin is done.
+********************************************************************************/
+char *CaptureBuiltin(struct command *input, struct statusValues *commandStatus,
+                     size_t *length) {
+  char *output;
+  int captureFd;
+  int savedFd;
+
+  *length = 0;
+  captureFd = memfd_create("smallsh-capture", MFD_CLOEXEC);
+  if (captureFd < 0) {
+    perror("memfd_create()");
+    return NULL;
+  }
+  fflush(stdout); /* Earlier output belongs to the original stdout */
+  savedFd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+  dup2(captureFd, STDOUT_FILENO);
+  RunBuiltin(input, commandStatus);
+  fflush(stdout);
+  dup2(savedFd, STDOUT_FILENO);
+  close(savedFd);
+
+  lseek(captureFd, 0, SEEK_SET);
+  output = ReadOutput(captureFd, length);
+  close(captureFd);
+  return output;
+}
+
+/********************************************************************************
+* Description: CapturePipeline()
+*   This function launches a command or pipeline for $(...) with the last
+*   stage writing to a pipe, reads the pipe to its end and then waits for the
+*   stages as a foreground job. They stay in the shell's process group, so
+*   Ctrl-C reaches them while the shell reads.
+********************************************************************************/
+char *CapturePipeline(struct pipeline *input, struct statusValues *commandStatus,
+                      size_t *length) {
+  struct launchOptions ends;
+  sigset_t oldMask;
+  char *output = NULL;
+  pid_t *pids;
+  pid_t pgid;
+  int pipeFds[2];
+  int pidCount;
+  bool lastStarted;
+
+  *length = 0;
+  if (HasBuiltinStage(input)) {
+    return NULL;
+  }
+  if (pipe2(pipeFds, O_CLOEXEC) < 0) {
+    perror("pipe2()");
+    return NULL;
+  }
+  pids = (pid_t *) ArenaAlloc(&commandArena, input->stageCount * sizeof(pid_t));
+  BlockChildSignal(&oldMask);
+  InitLaunchOptions(&ends);
+  ends.pipeOut = pipeFds[1];
+  pidCount = LaunchPipeline(input, &ends, pids, &pgid, &lastStarted);
+  close(pipeFds[1]);
+  output = ReadOutput(pipeFds[0], length);
+  close(pipeFds[0]);
+  if (pidCount > 0) {
+    RunJob(pids, pidCount, pgid, true, input->timeoutMs, input->isTimed,
+           input->stages, input->stageCount, commandStatus);
+  }
+  RestoreChildSignal(&oldMask);
+  return output;
+}
+
+/********************************************************************************
+* Description: Substitute()
+*   This function runs the command of a $(...), given by CommandLine.c, and
+*   returns its output without the trailing newlines, malloc()ed, or NULL if
+*   there is none. The command is built in the command arena alongside the
+*   line that holds it and always runs in the foreground. A builtin that
+*   runs in the shell is run there with CaptureBuiltin(), so "$(pwd)" or
+*   "$(printf ...)" never forks; anything else goes to CapturePipeline().
+*   The command starts from the shell's status, so "$(status)" reports the
+*   last command, but its own status is not the status of the line.
+********************************************************************************/
+char *Substitute(const char *command, size_t length, size_t *outputLength) {
+  struct statusValues captureStatus = *shellStatus;
+  struct pipeline inner;
+  char *output = NULL;
+  char *line;
+  int i;
+
+  *outputLength = 0;
+  line = ArenaStrndup(&commandArena, command, length);
+  TRACE('B', "substitute", NULL, 0);
+  if (CreatePipeline(line, &inner, &commandArena) && !inner.isComment) {
+    inner.isForeground = true;
+    for (i = 0; i < inner.stageCount; i++) {
+      inner.stages[i].isForeground = true;
+    }
+    if (inner.stageCount == 1 && inner.stages[0].builtin != NULL &&
+        (inner.stages[0].builtin->run == NULL || RunsInShell(&inner.stages[0]))) {
+      if (inner.stages[0].builtin->id != BUILTIN_EXIT) { /* It cannot end the shell */
+        output = CaptureBuiltin(&inner.stages[0], &captureStatus, outputLength);
+      }
+    } else {
+      output = CapturePipeline(&inner, &captureStatus, outputLength);
+    }
+    DestroyPipeline(&inner);
+  }
+  while (*outputLength > 0 && output[*outputLength - 1] == '\n') {
+    (*outputLength)--;
+  }
+  TRACE('E', "substitute", "bytes", (long) *outputLength);
+  return output;
+}
+
+/********************************************************************************
+* Description: SetExitStatus()
+*   This function records an exit value the shell decided on itself, for
+*   "status" and $?.
+********************************************************************************/
+void SetExitStatus(struct statusValues *commandStatus, int value) {
+  commandStatus->exitStatus = value;
+  commandStatus->termSignal = -5;
+  commandStatus->timedOut = false;
+  SetLastStatus(value);
+}
+
+/********************************************************************************
+* Description: RunPipeline()
+*   This function executes a pipeline built from one line of input, records
+*   its status for $?, and destroys it along with everything in the command
+*   arena. isParsed false means building it failed and only the status is
+*   set. Returns 1 if the command was "exit" and the shell should stop, 0
+*   otherwise.
+********************************************************************************/
+int RunPipeline(struct pipeline *shellPipe, bool isParsed,
+                struct statusValues *commandStatus) {
+  struct command *shellComm;
+  int exitFlag = 0;
+  int i;
+
+  if (!isParsed) {
+    SetExitStatus(commandStatus, 1);
+    ResetArena(&commandArena);
+    TRACE('E', "line", "status", 1);
+    return 0;
+  }
+  
+  /* Check for SIGTSTP */
+  if (firstStop == true && stopFlag == false ) {
+    stopFlag = true;
+  } else if (secondStop == true && stopFlag == true) {
+    firstStop = false;
+    secondStop = false;
+    stopFlag = false;
+  }
+
+  /* Check for foreground only mode */
+  if (stopFlag && !shellPipe->isComment) {
+    if (!shellPipe->isForeground) {
+      shellPipe->isForeground = true;
+      for (i = 0; i < shellPipe->stageCount; i++) {
+        shellPipe->stages[i].isForeground = true;
+      }
+    }
+  } 
+
+  /* Execute command */
+  if (!shellPipe->isComment) {
+    if (shellPipe->stageCount > 1) {
+      ExecutePipeline(shellPipe, commandStatus);
+    } else {
+      shellComm = &shellPipe->stages[0];
+      ExecuteCommand(shellComm, commandStatus); 
+      if (strcmp(shellComm->args[0], "exit") == 0) {
+        exitFlag = 1;
+      }
+    }
+  }
+
+  /* $? is the exit value, or 128 plus the signal that terminated the command */
+  if (commandStatus->termSignal > 0) {
+    SetLastStatus(128 + commandStatus->termSignal);
+  } else if (commandStatus->exitStatus >= 0) {
+    SetLastStatus(commandStatus->exitStatus);
+  }
+
+  /* Destroy command */
+  DestroyPipeline(shellPipe);
+  ResetArena(&commandArena); /* Release the line's memory, keeping the blocks */
+  TRACE('E', "line", "status", commandStatus->termSignal > 0 ?
+        128 + commandStatus->termSignal : commandStatus->exitStatus);
+  return exitFlag;
+}
+
+/********************************************************************************
+* Description: RunTokens()
+*   This function builds a pipeline from tokens made by ReadTokens() and runs
+*   it with RunPipeline(). The tokens are not changed, so they can be run
+*   again. Returns 1 if the command was "exit", 0 otherwise.
+********************************************************************************/
+int RunTokens(const struct token *tokens, int count, struct statusValues *commandStatus) {
+  struct pipeline shellPipe;
+  bool isParsed;
+
+  TRACE('B', "line", NULL, 0);
+  TRACE('B', "build", NULL, 0);
+  isParsed = BuildPipeline(tokens, count, &shellPipe, &commandArena);
+  TRACE('E', "build", "stages", isParsed ? shellPipe.stageCount : 0);
+  return RunPipeline(&shellPipe, isParsed, commandStatus);
+}
+
+/********************************************************************************
+* Description: RunCondition()
+*   This function runs the condition of an if or while. Returns JUMP_NONE
+*   and sets isTrue from its status, or how the shell has to stop.
+********************************************************************************/
+enum controlJump RunCondition(struct controlNode *node, struct statusValues *commandStatus,
+                              bool *isTrue) {
+  if (RunTokens(node->tokens, node->tokenCount, commandStatus)) {
+    return JUMP_EXIT;
+  }
+  if (commandStatus->termSignal == SIGINT || (jobControl && interrupted)) {
+    return JUMP_INTERRUPT;
+  }
+  *isTrue = commandStatus->termSignal < 0 && commandStatus->exitStatus == 0;
+  return JUMP_NONE;
+}
+
+/********************************************************************************
+* Description: EndIteration()
+*   This function settles how a loop body ended. Finished background jobs are
+*   reported, as after each line. A break or continue for this loop is used
+*   up, one for an outer loop passes on. Returns true to leave the loop, with
+*   jump set to what the caller has to pass on.
+********************************************************************************/
+bool EndIteration(enum controlJump *jump) {
+  ServiceJobs();
+  ReportJobs();
+  if (*jump == JUMP_NONE && jobControl && interrupted) {
+    *jump = JUMP_INTERRUPT;
+  }
+  if (*jump == JUMP_BREAK || *jump == JUMP_CONTINUE) {
+    if (--jumpLevels > 0) {
+      return true;
+    }
+    if (*jump == JUMP_BREAK) {
+      *jump = JUMP_NONE;
+      return true;
+    }
+    *jump = JUMP_NONE;
+  }
+  return *jump != JUMP_NONE;
+}
+
+enum controlJump RunNodes(struct controlNode *node, struct statusValues *commandStatus);
+
+/********************************************************************************
+* Description: RunFor()
+*   This function runs a for loop. Its words are expanded and matched once,
+*   copied out of the command arena, which every command in the body resets,
+*   and the variable is set to each in turn as a shell variable, which the
+*   body's commands do not inherit. Afterwards the variable is back to what
+*   it was before the loop, so an outer loop's variable of the same name or
+*   an environment variable shows through again.
+********************************************************************************/
+enum controlJump RunFor(struct controlNode *node, struct statusValues *commandStatus) {
+  enum controlJump jump = JUMP_NONE;
+  struct pipeline words;
+  struct command *list;
+  char **values;
+  const char *saved = GetShellVariable(node->name); /* An outer loop's, kept alive by it */
+  char *text;
+  size_t size = 0;
+  bool hasRun = false;
+  int count;
+  int i;
+
+  if (!BuildPipeline(node->tokens, node->tokenCount, &words, &commandArena)) {
+    ResetArena(&commandArena);
+    SetExitStatus(commandStatus, 1);
+    return JUMP_NONE;
+  }
+  list = &words.stages[0]; /* args[0] is the word "in" */
+  count = list->argCount - 1;
+  for (i = 1; i <= count; i++) {
+    size += strlen(list->args[i]) + 1;
+  }
+  values = (char **) malloc(count * sizeof(char *) + size + 1);
+  text = (char *) (values + count);
+  for (i = 0; i < count; i++) {
+    values[i] = strcpy(text, list->args[i + 1]);
+    text += strlen(text) + 1;
+  }
+  DestroyPipeline(&words);
+  ResetArena(&commandArena);
+
+  for (i = 0; i < count && jump == JUMP_NONE; i++) {
+    SetShellVariable(node->name, values[i]);
+    jump = RunNodes(node->body, commandStatus);
+    hasRun = true;
+    if (EndIteration(&jump)) {
+      break;
+    }
+  }
+  if (saved != NULL) {
+    SetShellVariable(node->name, saved);
+  } else {
+    UnsetShellVariable(node->name);
+  }
+  free(values);
+  if (!hasRun) {
+    SetExitStatus(commandStatus, 0);
+  }
+  return jump;
+}
+
+/********************************************************************************
+* Description: RunWhile()
+*   This function runs a while loop, running its condition before each pass.
+*   The loop's status is the last command the body ran, or 0.
+********************************************************************************/
+enum controlJump RunWhile(struct controlNode *node, struct statusValues *commandStatus) {
+  enum controlJump jump;
+  struct statusValues bodyStatus;
+  bool hasRun = false;
+  bool isTrue;
+
+  while ((jump = RunCondition(node, commandStatus, &isTrue)) == JUMP_NONE && isTrue) {
+    jump = RunNodes(node->body, commandStatus);
+    bodyStatus = *commandStatus;
+    hasRun = true;
+    if (EndIteration(&jump)) {
+      break;
+    }
+  }
+  if (jump == JUMP_NONE) {
+    if (hasRun) {
+      *commandStatus = bodyStatus;
+      SetLastStatus(bodyStatus.termSignal > 0 ? 128 + bodyStatus.termSignal :
+                    bodyStatus.exitStatus);
+    } else {
+      SetExitStatus(commandStatus, 0);
+    }
+  }
+  return jump;
+}
+
+/********************************************************************************
+* Description: RunNodes()
+*   This function runs a list of control nodes in the shell. Each command is
+*   built from its tokens every time it runs, so a loop body is read once and
+*   expands its references afresh on each pass. Returns JUMP_NONE when the
+*   list ran to its end, or the break, continue, exit or interrupt that ended
+*   it, with jumpLevels set for a break or continue.
+********************************************************************************/
+enum controlJump RunNodes(struct controlNode *node, struct statusValues *commandStatus) {
+  enum controlJump jump = JUMP_NONE;
+  bool isTrue;
+
+  for (; node != NULL && jump == JUMP_NONE; node = node->next) {
+    switch (node->kind) {
+      case NODE_COMMAND:
+        if (RunTokens(node->tokens, node->tokenCount, commandStatus)) {
+          jump = JUMP_EXIT;
+        } else if (commandStatus->termSignal == SIGINT) {
+          jump = JUMP_INTERRUPT;
         }
- 
-        /* Attempt to run process, print error if it fails */
-        execvp(input->args[0], input->args); 
-        perror(input->args[0]);
-        exit(1);
         break;
-      }
-      default: { 
-        if (input->isForeground) {
-          /* For foreground process, flush stdout, and sit there until the child completes */
-          fflush(stdout); 
-          waitpid(spawnpid, &childExitMethod, 0);
-          forkCount--;
-          /* Check exit value or terminate signal */
-          if (WIFEXITED(childExitMethod) != 0) {
-            commandStatus->exitStatus = WEXITSTATUS(childExitMethod);
-            commandStatus->termSignal = -5;
-          } else if (WIFSIGNALED(childExitMethod) != 0) {
-            commandStatus->termSignal = WTERMSIG(childExitMethod); 
-            commandStatus->exitStatus = -5;
-            if (strcmp(input->args[0], "kill") != 0) {
-              printf("terminated by signal %d\n", commandStatus->termSignal); 
-            }
-          }
-        } else {
-          /* For background process, print PID and the shell proceeds */
-          printf("background pid is %d\n", spawnpid);
-          processBG[countBG] = spawnpid;
-          countBG++;
-          forkCount--;
+      case NODE_IF:
+        jump = RunCondition(node, commandStatus, &isTrue);
+        if (jump == JUMP_NONE && isTrue) {
+          jump = RunNodes(node->body, commandStatus);
+        } else if (jump == JUMP_NONE && node->orElse != NULL) {
+          jump = RunNodes(node->orElse, commandStatus);
+        } else if (jump == JUMP_NONE) {
+          SetExitStatus(commandStatus, 0);
         }
         break;
-      }
+      case NODE_WHILE:
+        jump = RunWhile(node, commandStatus);
+        break;
+      case NODE_FOR:
+        jump = RunFor(node, commandStatus);
+        break;
+      case NODE_BREAK:
+      case NODE_CONTINUE:
+        SetExitStatus(commandStatus, 0);
+        jumpLevels = node->levels;
+        jump = node->kind == NODE_BREAK ? JUMP_BREAK : JUMP_CONTINUE;
+        break;
+    }
+  }
+  return jump;
+}
+
+/********************************************************************************
+* Description: RunControl()
+*   This function runs what the control parser has read once every block is
+*   closed, and then drops it. At a terminal Ctrl-C leaves the loops even
+*   while only builtins run. Returns 1 if "exit" ran, 0 otherwise.
+********************************************************************************/
+int RunControl(enum controlResult result, struct statusValues *commandStatus) {
+  struct sigaction oldAction;
+  enum controlJump jump;
+
+  if (result == CONTROL_ERROR) {
+    SetExitStatus(commandStatus, 1);
+  }
+  if (result != CONTROL_READY) {
+    return 0;
+  }
+  if (jobControl) {
+    AllowInterrupt(&oldAction);
+  }
+  jump = RunNodes(control.nodes, commandStatus);
+  if (jobControl) {
+    EndInterrupt(&oldAction);
+  }
+  ResetControl(&control);
+
+  if (jump == JUMP_BREAK || jump == JUMP_CONTINUE) {
+    fprintf(stderr, "%s: only meaningful in a loop\n",
+            jump == JUMP_BREAK ? "break" : "continue");
+    SetExitStatus(commandStatus, 1);
+  } else if (jump == JUMP_INTERRUPT && commandStatus->termSignal != SIGINT) {
+    commandStatus->exitStatus = -5; /* Ctrl-C between commands */
+    commandStatus->termSignal = SIGINT;
+    SetLastStatus(128 + SIGINT);
+  }
+  return jump == JUMP_EXIT;
+}
+
+/********************************************************************************
+* Description: EndControl()
+*   This function drops a block still open when the input ends.
+********************************************************************************/
+void EndControl(struct statusValues *commandStatus) {
+  if (control.depth > 0) {
+    fprintf(stderr, "syntax error: unexpected end of file\n");
+    ResetControl(&control);
+    SetExitStatus(commandStatus, 1);
+  }
+}
+
+/********************************************************************************
+* Description: RunLine()
+*   This function builds a command from one line of input and runs it with
+*   RunPipeline(). The line is tokenized in place. Returns 1 if the command
+*   was "exit" and the shell should stop, 0 otherwise.
+********************************************************************************/
+int RunLine(char line[], struct statusValues *commandStatus) {
+  struct pipeline shellPipe;
+  bool isParsed;
+
+  /* Blank lines are not commands */
+  if (line[strspn(line, " \t\n")] == '\0') {
+    return 0;
+  }
+
+  /* The lines of an if, while or for are read into a tree and run once it closes */
+  if (control.depth > 0 || StartsControl(line)) {
+    return RunControl(AddControlText(&control, line), commandStatus);
+  }
+
+  TRACE('B', "line", NULL, 0);
+  TRACE('B', "parse", NULL, 0);
+  isParsed = CreatePipeline(line, &shellPipe, &commandArena);
+  TRACE('E', "parse", "stages", isParsed ? shellPipe.stageCount : 0);
+  return RunPipeline(&shellPipe, isParsed, commandStatus);
+}
+
+/********************************************************************************
+* Description: RunScript()
+*   This function runs every line of a script buffer without prompting. Each
+*   line is terminated in place and handed straight to RunLine(), just as
+*   GetInput() hands over its lines. Finished background processes are
+*   reported after each line just like before each prompt.
+********************************************************************************/
+void RunScript(char *script, size_t length, struct statusValues *commandStatus) {
+  char *cursor = script;
+  char *end = script + length;
+  char *line;
+  int exitFlag = 0;
+
+  while (!exitFlag && (line = NextScriptLine(&cursor, end)) != NULL) {
+    exitFlag = RunLine(line, commandStatus);
+    ServiceJobs();
+    ReportJobs();
+  }
+  EndControl(commandStatus);
+}
+
+/********************************************************************************
+* Description: RunCompiledScript()
+*   This function runs a script compiled by OpenCompiledScript(), the same way
+*   RunScript() runs its text. Each line's tokens only need their references
+*   expanded and their patterns matched to become a pipeline. A line kept as
+*   text, which is one with a control keyword or a ';', goes through
+*   RunLine(). Tokens inside an open block go to the control parser.
+********************************************************************************/
+void RunCompiledScript(struct compiledScript *script, struct statusValues *commandStatus) {
+  struct compiledLine line;
+  enum controlResult result;
+  int exitFlag = 0;
+
+  while (!exitFlag && NextCompiledLine(script, &line, &commandArena)) {
+    if (line.text != NULL) {
+      exitFlag = RunLine(line.text, commandStatus);
+    } else if (control.depth > 0) {
+      result = AddControlTokens(&control, line.tokens, line.tokenCount);
+      ResetArena(&commandArena);
+      exitFlag = RunControl(result, commandStatus);
+    } else {
+      exitFlag = RunTokens(line.tokens, line.tokenCount, commandStatus);
     }
+    ServiceJobs();
+    ReportJobs();
   }
+  EndControl(commandStatus);
 }
 
-int main() {
-  struct command shellComm;
+int main(int argc, char *argv[]) {
   int exitFlag = 0;
   struct statusValues commandStatus;
   commandStatus.exitStatus = -5;
   commandStatus.termSignal = -5;
-  char currentDir[512];
-  bool stopFlag = false;
-  char readBuffer[2049];
+  commandStatus.timedOut = false;
+  commandStatus.limit = -1;
+  commandStatus.hasUsage = false;
+  shellStatus = &commandStatus;
+  struct inputReader input;
+  char *line = NULL;
+  char *historyLine = NULL; /* A line with a history reference, which can grow */
+  char defaultHistory[1024];
+  char *historyPath;
+  bool hasHistory = false;
+  char *script = NULL;
+  size_t scriptLength = 0;
+  bool isMapped = false;
+  struct compiledScript compiled;
+  bool isCompiled = false;
+  char *serverPath = NULL;
   
-  memset(currentDir, '\0', sizeof(currentDir));
+  InitArena(&commandArena);
+  InitControl(&control);
+  InitPidString();
+
+  /* $(...) runs its command in the shell, but not in the --serve daemon, */
+  /* which must never block on one. Set before a script is compiled */
+  if (argc < 3 || strcmp(argv[1], "--serve") != 0) {
+    SetSubstitution(Substitute);
+  }
+  SetForkedBuiltin(RunForkedBuiltin);
+
+  /* SMALLSH_SPAWN=fork selects the fork() launch path instead of posix_spawn */
+  SetSpawnMode(getenv("SMALLSH_SPAWN"));
+
+  /* SMALLSH_TRACE=file records every command's phases, written at exit */
+  if (getenv("SMALLSH_TRACE") != NULL && getenv("SMALLSH_TRACE")[0] != '\0' &&
+      !InitTrace(getenv("SMALLSH_TRACE"), getenv("SMALLSH_TRACE_EVENTS"))) {
+    perror("SMALLSH_TRACE");
+  }
+
+  /* "smallsh -c 'commands'" runs the argument, "smallsh file" runs the file, */
+  /* and "smallsh --serve path" runs what clients send to a socket at path */
+  if (argc > 2 && strcmp(argv[1], "--serve") == 0) {
+    serverPath = argv[2];
+  } else if (argc > 2 && strcmp(argv[1], "-c") == 0) {
+    script = argv[2];
+    scriptLength = strlen(argv[2]);
+  } else if (argc > 1 && !IsScriptCacheOff()) {
+    /* A script file is compiled once and its tokens cached for later runs */
+    if (!OpenCompiledScript(argv[1], &compiled)) {
+      perror(argv[1]);
+      return 1;
+    }
+    isCompiled = true;
+  } else if (argc > 1) {
+    script = MapScript(argv[1], &scriptLength);
+    if (script == NULL) {
+      perror(argv[1]);
+      return 1;
+    }
+    isMapped = true;
+  }
   
-  /* Start currentDir to the current working directory */ 
-  getcwd(currentDir, sizeof(currentDir));
+  /* Hold on to the directory the shell was started in */
+  InitDirectory();
 
-  /* Set up signal handlers for SIGUSR1 AND SIGTSTP */
+  /* Set up signal handlers for SIGCHLD AND SIGTSTP */
   /* Set up signal ignore handler for SIGINT */
-  struct sigaction SIGUSR1_action = {{0}}, SIGTSTP_action = {{0}},
-                   ignore_action = {{0}};
+  struct sigaction SIGTSTP_action = {{0}}, ignore_action = {{0}};
 
-  SIGUSR1_action.sa_handler = catchSIGUSR1;
-  sigfillset(&SIGUSR1_action.sa_mask);
-  SIGUSR1_action.sa_flags = 0;
+  InitJobs();
 
   SIGTSTP_action.sa_handler = catchSIGTSTP;
   sigfillset(&SIGTSTP_action.sa_mask);
@@ -383,54 +1857,99 @@ int main() {
 
   ignore_action.sa_handler = SIG_IGN;
 
-  sigaction(SIGUSR1, &SIGUSR1_action, NULL);
   sigaction(SIGTSTP, &SIGTSTP_action, NULL);
   sigaction(SIGINT, &ignore_action, NULL);  
+  sigaction(SIGTTOU, &ignore_action, NULL); /* Lets the shell take the terminal back */
+
+  if (serverPath != NULL) {
+    return Serve(serverPath);
+  }
+
+  /* Standard input is read through one reader, also by "parallel" in a script */
+  InitInput(&input, STDIN_FILENO);
+  shellInput = &input;
+
+  /* Non-interactive modes run the script and exit with the last status */
+  if (script != NULL || isCompiled) {
+    if (isCompiled) {
+      RunCompiledScript(&compiled, &commandStatus);
+      CloseCompiledScript(&compiled);
+    } else {
+      RunScript(script, scriptLength, &commandStatus);
+    }
+    if (isMapped) {
+      UnmapScript(script, scriptLength);
+    }
+    if (commandStatus.termSignal >= 0) {
+      return 128 + commandStatus.termSignal;
+    }
+    return commandStatus.exitStatus >= 0 ? commandStatus.exitStatus : 0;
+  }
+
+  /* At a terminal the shell runs each job in its own process group */
+  jobControl = isatty(STDIN_FILENO) && tcgetpgrp(STDIN_FILENO) == getpgrp();
+
+  /* History is kept for a terminal, or wherever SMALLSH_HISTORY points */
+  historyPath = getenv("SMALLSH_HISTORY");
+  if (historyPath == NULL && isatty(STDIN_FILENO) && getenv("HOME") != NULL) {
+    snprintf(defaultHistory, sizeof(defaultHistory), "%s/.smallsh_history", getenv("HOME"));
+    historyPath = defaultHistory;
+  }
+  if (historyPath != NULL && historyPath[0] != '\0') {
+    hasHistory = InitHistory(historyPath);
+  }
 
   /* Shell starts */
   do {
-    /* Get command */
-    memset(readBuffer, '\0', sizeof(readBuffer));
-    GetInput(readBuffer);
-    
-    /* Check if input is a single newline character */
-    if (strcmp(readBuffer, "\n") != 0) {
-      CreateCommand(readBuffer, &shellComm);
-      
-      /* Check for SIGTSTP */
-      if (firstStop == true && stopFlag == false ) {
-        stopFlag = true;
-      } else if (secondStop == true && stopFlag == true) {
-        firstStop = false;
-        secondStop = false;
-        stopFlag = false;
-      }
+    /* Get command, NULL at the end of the input */
+    TRACE('B', "read", NULL, 0);
+    line = GetInput(&input, control.depth > 0 ? "> " : ": ", jobTable.supervisorFd,
+                    ServiceJobs);
+    TRACE('E', "read", NULL, 0);
+    if (line == NULL) {
+      break;
+    }
 
-      /* Check for foreground only mode */
-      if (stopFlag) {
-        if (!shellComm.isForeground) {
-          shellComm.isForeground = true;
+    /* Expand a "!" reference, in a copy since it can make the line longer, */
+    /* and record the line */
+    if (hasHistory) {
+      if (line[strspn(line, " \t")] == '!') {
+        if (historyLine == NULL) {
+          historyLine = (char *) malloc(input.limit + 1);
         }
-      } 
-   
-      /* Execute command */
-      if (!shellComm.isComment) {
-        ExecuteCommand(&shellComm, &commandStatus, currentDir); 
-        if (strcmp(shellComm.args[0], "exit") == 0) {
-          exitFlag = 1;
+        strcpy(historyLine, line);
+        line = historyLine;
+        if (ExpandHistory(line, input.limit + 1) < 0) {
+          commandStatus.exitStatus = 1;
+          commandStatus.termSignal = -5;
+          commandStatus.timedOut = false;
+          continue;
         }
       }
-
-      /* Destroy command */
-      DestroyCommand(&shellComm); /* Free memory in arguments */     
+      AddHistory(line);
     }
-    /* Call background process handler */
-    /* This is a signal handler rather than a function call because */
-    /* I want it to block other signals while it runs */
-    raise(SIGUSR1);
+    
+    /* Run the command, RunLine() skips a line that is empty */
+    exitFlag = RunLine(line, &commandStatus);
+
+    /* Report background processes the SIGCHLD handler has reaped */
+    ReportJobs();
   } while (!exitFlag);
+  FreeInput(&input);
+  free(historyLine);
 
+  /* The end of the input ends the shell like "exit" at a terminal, and like */
+  /* the end of a script otherwise */
+  if (line == NULL) {
+    EndControl(&commandStatus);
+    if (input.isTerminal) {
+      printf("\n");
+      ExitSmallSh();
+    } else if (commandStatus.termSignal >= 0) {
+      return 128 + commandStatus.termSignal;
+    } else if (commandStatus.exitStatus >= 0) {
+      return commandStatus.exitStatus;
+    }
+  }
   return 0;
 }
-
-
@@ -0,0 +1,39 @@
+#!/bin/sh
+################################################################################
+# Program Name: parallelstdin.sh
+# Author: Mathew Kagel
+# Date: 2026-10-16
+# Description: Regression test for "parallel" reading its lines from the
+#   shell's piped standard input. The shell's reader takes stdin a block at a
+#   time, so the lines after "parallel" are already in its buffer and must
+#   come from there rather than from a second read of fd 0. Pipes a parallel
+#   block through smallsh, on its own and in a -c command, and checks every
+#   line ran. Prints "ok" or what went wrong, and exits 1 on a failure.
+#   Usage: tests/parallelstdin.sh
+################################################################################
+
+SHELL_BIN=${SMALLSH:-./smallsh}
+SMALLSH_SCRIPT_CACHE=off
+export SMALLSH_SCRIPT_CACHE
+failures=0
+
+# check name expected actual
+check() {
+  if [ "$2" = "$3" ]; then
+    echo "ok $1"
+  else
+    echo "FAIL $1: expected '$2', got '$3'"
+    failures=$((failures + 1))
+  fi
+}
+
+out=$(printf 'echo one\nparallel -j2\necho a\necho b\necho c\n' | "$SHELL_BIN" 2>&1 | sort | tr '\n' ' ')
+check "piped block" "a b c one parallel: 3 started, 3 succeeded, 0 failed, 0 signaled, 0 timed out " "$out"
+
+out=$(printf 'echo a\necho b\n' | "$SHELL_BIN" -c 'parallel -j2' 2>&1 | sort | tr '\n' ' ')
+check "-c command" "a b parallel: 2 started, 2 succeeded, 0 failed, 0 signaled, 0 timed out " "$out"
+
+out=$(printf 'parallel -j1\n' | "$SHELL_BIN" 2>&1)
+check "empty block" "parallel: 0 started, 0 succeeded, 0 failed, 0 signaled, 0 timed out" "$out"
+
+[ "$failures" -eq 0 ]